@@ -0,0 +1,131 @@
+/*
+Group name: Kismet
+
+Asynchronous block reader of a byte range of a file. A reader thread fills a fixed ring of
+buffers with `pread` while the consumer works on the blocks already read, so disk latency overlaps
+with tokenizing and memory use is `nbuffers * blockSize` however large the file (or its lines).
+With two buffers (the default) this is double buffering: block N is consumed while block N + 1 is
+being read.
+*/
+
+#ifndef BLOCKREADER_H
+#define BLOCKREADER_H
+
+#include <algorithm> 			// std::min
+#include <condition_variable> 	// std::condition_variable
+#include <iostream> 			// std::cout
+#include <memory> 				// std::unique_ptr
+#include <mutex> 				// std::mutex, std::unique_lock
+#include <string> 				// std::string
+#include <thread> 				// std::thread
+#include <vector> 				// std::vector
+#include <fcntl.h> 				// posix_fadvise
+#include <unistd.h> 			// pread, close
+#include "Partition.h"
+
+#define DEFAULT_BLOCK_SIZE (1 << 20) // bytes per block of the streaming reader
+#define DEFAULT_READ_BUFFERS 2 		// blocks of the streaming reader's ring
+
+class BlockReader {
+	/* Reads the bytes [range.begin, range.end) of a file in blocks of `blockSize` bytes. Call
+	`next()` to get the blocks in order; each block stays valid until the following call. */
+
+public:
+	BlockReader(const std::string& filename, ByteRange range, std::size_t blockSize = DEFAULT_BLOCK_SIZE,
+		int nbuffers = DEFAULT_READ_BUFFERS)
+		: range(range), blockSize(blockSize), buffers(nbuffers < 2 ? 2 : nbuffers), sizes(buffers.size(), 0) {
+		fd = open_or_exit(filename);
+		posix_fadvise(fd, range.begin, range.size(), POSIX_FADV_SEQUENTIAL);
+		for (auto& buffer: buffers)
+			buffer.reset(new char[blockSize]);
+		nblocks = range.size() <= 0 ? 0 : (range.size() + blockSize - 1) / blockSize;
+		reader = std::thread(&BlockReader::read_loop, this);
+	}
+
+	~BlockReader() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		slotFree.notify_all();
+		reader.join();
+		close(fd);
+	}
+
+	BlockReader(const BlockReader&) = delete;
+	BlockReader& operator=(const BlockReader&) = delete;
+
+	bool next(const char*& data, std::size_t& size) {
+		/* Release the previous block and wait for the next one. Return false at the end of the
+		range. */
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (consumed > 0 && released < consumed) {
+			released = consumed; // the previous block can be read into again
+			slotFree.notify_one();
+		}
+		if (consumed == nblocks)
+			return false;
+		blockReady.wait(lock, [this] { return produced > consumed; });
+		if (failed) {
+			std::cout << "Error: could not read input file" << std::endl;
+			exit(1);
+		}
+		int slot = consumed % buffers.size();
+		data = buffers[slot].get();
+		size = sizes[slot];
+		consumed++;
+		return true;
+	}
+
+private:
+	ByteRange range;
+	std::size_t blockSize;
+	std::vector< std::unique_ptr<char[]> > buffers; // ring of blocks
+	std::vector<std::size_t> sizes; 				// bytes held by each buffer
+	int fd;
+	long long nblocks;
+	long long produced = 0; 	// blocks read by the reader thread
+	long long consumed = 0; 	// blocks handed out by `next()`
+	long long released = 0; 	// blocks given back to the reader thread
+	bool stopping = false;
+	bool failed = false;
+	std::mutex mutex;
+	std::condition_variable blockReady;
+	std::condition_variable slotFree;
+	std::thread reader;
+
+	void read_loop() {
+		/* Reader thread: fill the next free buffer of the ring, block after block. */
+
+		for (long long block = 0; block < nblocks; block++) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotFree.wait(lock, [this, block] { return stopping || block - released < (long long) buffers.size(); });
+				if (stopping)
+					return;
+			}
+
+			int slot = block % buffers.size();
+			long long offset = range.begin + block * (long long) blockSize;
+			std::size_t want = std::min<long long>(blockSize, range.end - offset);
+			std::size_t got = 0;
+			while (got < want) { // pread may return fewer bytes than asked
+				ssize_t bytesRead = pread(fd, buffers[slot].get() + got, want - got, offset + got);
+				if (bytesRead <= 0)
+					break;
+				got += bytesRead;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				sizes[slot] = got;
+				failed |= got < want;
+				produced++;
+			}
+			blockReady.notify_one();
+		}
+	}
+};
+
+#endif
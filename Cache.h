@@ -0,0 +1,277 @@
+/*
+Group name: Kismet
+
+Persistent cache of the word counter of every file, so repeated runs over a mostly unchanged
+corpus only tokenize what changed. A cache file is kept per text file and pair of word length
+bounds, in a cache directory, and holds:
+	- a CacheHeader: magic number, version, word length bounds, size and modification time of the
+	  text file when it was counted, hash of its content (and of its whole hash blocks, so the hash
+	  of an appended file can be carried on from there) and the length of its path
+	- the path of the text file
+	- the counter of the whole file, front-coded in the wire format of Counter.h
+A cache file is trusted as is while the size and modification time of its text file are unchanged.
+Otherwise (or always with --cache-verify) the content hash of the bytes it covers is recomputed:
+if it still matches, the file was only touched or appended to, and only the appended bytes are
+counted. The modification time of a touched file is written back to its cache file, so it is
+trusted as is again by the next runs.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint> 			// std::uint64_t
+#include <cstdio> 			// std::rename, std::remove
+#include <cstring> 			// std::memcpy
+#include <fstream> 			// std::ifstream, std::ofstream, std::fstream
+#include <iostream> 		// std::cout
+#include <sstream> 			// std::ostringstream
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <climits> 			// PATH_MAX
+#include <cstdlib> 			// realpath
+#include <sys/stat.h> 		// stat, mkdir
+#include <mpi.h>
+#include "Counter.h"
+#include "MappedFile.h"
+#include "Partition.h"
+#include "Reduce.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define CACHE_MAGIC 0x31484357u 		// "WCH1"
+#define CACHE_VERSION 2
+#define CACHE_HASH_BLOCK (1 << 20) 		// bytes per independently hashed block of a text file
+
+struct CacheHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::int32_t minWordLen;
+	std::int32_t maxWordLen;
+	std::int64_t fileSize; 		// bytes of the text file covered by the counter
+	std::int64_t mtime; 		// modification time of the text file, in nanoseconds
+	std::uint64_t contentHash; 	// hash_file_range() of the covered bytes
+	std::uint64_t headHash; 	// hash_file_range() of the whole hash blocks of the covered bytes
+	std::uint32_t endsWithNewline; 	// whether the covered bytes end a line, so appending is safe
+	std::uint32_t pathSize; 	// bytes of the path following the header
+};
+
+struct CacheEntry {
+	/* What the cache holds for a text file, and what is left to count. Plain data, so it can be
+	broadcast as bytes. */
+
+	long long fileSize; 	// current size of the text file
+	long long mtime; 		// current modification time of the text file
+	long long cachedSize; 	// bytes counted by the cache file, valid once the cache is checked
+	int hasCache; 			// whether a cache file with the same bounds exists
+	int valid; 				// whether its counter can be used
+	CacheHeader header; 	// header of the cache file [if hasCache]
+};
+
+std::string get_absolute_path(const std::string& filename) {
+	/* Return the absolute path of an existing file, or the name as given if it cannot be resolved. */
+
+	char absolute[PATH_MAX];
+	return realpath(filename.c_str(), absolute) ? std::string(absolute) : filename;
+}
+
+std::string get_cache_path(const std::string& cacheDir, const std::string& filename, int minWordLen, int maxWordLen) {
+	/* Return the path of the cache file of a text file and pair of word length bounds. The name is
+	the hash of the absolute path of the text file, which is also stored in the cache file. */
+
+	std::string path = get_absolute_path(filename);
+	std::ostringstream name;
+	name << cacheDir << "/" << std::hex << hash_bytes(path.data(), path.size()) << std::dec
+		<< "-" << minWordLen << "-" << maxWordLen << ".wcc";
+	return name.str();
+}
+
+void get_file_stamp(const std::string& filename, long long& size, long long& mtime) {
+	/* Get the size and modification time (in nanoseconds) of a file. */
+
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) {
+		std::cout << "Error: could not stat file '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	size = st.st_size;
+	mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+bool read_cache_header(const std::string& cachePath, CacheHeader& header, std::string& path) {
+	/* Read the header and text file path of a cache file. Return false if there is no cache file
+	or it is not one. */
+
+	std::ifstream cache(cachePath, std::ios::in | std::ios::binary);
+	if (!cache.read((char*) &header, sizeof(CacheHeader)))
+		return false;
+	if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION)
+		return false;
+	path.resize(header.pathSize);
+	return (bool) cache.read(&path[0], header.pathSize);
+}
+
+bool load_cache(const std::string& cachePath, Counter& counter) {
+	/* Add the counter of a cache file to `counter`. Return false if the cache file is corrupt. */
+
+	MappedRange cache(cachePath, { 0, get_file_size(cachePath) });
+	CacheHeader header;
+	if (cache.size() < sizeof(CacheHeader))
+		return false;
+	std::memcpy(&header, cache.data(), sizeof(CacheHeader));
+	std::size_t begin = sizeof(CacheHeader) + header.pathSize;
+	if (begin > cache.size())
+		return false;
+	return compose_counter(counter, cache.data() + begin, cache.size() - begin) == cache.size() - begin;
+}
+
+void write_cache(const std::string& cachePath, const std::string& filename, CacheHeader header,
+	const Counter& counter) {
+	/* Write the cache file of a text file, through a temporary file renamed over the old one so a
+	cache file is never seen half-written. */
+
+	std::string path = get_absolute_path(filename);
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.pathSize = path.size();
+
+	std::string buffer((const char*) &header, sizeof(CacheHeader));
+	buffer += path;
+	decompose_counter(counter, buffer, true);
+
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream cache(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!cache.write(buffer.data(), buffer.size()) || (cache.close(), std::rename(tempPath.c_str(), cachePath.c_str()) != 0)) {
+		std::cout << "Warning: could not write cache file '" << cachePath << "'" << std::endl;
+		std::remove(tempPath.c_str());
+	}
+}
+
+std::uint64_t hash_file_range(const std::string& filename, ByteRange range, int rank, int nprocs) {
+	/* Content hash of a byte range of a file, which starts at a multiple of CACHE_HASH_BLOCK. The
+	range is cut into blocks of CACHE_HASH_BLOCK bytes, hashed independently by the processes in
+	turn, and the block hashes (seeded with their index in the file) are summed, so the hash does not
+	depend on the number of processes, and the hash of [0, a) plus that of [a, b) is the hash of
+	[0, b) when `a` is a multiple of CACHE_HASH_BLOCK. Collective over MPI_COMM_WORLD. */
+
+	long long firstBlock = range.begin / CACHE_HASH_BLOCK;
+	long long nblocks = (range.size() + CACHE_HASH_BLOCK - 1) / CACHE_HASH_BLOCK;
+	std::uint64_t eachHash = 0, hash = 0;
+	for (long long block = rank; block < nblocks; block += nprocs) {
+		long long begin = range.begin + block * CACHE_HASH_BLOCK;
+		MappedRange data(filename, { begin, std::min(range.end, begin + CACHE_HASH_BLOCK) });
+		eachHash += hash_bytes(data.data(), data.size(), firstBlock + block);
+	}
+	MPI_Allreduce(&eachHash, &hash, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+	return hash;
+}
+
+void refresh_cache_mtime(const std::string& cachePath, CacheHeader header, long long mtime) {
+	/* Rewrite the modification time in the header of a cache file whose text file was only touched,
+	so the next runs trust it again without hashing the text file. */
+
+	header.mtime = mtime;
+	std::fstream cache(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+	if (!cache.write((const char*) &header, sizeof(CacheHeader)))
+		std::cout << "Warning: could not write cache file '" << cachePath << "'" << std::endl;
+}
+
+bool ends_with_newline(const std::string& filename, long long size) {
+	/* Return whether the first `size` bytes of a file are whole lines. */
+
+	if (size == 0)
+		return true;
+	int fd = open_or_exit(filename);
+	char last = 0;
+	bool newline = pread(fd, &last, 1, size - 1) == 1 && last == '\n';
+	close(fd);
+	return newline;
+}
+
+std::vector<CacheEntry> check_cache(const std::vector<std::string>& filenames, const std::string& cacheDir,
+	int minWordLen, int maxWordLen, bool verify, int rank, int nprocs) {
+	/* Find out which part of every text file is already counted by its cache file. ROOT looks the
+	files and cache files up and broadcasts what it found, then the content hashes that need
+	checking are computed by every process together. Collective over MPI_COMM_WORLD. */
+
+	std::vector<CacheEntry> entries(filenames.size());
+	if (rank == ROOT) {
+		mkdir(cacheDir.c_str(), 0777); // may already exist
+		for (std::size_t i = 0; i < filenames.size(); i++) {
+			CacheEntry& entry = entries[i];
+			std::string path;
+			get_file_stamp(filenames[i], entry.fileSize, entry.mtime);
+			entry.hasCache = read_cache_header(get_cache_path(cacheDir, filenames[i], minWordLen, maxWordLen), entry.header, path)
+				&& entry.header.minWordLen == minWordLen && entry.header.maxWordLen == maxWordLen
+				&& path == get_absolute_path(filenames[i]); // not another file with the same path hash
+		}
+	}
+	MPI_Bcast(entries.data(), entries.size() * sizeof(CacheEntry), MPI_BYTE, ROOT, MPI_COMM_WORLD);
+
+	for (std::size_t i = 0; i < filenames.size(); i++) {
+		CacheEntry& entry = entries[i];
+		const CacheHeader& header = entry.header;
+		entry.valid = 0;
+		entry.cachedSize = 0;
+		if (!entry.hasCache)
+			continue;
+		bool unchanged = header.fileSize == entry.fileSize && header.mtime == entry.mtime;
+		bool appendable = header.fileSize == entry.fileSize || (header.fileSize < entry.fileSize && header.endsWithNewline);
+		if (unchanged && !verify) {
+			entry.valid = 1;
+		} else if (appendable) {
+			// The whole blocks and the rest are hashed apart, so the head hash is checked too
+			long long headEnd = header.fileSize / CACHE_HASH_BLOCK * CACHE_HASH_BLOCK;
+			std::uint64_t headHash = hash_file_range(filenames[i], { 0, headEnd }, rank, nprocs);
+			std::uint64_t tailHash = hash_file_range(filenames[i], { headEnd, header.fileSize }, rank, nprocs);
+			entry.valid = headHash == header.headHash && headHash + tailHash == header.contentHash;
+			if (entry.valid && !unchanged && header.fileSize == entry.fileSize && rank == ROOT)
+				refresh_cache_mtime(get_cache_path(cacheDir, filenames[i], minWordLen, maxWordLen), header, entry.mtime);
+		}
+		if (entry.valid)
+			entry.cachedSize = header.fileSize;
+	}
+	return entries;
+}
+
+void update_cache(const std::string& filename, const std::string& cacheDir, int minWordLen, int maxWordLen,
+	const CacheEntry& entry, Counter& eachWordCounter, int rank, int nprocs) {
+	/* Merge the counters of every process for the bytes of a text file past `entry.cachedSize`
+	with the counter of its cache file (if valid) into `eachWordCounter` of ROOT, and write the
+	result as the new cache file. The counters of the other processes are left empty, so the file
+	is still counted once when the counters are reduced. Collective over MPI_COMM_WORLD. */
+
+	Counter fileCounter;
+	gather_counter(eachWordCounter, fileCounter, rank, nprocs);
+
+	// Only the bytes past the whole blocks of the cache file are hashed, the hash of the whole
+	// blocks was checked by check_cache()
+	long long cachedHeadEnd = entry.valid ? entry.header.fileSize / CACHE_HASH_BLOCK * CACHE_HASH_BLOCK : 0;
+	long long headEnd = entry.fileSize / CACHE_HASH_BLOCK * CACHE_HASH_BLOCK;
+	std::uint64_t headHash = (entry.valid ? entry.header.headHash : 0)
+		+ hash_file_range(filename, { cachedHeadEnd, headEnd }, rank, nprocs);
+	std::uint64_t contentHash = headHash + hash_file_range(filename, { headEnd, entry.fileSize }, rank, nprocs);
+	eachWordCounter = Counter();
+	if (rank != ROOT)
+		return;
+
+	std::string cachePath = get_cache_path(cacheDir, filename, minWordLen, maxWordLen);
+	if (entry.valid && !load_cache(cachePath, fileCounter)) {
+		std::cout << "Error! Cache file '" << cachePath << "' is corrupt. Aborting program." << std::endl;
+		exit(1);
+	}
+
+	CacheHeader header;
+	header.minWordLen = minWordLen;
+	header.maxWordLen = maxWordLen;
+	header.fileSize = entry.fileSize;
+	header.mtime = entry.mtime;
+	header.contentHash = contentHash;
+	header.headHash = headHash;
+	header.endsWithNewline = ends_with_newline(filename, entry.fileSize);
+	write_cache(cachePath, filename, header, fileCounter);
+	eachWordCounter = std::move(fileCounter);
+}
+
+#endif
@@ -0,0 +1,363 @@
+/*
+Group name: Kismet
+
+Compressed (gzip or zstd) text files, decompressed as a stream instead of to disk first. Both
+formats are detected by their magic numbers, and need the program to be compiled with the matching
+library: -DWC_GZIP -lz for gzip, -DWC_ZSTD -lzstd for zstd.
+
+A compressed file is split between processes and threads at the boundaries of its independently
+compressed blocks, when the file has an index of them:
+	- gzip files in the BGZF layout (bgzip), a series of gzip members each holding its compressed
+	  size in a header field and its decompressed size in its trailer
+	- zstd files in the seekable format (zstd --seekable / t2sz), a series of frames followed by a
+	  seek table of their compressed and decompressed sizes
+Each part of such a file is a run of blocks, decompressed from its first block on. Words cut at the
+edges of the parts are handled as with MPI-IO input: a part skips the bytes up to its first
+delimiter, and carries on past its end up to the first delimiter there, so every word is counted by
+exactly one part. Other compressed files (plain or concatenated gzip members, zstd without a seek
+table) cannot be split, and are decompressed and tokenized as a single stream by one process.
+*/
+
+#ifndef COMPRESSED_H
+#define COMPRESSED_H
+
+#include <algorithm> 		// std::max
+#include <cstdint> 			// std::uint8_t, std::uint32_t
+#include <cstring> 			// std::memcpy
+#include <iostream> 		// std::cout
+#include <memory> 			// std::unique_ptr
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <unistd.h> 		// pread, close
+#include "Partition.h"
+#include "Tokenizer.h"
+#ifdef WC_GZIP
+#include <zlib.h>
+#endif
+#ifdef WC_ZSTD
+#include <zstd.h>
+#endif
+
+#define DECOMPRESS_BUFFER_SIZE (256 * 1024) 	// compressed bytes read / decompressed bytes made at a time
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1u 		// last 4 bytes of a seekable zstd file
+#define ZSTD_SEEK_TABLE_FOOTER 9 				// frame count, descriptor, magic number
+
+enum Compression { COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD };
+
+struct CompressedBlock {
+	/* Independently decompressible block of a compressed file. */
+
+	long long offset; 	// first compressed byte
+	long long size; 	// compressed bytes
+	long long rawSize; 	// decompressed bytes
+};
+
+inline std::uint32_t read_le32(const unsigned char* bytes) {
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (std::uint32_t) bytes[3] << 24;
+}
+
+Compression detect_compression(const std::string& filename) {
+	/* Return the compression of a file, from its first bytes. */
+
+	unsigned char magic[4] = { 0, 0, 0, 0 };
+	int fd = open_or_exit(filename);
+	ssize_t bytesRead = pread(fd, magic, 4, 0);
+	close(fd);
+	if (bytesRead >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return COMPRESSION_GZIP;
+	if (bytesRead == 4 && read_le32(magic) == 0xFD2FB528u)
+		return COMPRESSION_ZSTD;
+	return COMPRESSION_NONE;
+}
+
+const char* compression_name(Compression compression) {
+	return compression == COMPRESSION_GZIP ? "gzip" : compression == COMPRESSION_ZSTD ? "zstd" : "none";
+}
+
+bool index_bgzf_blocks(int fd, long long fileSize, std::vector<CompressedBlock>& blocks) {
+	/* Find the blocks of a BGZF file from their headers and trailers. Return false if the file is
+	not entirely made of BGZF blocks. */
+
+	for (long long offset = 0; offset < fileSize; ) {
+		unsigned char header[18]; // fixed gzip header, extra length and BC subfield
+		if (pread(fd, header, 18, offset) != 18 || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 0x04))
+			return false;
+		if (header[10] != 6 || header[11] != 0 || header[12] != 'B' || header[13] != 'C' || header[14] != 2)
+			return false; // BGZF writes exactly one extra subfield
+		long long size = (header[16] | header[17] << 8) + 1;
+		unsigned char trailer[4];
+		if (offset + size > fileSize || pread(fd, trailer, 4, offset + size - 4) != 4)
+			return false;
+		blocks.push_back({ offset, size, read_le32(trailer) });
+		offset += size;
+	}
+	return true;
+}
+
+bool index_zstd_frames(int fd, long long fileSize, std::vector<CompressedBlock>& blocks) {
+	/* Find the frames of a seekable zstd file from its seek table. Return false if it has none. */
+
+	unsigned char footer[ZSTD_SEEK_TABLE_FOOTER];
+	if (fileSize < ZSTD_SEEK_TABLE_FOOTER || pread(fd, footer, ZSTD_SEEK_TABLE_FOOTER, fileSize - ZSTD_SEEK_TABLE_FOOTER) != ZSTD_SEEK_TABLE_FOOTER
+		|| read_le32(footer + 5) != ZSTD_SEEKABLE_MAGIC)
+		return false;
+	long long nframes = read_le32(footer);
+	int entrySize = footer[4] & 0x80 ? 12 : 8; // with or without a checksum per frame
+	long long tableBegin = fileSize - ZSTD_SEEK_TABLE_FOOTER - nframes * entrySize;
+	if (tableBegin < 0)
+		return false;
+
+	std::vector<unsigned char> table(nframes * entrySize);
+	if (pread(fd, table.data(), table.size(), tableBegin) != (ssize_t) table.size())
+		return false;
+	long long offset = 0;
+	for (long long frame = 0; frame < nframes; frame++) {
+		long long size = read_le32(&table[frame * entrySize]);
+		blocks.push_back({ offset, size, read_le32(&table[frame * entrySize + 4]) });
+		offset += size;
+	}
+	return offset <= tableBegin;
+}
+
+std::vector<CompressedBlock> index_blocks(const std::string& filename, Compression compression) {
+	/* Return the independently decompressible blocks of a compressed file, or a single block of
+	unknown decompressed size (-1) covering the whole file if it has no index of them. */
+
+	int fd = open_or_exit(filename);
+	long long fileSize = get_file_size(filename);
+	std::vector<CompressedBlock> blocks;
+	bool indexed = compression == COMPRESSION_GZIP ? index_bgzf_blocks(fd, fileSize, blocks)
+		: index_zstd_frames(fd, fileSize, blocks);
+	close(fd);
+	if (!indexed || blocks.empty())
+		blocks.assign(1, { 0, fileSize, -1 });
+	return blocks;
+}
+
+class Decompressor {
+	/* Decompresses a file from a given compressed offset (the start of a block) to its end, a
+	buffer at a time. Concatenated gzip members and zstd frames are decompressed one after the
+	other. */
+
+public:
+	Decompressor(const std::string& filename, Compression compression, long long offset)
+		: filename(filename), compression(compression), filePos(offset),
+		  inBuffer(new char[DECOMPRESS_BUFFER_SIZE]), outBuffer(new char[DECOMPRESS_BUFFER_SIZE]) {
+		fd = open_or_exit(filename);
+		if (compression == COMPRESSION_GZIP) {
+#ifdef WC_GZIP
+			zstream = z_stream();
+			if (inflateInit2(&zstream, 15 + 16) != Z_OK) // 15 bit window, gzip wrapper only
+				fail();
+#else
+			unsupported("gzip", "-DWC_GZIP -lz");
+#endif
+		} else {
+#ifdef WC_ZSTD
+			dstream = ZSTD_createDStream();
+			if (dstream == NULL || ZSTD_isError(ZSTD_initDStream(dstream)))
+				fail();
+#else
+			unsupported("zstd", "-DWC_ZSTD -lzstd");
+#endif
+		}
+	}
+
+	~Decompressor() {
+#ifdef WC_GZIP
+		if (compression == COMPRESSION_GZIP)
+			inflateEnd(&zstream);
+#endif
+#ifdef WC_ZSTD
+		if (compression == COMPRESSION_ZSTD)
+			ZSTD_freeDStream(dstream);
+#endif
+		close(fd);
+	}
+
+	Decompressor(const Decompressor&) = delete;
+	Decompressor& operator=(const Decompressor&) = delete;
+
+	bool next(const char*& data, std::size_t& size) {
+		/* Decompress the next buffer of bytes, valid until the following call. Return false at the
+		end of the file. */
+
+		while (true) {
+			if (inPos == inSize && !endOfFile) {
+				ssize_t bytesRead = pread(fd, inBuffer.get(), DECOMPRESS_BUFFER_SIZE, filePos);
+				if (bytesRead < 0)
+					fail();
+				inPos = 0;
+				inSize = bytesRead;
+				filePos += bytesRead;
+				endOfFile = bytesRead == 0;
+			}
+			size = decompress();
+			data = outBuffer.get();
+			if (size > 0)
+				return true;
+			if (endOfFile && inPos == inSize && !pending) {
+				if (frameOpen)
+					fail(); // the file ends in the middle of a gzip member or zstd frame
+				return false;
+			}
+		}
+	}
+
+private:
+	std::string filename;
+	Compression compression;
+	int fd;
+	long long filePos; 			// next compressed byte to read
+	std::unique_ptr<char[]> inBuffer, outBuffer;
+	std::size_t inPos = 0, inSize = 0; // compressed bytes of `inBuffer` used, and held
+	bool endOfFile = false;
+	bool pending = false; 		// the last call filled `outBuffer`, more output may be waiting
+	bool frameOpen = false; 	// a gzip member or zstd frame is started but not finished
+#ifdef WC_GZIP
+	z_stream zstream;
+#endif
+#ifdef WC_ZSTD
+	ZSTD_DStream* dstream = NULL;
+#endif
+
+	std::size_t decompress() {
+		/* Decompress from the unused input bytes into `outBuffer`, return the bytes made. */
+
+		if (inPos == inSize && !pending)
+			return 0;
+		std::size_t made = 0;
+#ifdef WC_GZIP
+		if (compression == COMPRESSION_GZIP) {
+			zstream.next_in = (Bytef*) inBuffer.get() + inPos;
+			zstream.avail_in = inSize - inPos;
+			zstream.next_out = (Bytef*) outBuffer.get();
+			zstream.avail_out = DECOMPRESS_BUFFER_SIZE;
+			int status = inflate(&zstream, Z_NO_FLUSH);
+			if (status == Z_STREAM_END)
+				inflateReset(&zstream); // another member may follow
+			else if (status != Z_OK && status != Z_BUF_ERROR) // Z_BUF_ERROR: no progress possible yet
+				fail();
+			frameOpen = status != Z_STREAM_END && (frameOpen || status == Z_OK);
+			inPos = inSize - zstream.avail_in;
+			made = DECOMPRESS_BUFFER_SIZE - zstream.avail_out;
+		}
+#endif
+#ifdef WC_ZSTD
+		if (compression == COMPRESSION_ZSTD) {
+			ZSTD_inBuffer in = { inBuffer.get(), inSize, inPos };
+			ZSTD_outBuffer out = { outBuffer.get(), DECOMPRESS_BUFFER_SIZE, 0 };
+			std::size_t hint = ZSTD_decompressStream(dstream, &out, &in);
+			if (ZSTD_isError(hint))
+				fail();
+			frameOpen = hint != 0; // 0 once a frame is completely decoded and flushed
+			inPos = in.pos;
+			made = out.pos;
+		}
+#endif
+		pending = made == DECOMPRESS_BUFFER_SIZE;
+		return made;
+	}
+
+	void fail() {
+		std::cout << "Error: could not decompress file '" << filename << "'" << std::endl;
+		exit(1);
+	}
+
+	void unsupported(const char* format, const char* flags) {
+		std::cout << "Error: '" << filename << "' is " << format << " compressed; compile with " << flags
+			<< " to read it" << std::endl;
+		exit(1);
+	}
+};
+
+template <typename Emit>
+void tokenize_compressed(const std::string& filename, Compression compression, long long offset, bool skipHead,
+	long long rawSize, int minWordLen, int maxWordLen, bool lineEnds, Emit&& emit) {
+	/* Decompress a file from the block at compressed `offset` on, and pass the words of the part of
+	`rawSize` decompressed bytes starting there to `emit`. The part is cut as described above: if
+	`skipHead`, up to and including its first delimiter is left to the previous part, and it ends
+	after the first delimiter at or after `rawSize` (or at the end of the file if `rawSize` is -1).
+	With `lineEnds`, the part is cut at newlines instead of any delimiter, and the end of every line
+	is passed to `emit` as an empty word (see `tokenize_by_line()`).
+	*/
+
+	auto is_cut = [lineEnds](char c) {
+		return lineEnds ? c == '\n' : tok_is_delimiter(c);
+	};
+
+	Decompressor decompressor(filename, compression, offset);
+	StreamTokenizer tokenizer(minWordLen, maxWordLen);
+	long long pos = 0; // decompressed bytes before the current buffer
+	bool counting = !skipHead;
+	const char* data;
+	std::size_t size;
+	while (decompressor.next(data, size)) {
+		std::size_t begin = 0, end = size;
+		if (!counting) {
+			while (begin < size && !is_cut(data[begin]))
+				begin++;
+			if (begin == size) {
+				pos += size;
+				continue;
+			}
+			if (rawSize >= 0 && pos + (long long) begin >= rawSize)
+				return; // the whole part is a single word, counted by the previous part
+			begin++;
+			counting = true;
+		}
+
+		bool last = false;
+		if (rawSize >= 0 && pos + (long long) size > rawSize) {
+			std::size_t cut = std::max<long long>(begin, rawSize - pos);
+			while (cut < size && !is_cut(data[cut]))
+				cut++;
+			if (cut < size) {
+				end = cut + 1;
+				last = true;
+			}
+		}
+		if (lineEnds)
+			tokenize_by_line(tokenizer, data + begin, end - begin, emit);
+		else
+			tokenizer.tokenize(data + begin, end - begin, emit);
+		pos += size;
+		if (last)
+			break;
+	}
+	tokenizer.finish(emit);
+	if (lineEnds)
+		emit(std::string_view()); // the part ends a line, even without a newline
+}
+
+struct CompressedPart {
+	/* Run of blocks of a compressed file decompressed by one thread of one process. */
+
+	long long offset; 	// compressed offset of the first block
+	long long size; 	// compressed bytes of the blocks
+	long long rawSize; 	// decompressed bytes of the blocks, -1 if unknown
+	bool skipHead; 		// whether the part follows another one
+};
+
+std::vector<CompressedPart> split_blocks(const std::vector<CompressedBlock>& blocks, int nparts) {
+	/* Split the blocks of a compressed file into at most `nparts` runs of about the same compressed
+	size. A file without an index (a single block of unknown size) is a single part. */
+
+	std::vector<CompressedPart> parts;
+	long long totalSize = blocks.back().offset + blocks.back().size;
+	std::size_t block = 0;
+	for (int part = 0; part < nparts && block < blocks.size(); part++) {
+		long long partEnd = totalSize * (part + 1) / nparts;
+		CompressedPart run = { blocks[block].offset, 0, 0, block > 0 };
+		while (block < blocks.size() && (blocks[block].offset < partEnd || part == nparts - 1)) {
+			run.size += blocks[block].size;
+			run.rawSize = blocks[block].rawSize < 0 ? -1 : run.rawSize + blocks[block].rawSize;
+			block++;
+		}
+		if (run.rawSize != 0)
+			parts.push_back(run);
+	}
+	return parts;
+}
+
+#endif
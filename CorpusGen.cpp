@@ -0,0 +1,203 @@
+/*
+Group name: Kismet
+
+Synthetic corpus generator for benchmarking the word counter. Words are drawn from a vocabulary of
+random lowercase words following a Zipf distribution (the frequency of the word of rank r is
+proportional to 1 / r^s, as in natural text), and grouped into lines whose number of words follows
+a chosen distribution. Some words start with a capital letter or end with a punctuation mark, so
+lowercasing and delimiters are exercised too. The same options and seed always give the same file.
+
+Compile with:
+	$ g++ -std=c++17 -O2 CorpusGen.cpp -o CorpusGen
+
+Run with (e.g. 64 MB out of a vocabulary of 100000 words):
+	$ ./CorpusGen --size 64 --vocab 100000 --output corpus.txt
+or with a flatter distribution and long, uneven lines:
+	$ ./CorpusGen --size 64 --vocab 100000 --zipf 0.8 --line-words 40 --line-dist geometric --output corpus.txt
+*/
+
+#include <algorithm> 		// std::lower_bound, std::shuffle
+#include <cmath> 			// std::pow
+#include <cstdlib> 			// std::atoi, std::atof
+#include <fstream> 			// std::ofstream
+#include <functional> 		// std::function
+#include <iostream> 		// std::cout, std::cerr
+#include <random> 			// std::mt19937_64, distributions
+#include <string> 			// std::string
+#include <unordered_set> 	// std::unordered_set
+#include <vector> 			// std::vector
+
+#define WRITE_BUFFER_SIZE (1 << 20) // bytes buffered before each write
+
+struct CorpusOptions {
+	double megabytes = 16; 			// size of the corpus
+	long long vocab = 50000; 		// number of distinct words
+	double zipf = 1.0; 				// exponent s of the Zipf distribution
+	double lineWords = 12; 			// mean number of words per line
+	std::string lineDist = "poisson"; 	// fixed, uniform, poisson or geometric
+	unsigned long long seed = 1;
+	std::string output; 			// file to write, standard output if empty
+};
+
+void print_usage(const char* program) {
+	std::cout << "Usage: " << program << " [options]" << std::endl
+		<< "  --size MB              size of the corpus (default 16)" << std::endl
+		<< "  --vocab N              number of distinct words (default 50000)" << std::endl
+		<< "  --zipf S               Zipf exponent of the word frequencies (default 1.0)" << std::endl
+		<< "  --line-words N         mean number of words per line (default 12)" << std::endl
+		<< "  --line-dist fixed|uniform|poisson|geometric  distribution of the words per line" << std::endl
+		<< "                         (default poisson)" << std::endl
+		<< "  --seed N               random seed (default 1)" << std::endl
+		<< "  --output PATH          file to write (default: standard output)" << std::endl;
+}
+
+bool parse_options(int argc, char* argv[], CorpusOptions& options) {
+	/* Parse the command line into `options`. Return false if the command line is invalid. */
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+			return false; // every option takes a value
+		std::string value = argv[++i];
+
+		if (arg == "--size")
+			options.megabytes = std::atof(value.c_str());
+		else if (arg == "--vocab")
+			options.vocab = std::atoll(value.c_str());
+		else if (arg == "--zipf")
+			options.zipf = std::atof(value.c_str());
+		else if (arg == "--line-words")
+			options.lineWords = std::atof(value.c_str());
+		else if (arg == "--line-dist")
+			options.lineDist = value;
+		else if (arg == "--seed")
+			options.seed = std::stoull(value);
+		else if (arg == "--output")
+			options.output = value;
+		else
+			return false;
+	}
+	return options.megabytes > 0 && options.vocab > 0 && options.zipf >= 0 && options.lineWords >= 1
+		&& (options.lineDist == "fixed" || options.lineDist == "uniform" || options.lineDist == "poisson"
+			|| options.lineDist == "geometric");
+}
+
+std::vector<std::string> make_vocabulary(long long vocab, std::mt19937_64& rng) {
+	/* Return `vocab` distinct random lowercase words, most of them 2 to 9 letters long. Longer words
+	are used once the short ones run out. */
+
+	std::uniform_int_distribution<int> letter('a', 'z');
+	std::binomial_distribution<int> extraLength(14, 0.3); // mean length 1 + 4.2 letters
+	std::unordered_set<std::string> seen;
+	std::vector<std::string> words;
+	words.reserve(vocab);
+	seen.reserve(vocab);
+
+	int collisions = 0;
+	int minLength = 1;
+	while ((long long) words.size() < vocab) {
+		std::string word(std::max(minLength, 1 + extraLength(rng)), ' ');
+		for (char& c: word)
+			c = letter(rng);
+		if (seen.insert(word).second) {
+			words.push_back(word);
+		} else if (++collisions > 1000) {
+			minLength++; // the short words are (nearly) exhausted
+			collisions = 0;
+		}
+	}
+
+	// frequent words are not necessarily short, nor the first ones generated
+	std::shuffle(words.begin(), words.end(), rng);
+	return words;
+}
+
+std::vector<double> make_zipf_cdf(long long vocab, double s) {
+	/* Return the cumulative distribution of the ranks 1..vocab under a Zipf distribution of
+	exponent `s`. */
+
+	std::vector<double> cdf(vocab);
+	double total = 0;
+	for (long long r = 0; r < vocab; r++) {
+		total += 1.0 / std::pow((double) (r + 1), s);
+		cdf[r] = total;
+	}
+	for (double& p: cdf)
+		p /= total;
+	return cdf;
+}
+
+int main(int argc, char* argv[]) {
+	CorpusOptions options;
+	if (!parse_options(argc, argv, options)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	std::mt19937_64 rng(options.seed);
+	std::vector<std::string> words = make_vocabulary(options.vocab, rng);
+	std::vector<double> cdf = make_zipf_cdf(options.vocab, options.zipf);
+
+	// number of words of the next line, following the chosen distribution; only that one is built,
+	// and with a mean of 1 word every line has exactly 1 word (poisson and geometric need more)
+	double mean = options.lineWords;
+	std::function<int()> line_words = [mean]() { return (int) mean; };
+	if (options.lineDist == "uniform") {
+		std::uniform_int_distribution<int> uniformWords(1, std::max(1, (int) (2 * mean - 1)));
+		line_words = [uniformWords, &rng]() mutable { return uniformWords(rng); };
+	} else if (options.lineDist == "poisson" && mean > 1) {
+		std::poisson_distribution<int> poissonWords(mean - 1);
+		line_words = [poissonWords, &rng]() mutable { return 1 + poissonWords(rng); };
+	} else if (options.lineDist == "geometric" && mean > 1) {
+		std::geometric_distribution<int> geometricWords(1 / mean);
+		line_words = [geometricWords, &rng]() mutable { return 1 + geometricWords(rng); };
+	}
+
+	std::uniform_real_distribution<double> uniform(0, 1);
+	const char punctuation[] = ",.;:!?";
+
+	std::ofstream outFile;
+	if (!options.output.empty()) {
+		outFile.open(options.output, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!outFile.is_open()) {
+			std::cerr << "Error: could not open file '" << options.output << "'" << std::endl;
+			exit(1);
+		}
+	}
+	std::ostream& out = options.output.empty() ? std::cout : outFile;
+
+	long long targetBytes = (long long) (options.megabytes * (1 << 20));
+	long long bytesWritten = 0, wordsWritten = 0, linesWritten = 0;
+	std::string buffer;
+	buffer.reserve(WRITE_BUFFER_SIZE + 4096);
+
+	while (bytesWritten + (long long) buffer.size() < targetBytes) {
+		int n = line_words();
+		for (int i = 0; i < n; i++) {
+			const std::string& word = words[std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin()];
+			if (i > 0)
+				buffer += ' ';
+			buffer += word;
+			if (i == 0 || uniform(rng) < 0.02)
+				buffer[buffer.size() - word.size()] -= 'a' - 'A'; // capitalized
+			if (uniform(rng) < 0.08)
+				buffer += punctuation[(int) (uniform(rng) * 6)];
+		}
+		buffer += '\n';
+		wordsWritten += n;
+		linesWritten++;
+
+		if (buffer.size() >= WRITE_BUFFER_SIZE) {
+			out.write(buffer.data(), buffer.size());
+			bytesWritten += buffer.size();
+			buffer.clear();
+		}
+	}
+	out.write(buffer.data(), buffer.size());
+	bytesWritten += buffer.size();
+	out.flush();
+
+	std::cerr << "Wrote " << bytesWritten << " bytes, " << linesWritten << " lines, " << wordsWritten
+		<< " words out of a vocabulary of " << options.vocab << std::endl;
+	return 0;
+}
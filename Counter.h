@@ -4,20 +4,287 @@ Group name: Kismet
 
 */
 
+#ifndef COUNTER_H
+#define COUNTER_H
+
 #include <iostream> 		// std::cout
 #include <iomanip> 		    // std::setw
 #include <string> 			// std::string
-#include <unordered_map> 	// std::unordered_map, std::pair
-#include <sstream> 			// std::stringstream
+#include <string_view> 		// std::string_view
+#include <utility> 			// std::pair
+#include <initializer_list> // std::initializer_list
+#include <memory> 			// std::unique_ptr
 #include <vector> 			// std::vector
-#include <algorithm> 		// std::sort
+#include <algorithm> 		// std::sort, std::max
+#include <charconv> 		// std::to_chars
+#include <cstdint> 			// std::uint32_t, std::uint64_t
+#include <cstring> 			// std::memcpy
 
-/* Counter type is essentially an unordered_map type with word (string) for key-value and
-count (int) for mapped-value.
-*/
-typedef std::unordered_map<std::string, int> Counter;
+#define COUNTER_MIN_CAPACITY 16 		// initial number of slots of the hash table
+#define COUNTER_ARENA_BLOCK (64 * 1024) // size of a block of the key arena
+
+inline std::uint64_t hash_bytes(const char* data, std::size_t size, std::uint64_t seed = 0) {
+	/* Fast 64-bit hash of a byte string: 8 bytes at a time through a multiply-xorshift mix. */
+
+	const std::uint64_t m1 = 0x9e3779b97f4a7c15ull, m2 = 0xbf58476d1ce4e5b9ull, m3 = 0x94d049bb133111ebull;
+	std::uint64_t h = seed ^ (size * m1);
+	std::uint64_t k;
+
+	for (; size >= 8; data += 8, size -= 8) {
+		std::memcpy(&k, data, 8);
+		k *= m2;
+		k ^= k >> 29;
+		h = (h ^ k) * m1;
+	}
+	if (size > 0) {
+		k = 0;
+		std::memcpy(&k, data, size);
+		k *= m2;
+		k ^= k >> 29;
+		h = (h ^ k) * m1;
+	}
+	h ^= h >> 32;
+	h *= m3;
+	h ^= h >> 29;
+	return h;
+}
+
+inline std::uint64_t hash_word(std::string_view word) {
+	return hash_bytes(word.data(), word.size());
+}
+
+struct CounterEntry {
+	/* A word-count pair of a Counter. `first` points into the Counter's key arena, so it stays
+	valid for as long as the Counter does. */
+
+	std::string_view first; // word
+	long long second; 		// count
+};
+
+class Counter {
+	/* Counter type maps a word (string) key to a count (64-bit integer) value. It is a flat
+	open-addressing hash table with linear probing:
+		- `slots` hold the 32-bit hash of a key and the index of its entry (0 for an empty slot),
+		  so most probes never touch the key itself
+		- `entries` hold the word-count pairs contiguously, which makes iterating cheap
+		- keys are copied once into a contiguous arena of large blocks, which never move
+	Lookups take a `std::string_view`, so a word never needs to become a `std::string` just to be
+	counted.
+	*/
+
+public:
+	typedef CounterEntry value_type;
+	typedef std::vector<CounterEntry>::iterator iterator;
+	typedef std::vector<CounterEntry>::const_iterator const_iterator;
+
+	Counter() {}
+
+	Counter(std::initializer_list< std::pair<std::string_view, long long> > items) {
+		insert(items);
+	}
+
+	Counter(const Counter& other) {
+		*this = other;
+	}
+
+	Counter(Counter&& other) = default;
+
+	Counter& operator=(const Counter& other) {
+		if (this != &other) {
+			clear();
+			reserve(other.size());
+			for (auto& entry: other)
+				add(entry.first, entry.second);
+		}
+		return *this;
+	}
+
+	Counter& operator=(Counter&& other) = default;
+
+	long long& operator[](std::string_view key) {
+		/* Return the count of a word, inserting the word with a count of 0 if it does not exist. */
+
+		return find_or_insert(key, hash_word(key))->second;
+	}
+
+	long long& add(std::string_view key, long long count) {
+		/* Add `count` to the count of a word (inserting it if needed) and return the new count. */
+
+		return find_or_insert(key, hash_word(key))->second += count;
+	}
+
+	long long& add(std::string_view key, std::uint64_t hash, long long count) {
+		/* Same as above, for a word whose `hash_word()` is already known. */
+
+		return find_or_insert(key, hash)->second += count;
+	}
+
+	iterator find(std::string_view key) {
+		std::uint32_t index = find_index(key);
+		return index ? entries.begin() + (index - 1) : entries.end();
+	}
+
+	const_iterator find(std::string_view key) const {
+		std::uint32_t index = find_index(key);
+		return index ? entries.begin() + (index - 1) : entries.end();
+	}
+
+	std::size_t count(std::string_view key) const {
+		return find(key) != end() ? 1 : 0;
+	}
+
+	void insert(const std::pair<std::string_view, long long>& item) {
+		/* Insert a word-count pair, unless the word already exists (same as std::unordered_map). */
+
+		std::size_t oldSize = size();
+		CounterEntry* entry = find_or_insert(item.first, hash_word(item.first));
+		if (size() != oldSize)
+			entry->second = item.second;
+	}
+
+	void insert(std::initializer_list< std::pair<std::string_view, long long> > items) {
+		for (auto& item: items)
+			insert(item);
+	}
+
+	void reserve(std::size_t count) {
+		/* Make room for `count` words without rehashing. */
+
+		entries.reserve(count);
+		std::size_t capacity = COUNTER_MIN_CAPACITY;
+		while (capacity * 3 < count * 4)
+			capacity *= 2;
+		if (capacity > slots.size())
+			rehash(capacity);
+	}
+
+	void clear() {
+		slots.clear();
+		entries.clear();
+		arena.clear();
+		arenaUsed = arenaCapacity = 0;
+	}
+
+	std::size_t size() const { return entries.size(); }
+	bool empty() const { return entries.empty(); }
+
+	iterator begin() { return entries.begin(); }
+	iterator end() { return entries.end(); }
+	const_iterator begin() const { return entries.begin(); }
+	const_iterator end() const { return entries.end(); }
+
+	std::size_t memory_usage() const {
+		/* Return the number of bytes allocated by the Counter. */
+
+		std::size_t arenaBytes = 0;
+		for (auto& block: arena)
+			arenaBytes += block.size;
+		return slots.capacity() * sizeof(Slot) + entries.capacity() * sizeof(CounterEntry) + arenaBytes;
+	}
+
+	std::size_t probes() const {
+		/* Return the number of hash table slots visited by lookups so far (only counted when
+		compiled with -DWC_PROFILE, 0 otherwise). */
+
+#ifdef WC_PROFILE
+		return probeCount;
+#else
+		return 0;
+#endif
+	}
+
+private:
+	struct Slot {
+		std::uint32_t hash; 	// low 32 bits of the key's hash
+		std::uint32_t index; 	// index of the entry + 1, or 0 if the slot is empty
+	};
+
+	struct ArenaBlock {
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+	};
+
+	std::vector<Slot> slots; 			// hash table, size is a power of two
+	std::vector<CounterEntry> entries; 	// word-count pairs, in insertion order
+	std::vector<ArenaBlock> arena; 		// storage of the words
+	std::size_t arenaUsed = 0; 			// bytes used in the last arena block
+	std::size_t arenaCapacity = 0; 		// size of the last arena block
+#ifdef WC_PROFILE
+	mutable std::size_t probeCount = 0; // slots visited by lookups
+#endif
 
-void print_counter(Counter counter) {
+	std::uint32_t find_index(std::string_view key) const {
+		/* Return the index + 1 of the entry of `key`, or 0 if the key does not exist. */
+
+		return slots.empty() ? 0 : slots[find_slot(key, (std::uint32_t) hash_word(key))].index;
+	}
+
+	std::size_t find_slot(std::string_view key, std::uint32_t hash) const {
+		/* Return the slot holding `key`, or the empty slot where it would be inserted. The table
+		must not be empty. */
+
+		std::size_t mask = slots.size() - 1;
+		for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+			const Slot& slot = slots[i];
+#ifdef WC_PROFILE
+			probeCount++;
+#endif
+			if (slot.index == 0)
+				return i;
+			if (slot.hash == hash && entries[slot.index - 1].first == key)
+				return i;
+		}
+	}
+
+	CounterEntry* find_or_insert(std::string_view key, std::uint64_t fullHash) {
+		std::uint32_t hash = (std::uint32_t) fullHash;
+		if ((entries.size() + 1) * 4 > slots.size() * 3)
+			rehash(std::max<std::size_t>(COUNTER_MIN_CAPACITY, slots.size() * 2));
+
+		std::size_t slot = find_slot(key, hash);
+		if (slots[slot].index != 0)
+			return &entries[slots[slot].index - 1];
+
+		entries.push_back({ intern(key), 0 });
+		slots[slot] = { hash, (std::uint32_t) entries.size() };
+		return &entries.back();
+	}
+
+	void rehash(std::size_t capacity) {
+		/* Rebuild the hash table with `capacity` slots. Stored hashes are reused, so no key is
+		hashed or compared again. */
+
+		std::vector<Slot> oldSlots(capacity, Slot{ 0, 0 });
+		oldSlots.swap(slots);
+		std::size_t mask = capacity - 1;
+		for (const Slot& slot: oldSlots) {
+			if (slot.index == 0)
+				continue;
+			std::size_t i = slot.hash & mask;
+			while (slots[i].index != 0)
+				i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+
+	std::string_view intern(std::string_view key) {
+		/* Copy a key into the arena and return a view of the copy. */
+
+		if (key.empty())
+			return std::string_view(); // nothing to copy, and the arena may have no block yet
+		if (arenaUsed + key.size() > arenaCapacity) {
+			arenaCapacity = std::max<std::size_t>(COUNTER_ARENA_BLOCK, key.size());
+			arena.push_back({ std::unique_ptr<char[]>(new char[arenaCapacity]), arenaCapacity });
+			arenaUsed = 0;
+		}
+		char* copy = arena.back().data.get() + arenaUsed;
+		std::memcpy(copy, key.data(), key.size());
+		arenaUsed += key.size();
+		return std::string_view(copy, key.size());
+	}
+};
+
+void print_counter(const Counter& counter) {
 	/* Print the contents of the Counter. */
 
 	for (auto& item: counter)
@@ -26,7 +293,7 @@ void print_counter(Counter counter) {
 	std::cout << std::endl;
 }
 
-bool alphabetical( std::pair<std::string, int> x, std::pair<std::string, int> y) {
+bool alphabetical(const CounterEntry& x, const CounterEntry& y) {
 	/* Comparison function to be used in sorting Counter items (word-count pair) by comparing two
 	items at a time. Enables sorting by alphabetical order of the words. To use, feed it as an
 	argument to `print_counter()`.
@@ -35,120 +302,292 @@ bool alphabetical( std::pair<std::string, int> x, std::pair<std::string, int> y)
 	return x.first < y.first;
 }
 
-bool most_common( std::pair<std::string, int> x, std::pair<std::string, int> y) {
+bool most_common(const CounterEntry& x, const CounterEntry& y) {
 	/* Comparison function to be used in sorting Counter items (word-count pair) by comparing two
 	items at a time. Enables sorting by most common count of words. To use, feed it as an argument
-	to `print_counter()`.
+	to `print_counter()`. Words with the same count are ordered alphabetically.
 	*/
 
-	return x.second > y.second;
+	return x.second != y.second ? x.second > y.second : x.first < y.first;
+}
+
+inline void append_padded(std::string& out, std::string_view text, std::size_t width, bool left) {
+	/* Append `text` to `out`, padded with spaces to `width` characters like std::setw. */
+
+	if (!left && text.size() < width)
+		out.append(width - text.size(), ' ');
+	out += text;
+	if (left && text.size() < width)
+		out.append(width - text.size(), ' ');
 }
 
-void print_counter(Counter counter,
-	bool (*comp)(std::pair<std::string, int>, std::pair<std::string, int>)) {
+inline void append_number(std::string& out, long long value, std::size_t width) {
+	/* Append a number to `out`, right-aligned to `width` characters. */
+
+	char digits[24];
+	char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+	append_padded(out, std::string_view(digits, end - digits), width, false);
+}
+
+void append_table_header(std::string& out) {
+	out += "---------------------------------------------\n| ";
+	append_padded(out, "Word", 20, true);
+	out += " | ";
+	append_padded(out, "Length", 6, false);
+	out += " | ";
+	append_padded(out, "Frequency", 9, false);
+	out += " |\n";
+}
+
+void append_table_row(std::string& out, const CounterEntry& entry) {
+	/* Append the row of a word-count pair of the report table to `out`. */
+
+	out += "| ";
+	append_padded(out, entry.first, 20, true);
+	out += " | ";
+	append_number(out, entry.first.length(), 6);
+	out += " | ";
+	append_number(out, entry.second, 9);
+	out += " |\n";
+}
+
+void append_table_footer(std::string& out) {
+	out += "---------------------------------------------\n\n";
+}
+
+void print_counter(const Counter& counter, bool (*comp)(const CounterEntry&, const CounterEntry&)) {
 	/* Print the contents of the Counter in sorted fashion, given a comparison function as a
 	sorting key. Arguement options:
 		alphabetical
 		most_common
+	The table is formatted into a buffer written out a megabyte at a time, not flushed line by line.
 	*/
 
 	// create a vector containing all the counter items, then sort it using the given comparison
-	// function
-	std::vector< std::pair<std::string, int> > counter_elements(counter.begin(), counter.end());
+	// function (the items only hold views of the words, so no string is copied)
+	std::vector<CounterEntry> counter_elements(counter.begin(), counter.end());
 	std::sort(counter_elements.begin(), counter_elements.end(), comp);
 
-    // print header
-    std::cout << "---------------------------------------------" << std::endl;
-    std::cout << "| " << std::left << std::setw(20) << "Word" << " | " << std::right << std::setw(6) << "Length" << " | " << std::setw(9) << "Frequency" << " |" << std::endl;
-    // std::cout << "---------------------------------------------" << std::endl;
-	// print the sorted vector of Counter items
-	for (auto& item: counter_elements)
-        // std::cout << "'" << item.first << "': " << item.second << std::endl;
-        std::cout << "| " << std::left << std::setw(20) << item.first << " | " << std::right << std::setw(6) << item.first.length() << " | " << std::setw(9) << item.second << " |" << std::endl;
-    std::cout << "---------------------------------------------" << std::endl;
-	std::cout << std::endl;
+	std::string out;
+	append_table_header(out);
+	for (auto& item: counter_elements) {
+		append_table_row(out, item);
+		if (out.size() >= (1 << 20)) {
+			std::cout.write(out.data(), out.size());
+			out.clear();
+		}
+	}
+	append_table_footer(out);
+	std::cout.write(out.data(), out.size());
+	std::cout.flush();
 }
 
-void update_counter(Counter& counter, std::string word, int count) {
+void update_counter(Counter& counter, std::string_view word, long long count) {
 	/* Given a word string and count value, add the value of count to the current count of the
 	word in the counter if the word exists, otherwise insert the new word and set it's count.
-	Not meant to be used directly.
+	The word is hashed and looked up only once.
 	*/
 
-	if (counter.find(word) != counter.end())
-		counter[word] += count; // update count
-	else
-		counter[word] = count; // set new word and count
+	counter.add(word, count);
 }
 
-void update_counter(Counter& counter, std::string word) {
+void update_counter(Counter& counter, std::string_view word) {
 	/* Given a word string, increment the count of the word in the counter by 1 if the word
 	exists, otherwise insert the new word and set it's count to 1.
 	*/
 
-	update_counter(counter, word, 1);
+	counter.add(word, 1);
 }
 
-void update_counter(Counter& counter, std::vector<std::string>& words) {
+void update_counter(Counter& counter, const std::vector<std::string>& words) {
 	/* For each word in the given vector of word strings, increment the count of the word in the
 	counter if the word exists, otherwise insert the new word and set it's count to 1.
 	*/
 
-	for (std::string word: words)
-		update_counter(counter, word, 1);
+	for (const std::string& word: words)
+		counter.add(word, 1);
 }
 
-void update_counter(Counter& counter, Counter& other_counter) {
+void update_counter(Counter& counter, const Counter& other_counter) {
 	/* Update the contents of the first counter with content from the second counter. */
 
 	for (auto& pair: other_counter)
-		update_counter(counter, pair.first, pair.second);
+		counter.add(pair.first, pair.second);
 }
 
-int get_counter_size(Counter& counter) {
+long long get_counter_size(const Counter& counter) {
 	/* Return the size (number of unique words) in the counter. */
 
 	return counter.size();
 }
 
-int get_counter_total(Counter& counter) {
+long long get_counter_total(const Counter& counter) {
 	/* Return the total count of every word in the counter. */
 
-	int total_count = 0;
+	long long total_count = 0;
 	for (auto& pair: counter)
 		total_count += pair.second;
 	return total_count;
 }
 
-void decompose_counter(Counter counter, std::string& words, std::vector<int>& counts) {
-	/* Decompose (break-down) the Counter into two main components of contiguous data objects:
-		- a string of individual words, separated by newlines
-		- an integer vector of counts of the respective words
-	Store the results in the given string and integer vector objects, which can be later used to
-	rebuild the Counter using the `compose_counter()` function.
-	*/
+/* Wire format of a decomposed Counter, a single contiguous buffer made of:
+	- a CounterHeader: magic number, flags, number of entries, payload size and payload checksum
+	- the payload, one record per word-count pair:
+		plain:        varint(word length)  word bytes  varint(count)
+		front-coded:  varint(length of the prefix shared with the previous word)
+		              varint(suffix length)  suffix bytes  varint(count)
+	  front-coded records are written in alphabetical order of the words.
+Varints are LEB128: 7 bits per byte, least significant group first, high bit set on every byte
+but the last.
+*/
+
+#define COUNTER_MAGIC 0x31434357u 		// "WCC1"
+#define COUNTER_FRONT_CODED 0x1u 		// flag: payload is front-coded
 
-	std::stringstream ss; // new stringstream object
-	for (auto& pair: counter) {
-		// Iterating through each word-count pair ensures that they are added to the objects in
-		// the correct order. This is necessary to correctly recompose the Counter later.
-		ss << pair.first << '\n'; // push word to end of ss, followed by newline char
-		counts.push_back(pair.second); // push count value to end vector as new element
+struct CounterHeader {
+	std::uint32_t magic;
+	std::uint32_t flags;
+	std::uint64_t entries; 		// number of word-count pairs
+	std::uint64_t payloadSize; 	// bytes following the header
+	std::uint64_t checksum; 	// hash_bytes() of the payload
+};
+
+inline void put_varint(std::string& buffer, std::uint64_t value) {
+	char bytes[10];
+	int n = 0;
+	while (value >= 0x80) {
+		bytes[n++] = (char) (value | 0x80);
+		value >>= 7;
 	}
-	words = ss.str(); // convert stringstream to store in string object
+	bytes[n++] = (char) value;
+	buffer.append(bytes, n);
+}
+
+inline bool get_varint(const char*& pos, const char* end, std::uint64_t& value) {
+	/* Read a varint at `pos` and advance `pos` past it. Return false if the buffer ends first. */
+
+	value = 0;
+	for (int shift = 0; pos < end && shift < 64; shift += 7) {
+		std::uint8_t byte = (std::uint8_t) *pos++;
+		value |= (std::uint64_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+template <typename EntryPtrIterator>
+void encode_entries(std::string& buffer, EntryPtrIterator first, EntryPtrIterator last, bool frontCoded) {
+	/* Append a header and the records of the entries pointed to by [first, last) to `buffer`.
+	For a front-coded buffer the entries must already be in alphabetical order. */
+
+	std::size_t headerPos = buffer.size();
+	buffer.resize(headerPos + sizeof(CounterHeader)); // filled in once the payload is known
+
+	std::uint64_t entries = 0;
+	std::string_view previous;
+	for (EntryPtrIterator it = first; it != last; ++it, ++entries) {
+		const CounterEntry& entry = **it;
+		if (frontCoded) {
+			std::size_t shared = 0, limit = std::min(previous.size(), entry.first.size());
+			while (shared < limit && previous[shared] == entry.first[shared])
+				shared++;
+			put_varint(buffer, shared);
+			put_varint(buffer, entry.first.size() - shared);
+			buffer.append(entry.first.data() + shared, entry.first.size() - shared);
+			previous = entry.first;
+		} else {
+			put_varint(buffer, entry.first.size());
+			buffer.append(entry.first.data(), entry.first.size());
+		}
+		put_varint(buffer, (std::uint64_t) entry.second);
+	}
+
+	CounterHeader header;
+	header.magic = COUNTER_MAGIC;
+	header.flags = frontCoded ? COUNTER_FRONT_CODED : 0;
+	header.entries = entries;
+	header.payloadSize = buffer.size() - headerPos - sizeof(CounterHeader);
+	header.checksum = hash_bytes(buffer.data() + headerPos + sizeof(CounterHeader), header.payloadSize);
+	std::memcpy(&buffer[headerPos], &header, sizeof(CounterHeader));
 }
 
-void compose_counter(Counter& counter, std::string words, std::vector<int> counts) {
-	/* (Re)compose (build) a Counter from two given components of contiguous data objects:
-		- a string of individual words, separated by newlines
-		- an integer vector of counts of the respective words
-	Store the result in the given Counter object, which is assumed to be empty.
-	Note: Assumes that there are an equal number of individual words and counts.
+void decompose_counter(const Counter& counter, std::string& buffer, bool frontCoded = false) {
+	/* Decompose (break-down) the Counter into a single contiguous buffer in the wire format above,
+	appended to `buffer`, which can be sent as is and later used to rebuild the Counter using the
+	`compose_counter()` function. A front-coded buffer is sorted and usually smaller, but takes
+	longer to build.
 	*/
 
-	std::stringstream ss(words); // convert string of words to stream
-	std::string word; // temporary variable to hold a word
-	int i = 0; // index for counts vector
-	while (ss >> word)
-		update_counter(counter, word, counts[i++]);
-}
\ No newline at end of file
+	std::vector<const CounterEntry*> entries;
+	entries.reserve(counter.size());
+	for (auto& entry: counter)
+		entries.push_back(&entry);
+	if (frontCoded)
+		std::sort(entries.begin(), entries.end(), [](const CounterEntry* x, const CounterEntry* y) {
+			return x->first < y->first;
+		});
+	encode_entries(buffer, entries.begin(), entries.end(), frontCoded);
+}
+
+std::size_t compose_counter(Counter& counter, const char* data, std::size_t size) {
+	/* (Re)compose a Counter from a buffer in the wire format above, reading the words straight out
+	of the buffer (e.g. an MPI receive buffer). The counts are added to those already in `counter`.
+	Return the number of bytes used by the decomposed Counter, or 0 if the buffer is truncated or
+	corrupt.
+	*/
+
+	CounterHeader header;
+	if (size < sizeof(CounterHeader))
+		return 0;
+	std::memcpy(&header, data, sizeof(CounterHeader));
+	if (header.magic != COUNTER_MAGIC || header.payloadSize > size - sizeof(CounterHeader))
+		return 0;
+
+	if (header.entries > header.payloadSize / 2)
+		return 0; // every entry takes at least 2 bytes, and the checksum does not cover the header
+
+	const char* pos = data + sizeof(CounterHeader);
+	const char* end = pos + header.payloadSize;
+	if (hash_bytes(pos, header.payloadSize) != header.checksum)
+		return 0;
+
+	bool frontCoded = header.flags & COUNTER_FRONT_CODED;
+	std::string word; // current word, only needed to undo front coding
+	counter.reserve(counter.size() + header.entries);
+	for (std::uint64_t i = 0; i < header.entries; i++) {
+		std::uint64_t shared = 0, length, count;
+		if (frontCoded && (!get_varint(pos, end, shared) || shared > word.size()))
+			return 0;
+		if (!get_varint(pos, end, length) || length > (std::uint64_t) (end - pos))
+			return 0;
+		std::string_view key(pos, length);
+		pos += length;
+		if (!get_varint(pos, end, count))
+			return 0;
+
+		if (frontCoded) {
+			word.resize(shared);
+			word.append(key);
+			key = word;
+		}
+		counter.add(key, (long long) count);
+	}
+	return pos == end ? sizeof(CounterHeader) + header.payloadSize : 0;
+}
+
+bool compose_counters(Counter& counter, const char* data, std::size_t size) {
+	/* Compose every decomposed Counter of a buffer holding several of them back to back (e.g. the
+	buffers gathered from every process) into `counter`. Return false if the buffer is corrupt. */
+
+	std::size_t pos = 0;
+	while (pos < size) {
+		std::size_t used = compose_counter(counter, data + pos, size - pos);
+		if (used == 0)
+			return false;
+		pos += used;
+	}
+	return true;
+}
+
+#endif
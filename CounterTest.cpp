@@ -2,13 +2,148 @@
 Program for testing Counter object; demonstrating functions in "Counter.h". 
 
 Compile with:
-	$ g++ CounterTest.cpp -o CounterTest
+	$ g++ -std=c++17 -O2 CounterTest.cpp -o CounterTest
 
-Run with:
+Run with (from the repository root, so the benchmark corpus can be found):
 	$ ./CounterTest
 */
 
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
 #include "Counter.h"
+#include "Tokenizer.h"
+
+static std::size_t allocatedBytes = 0; // bytes currently allocated through CountingAllocator
+
+template <typename T>
+struct CountingAllocator {
+	/* Allocator that keeps track of the memory used by a standard container. */
+
+	typedef T value_type;
+	CountingAllocator() {}
+	template <typename U> CountingAllocator(const CountingAllocator<U>&) {}
+	T* allocate(std::size_t n) {
+		allocatedBytes += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T* p, std::size_t n) {
+		allocatedBytes -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+	template <typename U> bool operator==(const CountingAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+// the previous Counter type, for comparison
+typedef std::unordered_map<std::string, int, std::hash<std::string>, std::equal_to<std::string>,
+	CountingAllocator< std::pair<const std::string, int> > > MapCounter;
+
+void benchmark_wire_format(const std::vector<std::string_view>& words) {
+	/* Compare the size and (de)serialization time of the wire format against the previous
+	newline-separated words plus vector of counts, built through a std::stringstream and parsed
+	back with `ss >> word`. */
+
+	typedef std::chrono::steady_clock Clock;
+	Counter counter;
+	for (std::string_view word: words)
+		update_counter(counter, word);
+
+	// previous format
+	auto start = Clock::now();
+	std::stringstream out;
+	std::vector<int> counts;
+	for (auto& pair: counter) {
+		out << pair.first << '\n';
+		counts.push_back(pair.second);
+	}
+	std::string oldWords = out.str();
+	double oldEncode = std::chrono::duration<double>(Clock::now() - start).count();
+	start = Clock::now();
+	Counter oldCounter;
+	std::stringstream in(oldWords);
+	std::string word;
+	int i = 0;
+	while (in >> word)
+		update_counter(oldCounter, word, counts[i++]);
+	double oldDecode = std::chrono::duration<double>(Clock::now() - start).count();
+	std::size_t oldBytes = oldWords.size() + counts.size() * sizeof(int);
+
+	std::cout << "| " << std::left << std::setw(26) << "Wire format" << " | " << std::right << std::setw(12)
+		<< "Bytes" << " | " << std::setw(10) << "Encode ms" << " | " << std::setw(11) << "Decode ms" << " |" << std::endl;
+	std::cout << "| " << std::left << std::setw(26) << "words + vector<int>" << " | " << std::right << std::setw(12)
+		<< oldBytes << " | " << std::setw(10) << oldEncode * 1e3 << " | " << std::setw(11) << oldDecode * 1e3 << " |" << std::endl;
+
+	for (bool frontCoded: { false, true }) {
+		start = Clock::now();
+		std::string buffer;
+		decompose_counter(counter, buffer, frontCoded);
+		double encode = std::chrono::duration<double>(Clock::now() - start).count();
+		start = Clock::now();
+		Counter newCounter;
+		compose_counter(newCounter, buffer.data(), buffer.size());
+		double decode = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::cout << "| " << std::left << std::setw(26) << (frontCoded ? "front-coded + varints" : "length-prefixed + varints")
+			<< " | " << std::right << std::setw(12) << buffer.size() << " | " << std::setw(10) << encode * 1e3
+			<< " | " << std::setw(11) << decode * 1e3 << " |" << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+void benchmark_counters(const std::vector<std::string_view>& words) {
+	/* Compare inserts/sec and bytes per entry of the Counter against the previous
+	std::unordered_map<std::string, int> based Counter, counting the same sequence of words. */
+
+	const int rounds = 5;
+	typedef std::chrono::steady_clock Clock;
+
+	// previous Counter: word copied into a std::string, hashed once by find() and again by []
+	double mapSeconds = 0;
+	std::size_t mapBytes = 0, mapSize = 0;
+	for (int r = 0; r < rounds; r++) {
+		MapCounter counter;
+		auto start = Clock::now();
+		for (std::string_view view: words) {
+			std::string word(view);
+			if (counter.find(word) != counter.end())
+				counter[word] += 1;
+			else
+				counter[word] = 1;
+		}
+		mapSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		mapSize = counter.size();
+		mapBytes = allocatedBytes;
+		for (auto& item: counter) // keys too long for the small string buffer live on the heap
+			if (item.first.capacity() > 15)
+				mapBytes += item.first.capacity() + 1;
+	}
+
+	// flat Counter: words counted straight from their views
+	double flatSeconds = 0;
+	std::size_t flatBytes = 0, flatSize = 0;
+	for (int r = 0; r < rounds; r++) {
+		Counter counter;
+		auto start = Clock::now();
+		for (std::string_view word: words)
+			update_counter(counter, word);
+		flatSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		flatSize = counter.size();
+		flatBytes = counter.memory_usage();
+	}
+
+	double inserts = (double) words.size() * rounds;
+	std::cout << "| " << std::left << std::setw(26) << "Counter" << " | " << std::right << std::setw(12)
+		<< "Inserts/sec" << " | " << std::setw(10) << "Entries" << " | " << std::setw(11) << "Bytes/entry" << " |" << std::endl;
+	std::cout << "| " << std::left << std::setw(26) << "unordered_map<string, int>" << " | " << std::right
+		<< std::setw(12) << (long long) (inserts / mapSeconds) << " | " << std::setw(10) << mapSize << " | "
+		<< std::setw(11) << mapBytes / std::max<std::size_t>(mapSize, 1) << " |" << std::endl;
+	std::cout << "| " << std::left << std::setw(26) << "Counter (flat table)" << " | " << std::right
+		<< std::setw(12) << (long long) (inserts / flatSeconds) << " | " << std::setw(10) << flatSize << " | "
+		<< std::setw(11) << flatBytes / std::max<std::size_t>(flatSize, 1) << " |" << std::endl;
+	std::cout << std::endl;
+}
 
 int main() {
 	// Defining an empty Counter ...
@@ -52,28 +187,39 @@ int main() {
 	std::cout << std::endl;
 
 
-	// Decomposing the Counter contents into contiguous data objects ...
+	// Decomposing the Counter contents into a contiguous buffer ...
 	
-	std::string counter_keys; // to contiguously store the counter keys (string) where the keys are separated by a newline char
-	std::vector<int> counter_values; // to contiguously store the counter values (int) where each value is an element
-	decompose_counter(fruit_basket, counter_keys, counter_values);
+	std::string counter_buffer; // header followed by length-prefixed words and varint counts
+	decompose_counter(fruit_basket, counter_buffer);
+	std::string sorted_buffer; // same, with the words sorted and front-coded (prefix-compressed)
+	decompose_counter(fruit_basket, sorted_buffer, true);
 	
 	std::cout << "Decomposition of fruit_basket:-" << std::endl;
-	std::cout << "Fruit names (counter keys):" << std::endl << counter_keys;
-	std::cout << "Fruit count (counter values):" << std::endl;
-	for (int i : counter_values)
-		std::cout << i << std::endl;
+	std::cout << "Plain buffer size: " << counter_buffer.size() << " bytes" << std::endl;
+	std::cout << "Front-coded buffer size: " << sorted_buffer.size() << " bytes" << std::endl;
 	std::cout << std::endl;
 	
 	
-	// Recomposing the Counter from contiguous data objects ...
+	// Recomposing the Counter from the buffers ...
 	
 	Counter new_fruit_basket; // new Counter
 	
-	compose_counter(new_fruit_basket, counter_keys, counter_values);
+	compose_counter(new_fruit_basket, counter_buffer.data(), counter_buffer.size());
 	std::cout << "(Re)composition of new_fruit_basket:-" << std::endl;
 	print_counter(new_fruit_basket);
 	
+	Counter sorted_fruit_basket; // new Counter, from the front-coded buffer
+	compose_counter(sorted_fruit_basket, sorted_buffer.data(), sorted_buffer.size());
+	std::cout << "(Re)composition of sorted_fruit_basket (words in alphabetical order):-" << std::endl;
+	print_counter(sorted_fruit_basket);
+	
+	// A corrupted buffer is rejected ...
+	std::string corrupt_buffer = counter_buffer;
+	corrupt_buffer[corrupt_buffer.size() / 2] ^= 0x01;
+	std::cout << "Composing a corrupted buffer " << (compose_counter(new_fruit_basket,
+		corrupt_buffer.data(), corrupt_buffer.size()) == 0 ? "fails" : "succeeds (BUG)") << std::endl;
+	std::cout << std::endl;
+	
 	
 	// Printing Counter contents in some sorted order ...
 	
@@ -82,6 +228,40 @@ int main() {
 	
 	std::cout << "Sorted new_fruit_basket by most common counts:-" << std::endl;
 	print_counter(new_fruit_basket, most_common);
+
+
+	// Benchmarking the Counter against the previous std::unordered_map based Counter ...
+
+	std::ifstream corpus("ascii-only/shelly.txt", std::ios::binary);
+	std::string text((std::istreambuf_iterator<char>(corpus)), std::istreambuf_iterator<char>());
+	if (text.empty()) {
+		std::cout << "Benchmark skipped: could not read ascii-only/shelly.txt" << std::endl;
+		return 0;
+	}
+
+	// keep a lowercased copy of every word, so the benchmark only measures counting
+	std::string wordStore;
+	std::vector<std::pair<std::size_t, std::size_t> > wordSpans;
+	Tokenizer tokenizer(1, 20);
+	tokenizer.tokenize(text.data(), text.size(), [&](std::string_view word) {
+		wordSpans.push_back({ wordStore.size(), word.size() });
+		wordStore.append(word);
+	});
+	std::vector<std::string_view> words;
+	for (auto& span: wordSpans)
+		words.push_back(std::string_view(wordStore).substr(span.first, span.second));
+
+	std::cout << "Counting the " << words.size() << " words of ascii-only/shelly.txt:-" << std::endl;
+	benchmark_counters(words);
+	benchmark_wire_format(words);
+
+	// ... and on a larger vocabulary of mostly unique words
+	std::vector<std::string> manyWords;
+	for (int i = 0; i < 1000000; i++)
+		manyWords.push_back("word" + std::to_string(i * 2654435761u % 400000));
+	std::vector<std::string_view> manyViews(manyWords.begin(), manyWords.end());
+	std::cout << "Counting 1000000 words out of a vocabulary of 400000:-" << std::endl;
+	benchmark_counters(manyViews);
 	return 0;
 }
 
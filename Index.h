@@ -0,0 +1,496 @@
+/*
+Group name: Kismet
+
+Word count index (--index): the final counter written as an immutable file, which IndexQuery.cpp
+maps into memory to look words up, scan prefixes and list the most common words without counting
+the text again. An index file holds, every section 8-byte aligned:
+	- an IndexHeader: magic number, version, number of words, total count, and where every section is
+	- the keys: the words in alphabetical order, front-coded in blocks of INDEX_BLOCK_WORDS words
+	  (the first word of a block is stored whole, so every block can be decoded on its own)
+	- the block table: offset of every block in the keys, for binary searches by word or prefix
+	- the counts: count of every word by ordinal (its position in alphabetical order)
+	- the ranking: the ordinals of the words from the most common, for top-N queries
+	- a minimal perfect hash function of the words, BBHash-like: levels of bit arrays, a rank sample
+	  every INDEX_RANK_WORDS words of bits, and the ordinal of every hash value (slot)
+Opening an index only maps the file and checks its header, so it takes the same time whatever its
+size. A lookup follows the word through the levels to its slot, decodes the word of the slot's
+ordinal (at most one block) to confirm it, and reads its count. The few words that collide at every
+level, if any, are left out of the hash function and found by binary search.
+*/
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <algorithm> 		// std::sort, std::max
+#include <cstdint> 			// std::uint32_t, std::uint64_t
+#include <cstdio> 			// std::rename, std::remove
+#include <cstring> 			// std::memcpy, std::memset
+#include <fstream> 			// std::ofstream
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <string_view> 		// std::string_view
+#include <vector> 			// std::vector
+#include <fcntl.h> 			// open
+#include <sys/mman.h> 		// mmap, madvise, munmap
+#include <sys/stat.h> 		// fstat
+#include <unistd.h> 		// close
+#include "Counter.h"
+
+#define INDEX_MAGIC 0x31494357u 		// "WCI1"
+#define INDEX_VERSION 1
+#define INDEX_BLOCK_WORDS 16 			// words per front-coded block of the keys
+#define INDEX_MPHF_GAMMA 2 				// bits of a level of the hash function per word left to place
+#define INDEX_MPHF_LEVELS 24 			// levels of the hash function, words left after them are searched
+#define INDEX_RANK_WORDS 8 				// 64-bit words of the bit arrays per rank sample
+
+struct IndexHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint64_t words; 			// number of words
+	std::uint64_t total; 			// sum of the counts
+	std::uint64_t blocks; 			// blocks of the keys
+	std::uint64_t keysOffset;
+	std::uint64_t keysSize;
+	std::uint64_t blockTableOffset; // uint64 per block
+	std::uint64_t countsOffset; 	// uint64 per word
+	std::uint64_t rankingOffset; 	// uint32 per word
+	std::uint64_t bitsOffset; 		// uint64 words of the bit arrays of every level, back to back
+	std::uint64_t ranksOffset; 		// uint64 per INDEX_RANK_WORDS words of bits: set bits before them
+	std::uint64_t slotsOffset; 		// uint32 per hashed word: its ordinal
+	std::uint64_t fileSize;
+	std::uint32_t levels; 			// levels of the hash function in use
+	std::uint32_t leftover; 		// words left out of the hash function
+	std::uint64_t levelBegin[INDEX_MPHF_LEVELS + 1]; // first bit of every level, a multiple of 64
+};
+
+inline std::uint64_t index_level_hash(std::uint64_t wordHash, std::uint32_t level) {
+	/* Hash of a word for a level of the hash function, from its hash_word(). */
+
+	return hash_bytes((const char*) &wordHash, sizeof(wordHash), level + 1);
+}
+
+inline std::uint64_t align8(std::uint64_t offset) {
+	return (offset + 7) & ~7ull;
+}
+
+class IndexWriter {
+	/* Builds an index from words added in alphabetical order, and writes it to a file. */
+
+public:
+	void add(std::string_view word, long long count) {
+		/* Add the next word, which must come after the previous one alphabetically. */
+
+		std::uint64_t ordinal = counts.size();
+		std::size_t shared = 0;
+		if (ordinal % INDEX_BLOCK_WORDS == 0) {
+			blockTable.push_back(keys.size());
+		} else {
+			std::size_t limit = std::min(previous.size(), word.size());
+			while (shared < limit && previous[shared] == word[shared])
+				shared++;
+		}
+		put_varint(keys, shared);
+		put_varint(keys, word.size() - shared);
+		keys.append(word.data() + shared, word.size() - shared);
+		previous.assign(word.data(), word.size());
+
+		counts.push_back(count);
+		hashes.push_back(hash_word(word));
+		total += count;
+	}
+
+	std::uint64_t size() const { return counts.size(); }
+
+	bool write(const std::string& path) {
+		/* Build the hash function and the ranking, and write the index through a temporary file
+		renamed over `path`. Return false if the file cannot be written. */
+
+		IndexHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = INDEX_MAGIC;
+		header.version = INDEX_VERSION;
+		header.words = counts.size();
+		header.total = total;
+		header.blocks = blockTable.size();
+
+		std::vector<std::uint64_t> bits, ranks;
+		std::vector<std::uint32_t> slots;
+		build_hash_function(header, bits, ranks, slots);
+
+		std::vector<std::uint32_t> ranking(counts.size());
+		for (std::uint32_t i = 0; i < ranking.size(); i++)
+			ranking[i] = i;
+		std::sort(ranking.begin(), ranking.end(), [this](std::uint32_t x, std::uint32_t y) {
+			return counts[x] != counts[y] ? counts[x] > counts[y] : x < y; // like most_common()
+		});
+
+		header.keysOffset = align8(sizeof(IndexHeader));
+		header.keysSize = keys.size();
+		header.blockTableOffset = align8(header.keysOffset + header.keysSize);
+		header.countsOffset = header.blockTableOffset + blockTable.size() * 8;
+		header.rankingOffset = header.countsOffset + counts.size() * 8;
+		header.bitsOffset = align8(header.rankingOffset + ranking.size() * 4);
+		header.ranksOffset = header.bitsOffset + bits.size() * 8;
+		header.slotsOffset = header.ranksOffset + ranks.size() * 8;
+		header.fileSize = header.slotsOffset + slots.size() * 4;
+
+		std::string tempPath = path + ".tmp";
+		std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		std::uint64_t written = 0;
+		auto put = [&file, &written](std::uint64_t offset, const void* data, std::size_t size) {
+			static const char padding[8] = {};
+			file.write(padding, offset - written);
+			file.write((const char*) data, size);
+			written = offset + size;
+		};
+		put(0, &header, sizeof(header));
+		put(header.keysOffset, keys.data(), keys.size());
+		put(header.blockTableOffset, blockTable.data(), blockTable.size() * 8);
+		put(header.countsOffset, counts.data(), counts.size() * 8);
+		put(header.rankingOffset, ranking.data(), ranking.size() * 4);
+		put(header.bitsOffset, bits.data(), bits.size() * 8);
+		put(header.ranksOffset, ranks.data(), ranks.size() * 8);
+		put(header.slotsOffset, slots.data(), slots.size() * 4);
+		if (!file || (file.close(), std::rename(tempPath.c_str(), path.c_str()) != 0)) {
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::string keys;
+	std::vector<std::uint64_t> blockTable;
+	std::vector<std::uint64_t> counts; 	// by ordinal
+	std::vector<std::uint64_t> hashes; 	// hash_word() by ordinal
+	std::string previous; 				// last word added
+	std::uint64_t total = 0;
+
+	void build_hash_function(IndexHeader& header, std::vector<std::uint64_t>& bits, std::vector<std::uint64_t>& ranks,
+		std::vector<std::uint32_t>& slots) {
+		/* Place the words level by level: at each level a word gets a bit of an array of
+		INDEX_MPHF_GAMMA bits per word left, and keeps it if no other word left got the same bit;
+		the others move on to the next level. The hash value of a word is the rank of its bit among
+		the set bits of every level. */
+
+		std::vector<std::uint32_t> left(hashes.size()), next;
+		for (std::uint32_t i = 0; i < left.size(); i++)
+			left[i] = i;
+		std::vector< std::pair<std::uint64_t, std::uint32_t> > placed; // (bit, ordinal)
+		placed.reserve(left.size());
+
+		std::uint32_t level = 0;
+		for (; level < INDEX_MPHF_LEVELS && !left.empty(); level++) {
+			std::uint64_t begin = header.levelBegin[level];
+			std::uint64_t levelBits = std::max<std::uint64_t>(64, (left.size() * INDEX_MPHF_GAMMA + 63) / 64 * 64);
+			header.levelBegin[level + 1] = begin + levelBits;
+
+			std::vector<std::uint64_t> seen(levelBits / 64, 0), collided(levelBits / 64, 0);
+			for (std::uint32_t ordinal: left) {
+				std::uint64_t bit = index_level_hash(hashes[ordinal], level) % levelBits;
+				std::uint64_t mask = 1ull << (bit % 64);
+				if (seen[bit / 64] & mask)
+					collided[bit / 64] |= mask;
+				seen[bit / 64] |= mask;
+			}
+			next.clear();
+			for (std::uint32_t ordinal: left) {
+				std::uint64_t bit = index_level_hash(hashes[ordinal], level) % levelBits;
+				if (collided[bit / 64] & (1ull << (bit % 64)))
+					next.push_back(ordinal);
+				else
+					placed.emplace_back(begin + bit, ordinal);
+			}
+			for (std::size_t w = 0; w < seen.size(); w++)
+				bits.push_back(seen[w] & ~collided[w]);
+			left.swap(next);
+		}
+		for (std::uint32_t l = level; l < INDEX_MPHF_LEVELS; l++)
+			header.levelBegin[l + 1] = header.levelBegin[level];
+		header.levels = level;
+		header.leftover = left.size();
+
+		std::uint64_t setBits = 0;
+		for (std::size_t w = 0; w < bits.size(); w++) {
+			if (w % INDEX_RANK_WORDS == 0)
+				ranks.push_back(setBits);
+			setBits += __builtin_popcountll(bits[w]);
+		}
+
+		// Every placed bit is set, so the slots are the placed words in the order of their bits
+		std::sort(placed.begin(), placed.end());
+		slots.reserve(placed.size());
+		for (auto& entry: placed)
+			slots.push_back(entry.second);
+	}
+};
+
+void index_corrupt() {
+	/* Abort on data of an index file that its header did not rule out. */
+
+	std::cout << "Error! Index file is corrupt. Aborting program." << std::endl;
+	exit(1);
+}
+
+class WordIndex {
+	/* An index file mapped into memory, read only, for the lifetime of the object. */
+
+public:
+	~WordIndex() {
+		if (mapping != NULL)
+			munmap(mapping, mapLength);
+	}
+
+	WordIndex() {}
+	WordIndex(const WordIndex&) = delete;
+	WordIndex& operator=(const WordIndex&) = delete;
+
+	bool open(const std::string& path) {
+		/* Map an index file. Return false if it cannot be read or is not an index of this version. */
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || (std::uint64_t) info.st_size < sizeof(IndexHeader)) {
+			close(fd);
+			return false;
+		}
+		mapLength = info.st_size;
+		mapping = mmap(NULL, mapLength, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd); // the mapping stays valid after the descriptor is closed
+		if (mapping == MAP_FAILED) {
+			mapping = NULL;
+			return false;
+		}
+		madvise(mapping, mapLength, MADV_RANDOM); // lookups touch a few pages each
+
+		base = (const char*) mapping;
+		header = (const IndexHeader*) base;
+		if (!check_header())
+			return false;
+		keys = base + header->keysOffset;
+		keysEnd = keys + header->keysSize;
+		blockTable = (const std::uint64_t*) (base + header->blockTableOffset);
+		counts = (const std::uint64_t*) (base + header->countsOffset);
+		ranking = (const std::uint32_t*) (base + header->rankingOffset);
+		bits = (const std::uint64_t*) (base + header->bitsOffset);
+		ranks = (const std::uint64_t*) (base + header->ranksOffset);
+		slots = (const std::uint32_t*) (base + header->slotsOffset);
+		return true;
+	}
+
+	std::uint64_t words() const { return header->words; }
+	std::uint64_t total() const { return header->total; }
+	std::uint64_t file_size() const { return header->fileSize; }
+	const IndexHeader& get_header() const { return *header; }
+
+	long long count_at(std::uint64_t ordinal) const { return counts[ordinal]; }
+
+	std::uint64_t ranked(std::uint64_t i) const {
+		/* Return the ordinal of the i-th most common word. */
+
+		if (ranking[i] >= header->words)
+			index_corrupt();
+		return ranking[i];
+	}
+
+	const char* block(std::uint64_t b) const {
+		/* Return the start of a block of the keys. */
+
+		if (blockTable[b] >= header->keysSize)
+			index_corrupt();
+		return keys + blockTable[b];
+	}
+
+	const char* keys_end() const { return keysEnd; }
+
+	bool next_word(const char*& pos, std::string& word) const {
+		/* Decode the word at `pos` into `word`, which holds the previous word of its block, and
+		advance `pos` past it. Return false if the keys are corrupt. */
+
+		std::uint64_t shared, suffix;
+		if (!get_varint(pos, keysEnd, shared) || !get_varint(pos, keysEnd, suffix) || shared > word.size()
+			|| suffix > (std::uint64_t) (keysEnd - pos))
+			return false;
+		word.resize(shared);
+		word.append(pos, suffix);
+		pos += suffix;
+		return true;
+	}
+
+	bool word_at(std::uint64_t ordinal, std::string& word) const {
+		/* Decode the word of an ordinal, from the start of its block. */
+
+		const char* pos = block(ordinal / INDEX_BLOCK_WORDS);
+		word.clear();
+		for (std::uint64_t i = 0; i <= ordinal % INDEX_BLOCK_WORDS; i++)
+			if (!next_word(pos, word))
+				return false;
+		return true;
+	}
+
+	std::uint64_t lower_bound(std::string_view key) const {
+		/* Return the ordinal of the first word not before `key` (words() if there is none): a binary
+		search over the first words of the blocks, then a scan of one block. */
+
+		std::string word;
+		std::uint64_t lo = 0, hi = header->blocks; // the blocks before lo start before key
+		while (lo < hi) {
+			std::uint64_t mid = lo + (hi - lo) / 2;
+			const char* pos = block(mid);
+			word.clear();
+			if (next_word(pos, word) && std::string_view(word) < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == 0)
+			return 0;
+		std::uint64_t ordinal = (lo - 1) * INDEX_BLOCK_WORDS, end = std::min(lo * INDEX_BLOCK_WORDS, header->words);
+		const char* pos = block(lo - 1);
+		word.clear();
+		for (; ordinal < end && next_word(pos, word) && std::string_view(word) < key; ordinal++)
+			;
+		return ordinal;
+	}
+
+	bool find(std::string_view key, long long& count) const {
+		/* Look a word up; return whether it is in the index, and its count if it is. */
+
+		std::string word;
+		std::uint64_t wordHash = hash_word(key);
+		for (std::uint32_t level = 0; level < header->levels; level++) {
+			std::uint64_t begin = header->levelBegin[level], levelBits = header->levelBegin[level + 1] - begin;
+			std::uint64_t bit = begin + index_level_hash(wordHash, level) % levelBits;
+			if (!(bits[bit / 64] & (1ull << (bit % 64))))
+				continue;
+			std::uint64_t slot = rank(bit);
+			if (slot >= header->words - header->leftover || slots[slot] >= header->words)
+				index_corrupt();
+			std::uint64_t ordinal = slots[slot];
+			if (word_at(ordinal, word) && std::string_view(word) == key) {
+				count = counts[ordinal];
+				return true;
+			}
+			break; // the bit of another word, so this one is not placed
+		}
+		if (header->leftover == 0)
+			return false;
+
+		std::uint64_t ordinal = lower_bound(key);
+		if (ordinal < header->words && word_at(ordinal, word) && std::string_view(word) == key) {
+			count = counts[ordinal];
+			return true;
+		}
+		return false;
+	}
+
+private:
+	void* mapping = NULL;
+	std::size_t mapLength = 0;
+	const char* base = NULL;
+	const IndexHeader* header = NULL;
+	const char* keys = NULL;
+	const char* keysEnd = NULL;
+	const std::uint64_t* blockTable = NULL;
+	const std::uint64_t* counts = NULL;
+	const std::uint32_t* ranking = NULL;
+	const std::uint64_t* bits = NULL;
+	const std::uint64_t* ranks = NULL;
+	const std::uint32_t* slots = NULL;
+
+	bool check_header() const {
+		/* Check that the header describes an index of this version whose sections lie in order
+		within the file, with the sizes given by the number of words and the levels of the hash
+		function. The contents of the sections are checked as they are read. */
+
+		const IndexHeader& h = *header;
+		if (h.magic != INDEX_MAGIC || h.version != INDEX_VERSION || h.fileSize != mapLength
+			|| h.words > h.fileSize / 8 || h.leftover > h.words || h.levels > INDEX_MPHF_LEVELS
+			|| h.blocks != (h.words + INDEX_BLOCK_WORDS - 1) / INDEX_BLOCK_WORDS || h.levelBegin[0] != 0)
+			return false; // the counts take 8 bytes a word, so `words` bounds the other sizes
+		for (std::uint32_t level = 0; level < h.levels; level++)
+			if (h.levelBegin[level + 1] <= h.levelBegin[level] || h.levelBegin[level + 1] % 64 != 0
+				|| h.levelBegin[level + 1] / 8 > h.fileSize)
+				return false; // every level in use has bits, or its hash could not be reduced
+		std::uint64_t bitWords = h.levelBegin[h.levels] / 64;
+		std::uint64_t rankSamples = (bitWords + INDEX_RANK_WORDS - 1) / INDEX_RANK_WORDS;
+
+		// Every section starts 8-byte aligned, after the end of the one before it
+		std::uint64_t end = sizeof(IndexHeader);
+		auto section = [&end, &h](std::uint64_t offset, std::uint64_t size) {
+			if (offset % 8 != 0 || offset < end || offset > h.fileSize || size > h.fileSize - offset)
+				return false;
+			end = offset + size;
+			return true;
+		};
+		return section(h.keysOffset, h.keysSize) && section(h.blockTableOffset, h.blocks * 8)
+			&& section(h.countsOffset, h.words * 8) && section(h.rankingOffset, h.words * 4)
+			&& section(h.bitsOffset, bitWords * 8) && section(h.ranksOffset, rankSamples * 8)
+			&& section(h.slotsOffset, (h.words - h.leftover) * 4) && end == h.fileSize;
+	}
+
+	std::uint64_t rank(std::uint64_t bit) const {
+		/* Return the number of set bits before `bit`. */
+
+		std::uint64_t word = bit / 64, sample = word / INDEX_RANK_WORDS;
+		std::uint64_t result = ranks[sample];
+		for (std::uint64_t w = sample * INDEX_RANK_WORDS; w < word; w++)
+			result += __builtin_popcountll(bits[w]);
+		return result + __builtin_popcountll(bits[word] & ((1ull << (bit % 64)) - 1));
+	}
+};
+
+class IndexCursor {
+	/* Walks the words of an index in alphabetical order, from a given ordinal. */
+
+public:
+	IndexCursor(const WordIndex& index, std::uint64_t ordinal = 0) : index(index), ordinal(ordinal) {
+		if (ordinal >= index.words())
+			return;
+		pos = index.block(ordinal / INDEX_BLOCK_WORDS);
+		for (std::uint64_t i = 0; i <= ordinal % INDEX_BLOCK_WORDS; i++)
+			decode();
+	}
+
+	bool done() const { return ordinal >= index.words(); }
+	std::string_view word() const { return current; }
+	long long count() const { return index.count_at(ordinal); }
+	std::uint64_t get_ordinal() const { return ordinal; }
+
+	void next() {
+		// The blocks lie back to back, and the first word of a block shares nothing
+		if (++ordinal < index.words())
+			decode();
+	}
+
+private:
+	const WordIndex& index;
+	std::uint64_t ordinal;
+	const char* pos = NULL;
+	std::string current;
+
+	void decode() {
+		if (!index.next_word(pos, current))
+			index_corrupt();
+	}
+};
+
+bool write_index(const Counter& counter, const std::string& path) {
+	/* Write the words of a counter to an index file. Return false if it cannot be written. */
+
+	std::vector<const CounterEntry*> entries;
+	entries.reserve(counter.size());
+	for (auto& entry: counter)
+		entries.push_back(&entry);
+	std::sort(entries.begin(), entries.end(), [](const CounterEntry* x, const CounterEntry* y) {
+		return x->first < y->first;
+	});
+	IndexWriter writer;
+	for (const CounterEntry* entry: entries)
+		writer.add(entry->first, entry->second);
+	return writer.write(path);
+}
+
+#endif
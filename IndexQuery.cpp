@@ -0,0 +1,173 @@
+/*
+Group name: Kismet
+
+Query tool of the word count index written by `ass --index PATH` (see Index.h). The index is
+mapped into memory, so a query only reads the pages it needs, and starts as fast for a large index
+as for a small one. Two or more indexes can also be merged into one, adding up the counts of their
+words, without counting the text again.
+
+Compile with:
+	$ g++ -std=c++17 -O2 IndexQuery.cpp -o IndexQuery
+
+Run with:
+	$ mpirun -n 4 ./ass --index words.idx test-data/fruits1.txt ascii-only/shelly.txt
+	$ ./IndexQuery words.idx count apple banana    (count of every word, 0 if it is not in the index)
+	$ ./IndexQuery words.idx prefix pre 20         (words starting with "pre", at most 20)
+	$ ./IndexQuery words.idx top 10                (10 most common words)
+	$ ./IndexQuery words.idx info                  (size and layout of the index)
+	$ ./IndexQuery words.idx bench 1000000         (time of a lookup, over the words of the index)
+	$ ./IndexQuery --merge all.idx a.idx b.idx     (one index of the words of both)
+*/
+
+#include <chrono> 			// std::chrono
+#include <cstdlib> 			// std::atoll
+#include <iostream> 		// std::cout
+#include <memory> 			// std::unique_ptr
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include "Index.h"
+
+void print_usage(const char* program) {
+	std::cout << "Usage: " << program << " INDEX command [arguments]" << std::endl
+		<< "  count WORD ...         count of every word (0 if it is not in the index)" << std::endl
+		<< "  prefix PREFIX [N]      words starting with PREFIX, alphabetically (at most N)" << std::endl
+		<< "  top N                  the N most common words" << std::endl
+		<< "  info                   number of words, total count and size of the index" << std::endl
+		<< "  bench [N]              time N lookups of words of the index (default 1000000)" << std::endl
+		<< "   or: " << program << " --merge OUTPUT INDEX ...  merge indexes, adding up the counts" << std::endl;
+}
+
+void open_or_exit(WordIndex& index, const std::string& path) {
+	if (!index.open(path)) {
+		std::cout << "Error: '" << path << "' is not a word count index" << std::endl;
+		exit(1);
+	}
+}
+
+void print_table(const std::vector<CounterEntry>& entries) {
+	/* Print words in the table of the word count report. */
+
+	std::string out;
+	append_table_header(out);
+	for (const CounterEntry& entry: entries)
+		append_table_row(out, entry);
+	append_table_footer(out);
+	std::cout << out;
+}
+
+void merge_indexes(const std::string& outputPath, const std::vector<std::string>& paths) {
+	/* Merge the words of several indexes, in one alphabetical pass over all of them. */
+
+	std::vector<std::unique_ptr<WordIndex>> indexes;
+	std::vector<std::unique_ptr<IndexCursor>> cursors;
+	for (const std::string& path: paths) {
+		indexes.emplace_back(new WordIndex());
+		open_or_exit(*indexes.back(), path);
+		cursors.emplace_back(new IndexCursor(*indexes.back()));
+	}
+
+	IndexWriter writer;
+	std::string word;
+	while (true) {
+		const IndexCursor* first = NULL;
+		for (auto& cursor: cursors)
+			if (!cursor->done() && (first == NULL || cursor->word() < first->word()))
+				first = cursor.get();
+		if (first == NULL)
+			break;
+		word = first->word();
+		long long count = 0;
+		for (auto& cursor: cursors)
+			if (!cursor->done() && cursor->word() == word) {
+				count += cursor->count();
+				cursor->next();
+			}
+		writer.add(word, count);
+	}
+	if (!writer.write(outputPath)) {
+		std::cout << "Error: could not write index '" << outputPath << "'" << std::endl;
+		exit(1);
+	}
+	std::cout << "Merged " << paths.size() << " indexes into " << outputPath << ": " << writer.size() << " words"
+		<< std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc >= 4 && std::string(argv[1]) == "--merge") {
+		merge_indexes(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+		return 0;
+	}
+	if (argc < 3) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	WordIndex index;
+	open_or_exit(index, argv[1]);
+	std::string command = argv[2];
+	std::vector<CounterEntry> entries;
+
+	if (command == "count") {
+		for (int i = 3; i < argc; i++) {
+			long long count = 0;
+			index.find(argv[i], count);
+			std::cout << argv[i] << " " << count << std::endl;
+		}
+	} else if (command == "prefix" && argc >= 4) {
+		std::string_view prefix = argv[3];
+		long long limit = argc >= 5 ? std::atoll(argv[4]) : -1;
+		std::vector<std::string> words; // backs the entries
+		for (IndexCursor cursor(index, index.lower_bound(prefix)); !cursor.done() && (long long) words.size() != limit
+			&& cursor.word().substr(0, prefix.size()) == prefix; cursor.next()) {
+			words.emplace_back(cursor.word());
+			entries.push_back({ std::string_view(), cursor.count() });
+		}
+		for (std::size_t i = 0; i < words.size(); i++)
+			entries[i].first = words[i];
+		print_table(entries);
+	} else if (command == "top" && argc >= 4) {
+		std::uint64_t n = std::min<std::uint64_t>(std::max(0LL, std::atoll(argv[3])), index.words());
+		std::vector<std::string> words(n);
+		for (std::uint64_t i = 0; i < n; i++) {
+			std::uint64_t ordinal = index.ranked(i);
+			index.word_at(ordinal, words[i]);
+			entries.push_back({ words[i], index.count_at(ordinal) });
+		}
+		print_table(entries);
+	} else if (command == "info") {
+		const IndexHeader& header = index.get_header();
+		std::cout << "Words      : " << header.words << std::endl
+			<< "Total count: " << header.total << std::endl
+			<< "File size  : " << header.fileSize << " bytes (keys " << header.keysSize << " bytes in "
+			<< header.blocks << " blocks of " << INDEX_BLOCK_WORDS << " words)" << std::endl
+			<< "Hash       : " << header.levels << " levels, " << header.levelBegin[header.levels] << " bits ("
+			<< (header.words > 0 ? (double) header.levelBegin[header.levels] / header.words : 0) << " per word), "
+			<< header.leftover << " words left out" << std::endl;
+	} else if (command == "bench") {
+		long long n = argc >= 4 ? std::atoll(argv[3]) : 1000000;
+		if (index.words() == 0 || n <= 0) {
+			std::cout << "Nothing to look up" << std::endl;
+			return 0;
+		}
+		// The words to look up are decoded first, spread over the whole index
+		std::vector<std::string> words;
+		for (std::uint64_t i = 0; i < std::min<std::uint64_t>(n, index.words()); i++) {
+			words.emplace_back();
+			index.word_at(i * index.words() / std::min<std::uint64_t>(n, index.words()), words.back());
+		}
+		long long found = 0, sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (long long i = 0; i < n; i++) {
+			long long count = 0;
+			found += index.find(words[i % words.size()], count);
+			sum += count;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << n << " lookups in " << seconds << " s: " << seconds / n * 1e9 << " ns per lookup (" << found
+			<< " found, counts summing to " << sum << ")" << std::endl;
+	} else {
+		print_usage(argv[0]);
+		return 1;
+	}
+	return 0;
+}
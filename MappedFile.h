@@ -0,0 +1,62 @@
+/*
+Group name: Kismet
+
+Read-only memory mapping of a byte range of a file, so the range can be tokenized directly
+from the page cache without copying it line by line into strings.
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <fcntl.h> 			// open
+#include <sys/mman.h> 		// mmap, madvise, munmap
+#include <unistd.h> 		// sysconf, close
+#include "Partition.h"
+
+class MappedRange {
+	/* Maps the bytes [range.begin, range.end) of a file for the lifetime of the object. The
+	mapping itself starts at the page boundary below `range.begin`. */
+
+public:
+	MappedRange(const std::string& filename, ByteRange range) {
+		if (range.size() <= 0)
+			return; // nothing to map
+
+		int fd = open_or_exit(filename);
+
+		long long pageSize = sysconf(_SC_PAGESIZE);
+		long long mapBegin = range.begin / pageSize * pageSize; // mmap offsets must be page aligned
+		mapLength = range.end - mapBegin;
+		mapping = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, mapBegin);
+		close(fd); // the mapping stays valid after the descriptor is closed
+		if (mapping == MAP_FAILED) {
+			std::cout << "Error: could not map file '" << filename << "'" << std::endl;
+			exit(1);
+		}
+		madvise(mapping, mapLength, MADV_SEQUENTIAL); // read-ahead aggressively, drop pages behind
+
+		rangeData = (const char*) mapping + (range.begin - mapBegin);
+		rangeSize = range.size();
+	}
+
+	~MappedRange() {
+		if (mapping != NULL)
+			munmap(mapping, mapLength);
+	}
+
+	MappedRange(const MappedRange&) = delete;
+	MappedRange& operator=(const MappedRange&) = delete;
+
+	const char* data() const { return rangeData; }
+	size_t size() const { return rangeSize; }
+
+private:
+	void* mapping = NULL;
+	size_t mapLength = 0;
+	const char* rangeData = NULL;
+	size_t rangeSize = 0;
+};
+
+#endif
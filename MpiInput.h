@@ -0,0 +1,115 @@
+/*
+Group name: Kismet
+
+Collective MPI-IO input. All processes open a file together with MPI_File_open and read equal
+byte ranges of it with MPI_File_read_at_all, so the MPI library can aggregate the requests
+(collective buffering) instead of every process hitting the file system on its own. The ranges are
+not aligned to lines beforehand; instead every process gives the bytes before its first delimiter
+(the end of a word that may have started on the previous process) to its left neighbour, which
+appends them to its own range. Cutting right after a delimiter never splits a word.
+*/
+
+#ifndef MPIINPUT_H
+#define MPIINPUT_H
+
+#include <algorithm> 		// std::min, std::max
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <mpi.h>
+#include "Partition.h"
+#include "Tokenizer.h"
+#include "Profile.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define MPIIO_PIECE_SIZE (1 << 30) 		// bytes read per collective call (counts are ints)
+#define MPIIO_CB_BUFFER_SIZE "16777216" // collective buffer size hint, in bytes
+
+MPI_Info make_read_hints() {
+	/* Hints for reading a file collectively. Unknown hints are ignored by MPI implementations. */
+
+	MPI_Info info;
+	MPI_Info_create(&info);
+	MPI_Info_set(info, "romio_cb_read", "enable"); 			// always aggregate collective reads
+	MPI_Info_set(info, "cb_buffer_size", MPIIO_CB_BUFFER_SIZE);
+	MPI_Info_set(info, "romio_ds_read", "disable"); 		// no data sieving, ranges are contiguous
+	MPI_Info_set(info, "access_style", "read_once,sequential");
+	return info;
+}
+
+bool read_file_collective(const std::string& filename, std::string& text, std::size_t& textBegin,
+	long long& bytesRead, int rank, int nprocs) {
+	/* Read this process's share of a file into `text`, which is to be tokenized from `textBegin`
+	on, cut so that no word is split between two processes. Collective over MPI_COMM_WORLD. Return
+	false (on every process) if some process's share has no delimiter to cut at, e.g. a file smaller
+	than the number of processes; the file should then be read the POSIX way. */
+
+	MPI_Info info = make_read_hints();
+	MPI_File file;
+	int error = MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_RDONLY, info, &file);
+	MPI_Info_free(&info);
+	if (error != MPI_SUCCESS) {
+		if (rank == ROOT)
+			std::cout << "Error: could not open file '" << filename << "' with MPI-IO" << std::endl;
+		exit(1);
+	}
+
+	MPI_Offset fileSize;
+	MPI_File_get_size(file, &fileSize);
+	ByteRange range = { fileSize * rank / nprocs, fileSize * (rank + 1) / nprocs };
+
+	// Every process makes the same number of collective calls, some of them possibly empty
+	long long maxRangeSize = (fileSize + nprocs - 1) / nprocs;
+	long long pieces = std::max(1LL, (maxRangeSize + MPIIO_PIECE_SIZE - 1) / MPIIO_PIECE_SIZE);
+	text.resize(range.size());
+	{
+		PROFILE_SCOPE(PROF_READ);
+		for (long long piece = 0; piece < pieces; piece++) {
+			long long offset = piece * MPIIO_PIECE_SIZE;
+			int count = std::max(0LL, std::min<long long>(MPIIO_PIECE_SIZE, range.size() - offset));
+			MPI_Status status;
+			int got = 0;
+			if (MPI_File_read_at_all(file, range.begin + offset, count > 0 ? &text[offset] : NULL, count, MPI_CHAR, &status) != MPI_SUCCESS
+				|| MPI_Get_count(&status, MPI_CHAR, &got) != MPI_SUCCESS || got != count) {
+				std::cout << "Error: could not read file '" << filename << "' with MPI-IO" << std::endl;
+				exit(1);
+			}
+		}
+	}
+	MPI_File_close(&file);
+	bytesRead = range.size();
+	PROFILE_ADD(PROF_BYTES_READ, range.size());
+
+	// The head of the range, up to and including its first delimiter, belongs to the left neighbour
+	PROFILE_SCOPE(PROF_COMM);
+	long long headSize = 0;
+	int hasCut = 1;
+	if (rank > 0) {
+		while (headSize < range.size() && !tok_is_delimiter(text[headSize]))
+			headSize++;
+		hasCut = headSize < range.size();
+		headSize = std::min(headSize + 1, range.size());
+	}
+	int allHaveCut;
+	MPI_Allreduce(&hasCut, &allHaveCut, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+	if (!allHaveCut)
+		return false;
+
+	int left = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+	int right = rank + 1 < nprocs ? rank + 1 : MPI_PROC_NULL;
+	long long tailSize = 0; // size of the right neighbour's head
+	MPI_Sendrecv(&headSize, 1, MPI_LONG_LONG, left, 0, &tailSize, 1, MPI_LONG_LONG, right, 0,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	text.resize(range.size() + tailSize); // the head of the right neighbour goes after the range
+	MPI_Sendrecv(text.data(), headSize, MPI_CHAR, left, 1, &text[range.size()], tailSize, MPI_CHAR, right, 1,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	PROFILE_ADD(PROF_BYTES_SENT, headSize);
+	PROFILE_ADD(PROF_BYTES_RECEIVED, tailSize);
+
+	textBegin = headSize;
+	return true;
+}
+
+#endif
@@ -0,0 +1,474 @@
+/*
+Group name: Kismet
+
+N-gram counting of --ngram N: every run of N consecutive words of a line (after the word length
+filter) is counted, as if the words were joined by single spaces. N-grams never run across lines,
+so the line-aligned ranges of the processes and threads see exactly the n-grams of their lines.
+
+N-grams are not stored as strings. Every counter has a dictionary giving each word an id (from 1
+on, in order of first appearance), and an n-gram is the ids of its words packed into a single
+integer key, 32 bits per id: a 64-bit key for N <= 2, a 128-bit key for N <= 4. The keys are
+counted in a flat open-addressing table of integers.
+
+Counters with different dictionaries are merged by remapping the ids of one into the other.
+Between processes, the dictionaries are merged first: ROOT builds the global dictionary and sends
+every process the map from its ids to global ones. The remapped n-grams are then combined on ROOT
+(gather) or on the owner process of each n-gram (shuffle), and only the n-grams of the report are
+decoded back into words.
+*/
+
+#ifndef NGRAM_H
+#define NGRAM_H
+
+#include <algorithm> 		// std::max, std::nth_element, std::partition, std::sort
+#include <cstdint> 			// std::uint32_t, std::uint64_t
+#include <cstring> 			// std::memcpy
+#include <iomanip> 			// std::setw
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <string_view> 		// std::string_view
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+#include "Reduce.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define NGRAM_MAX 4 				// longest n-grams: 4 ids of 32 bits fill a 128-bit key
+#define NGRAM_MIN_CAPACITY 16 		// initial number of slots of a KeyCounter
+#define DEFAULT_NGRAM_TOP 20 		// n-grams reported without --top
+
+typedef unsigned __int128 NgramKey128;
+
+inline std::uint64_t hash_key(std::uint64_t key) {
+	/* 64-bit mix of an integer key (splitmix64 finalizer). */
+
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ull;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebull;
+	key ^= key >> 31;
+	return key;
+}
+
+inline std::uint64_t hash_key(NgramKey128 key) {
+	return hash_key((std::uint64_t) key ^ hash_key((std::uint64_t) (key >> 64)));
+}
+
+template <typename Key>
+class KeyCounter {
+	/* Counter of non-zero integer keys: a flat open-addressing hash table with linear probing,
+	holding keys and counts in two parallel arrays. A key of 0 marks an empty slot. */
+
+public:
+	void add(Key key, long long count) {
+		/* Add `count` to the count of a key, inserting it if needed. */
+
+		if ((used + 1) * 4 > keys.size() * 3)
+			rehash(std::max<std::size_t>(NGRAM_MIN_CAPACITY, keys.size() * 2));
+		std::size_t mask = keys.size() - 1;
+		std::size_t slot = hash_key(key) & mask;
+		while (keys[slot] != 0 && keys[slot] != key)
+			slot = (slot + 1) & mask;
+		if (keys[slot] == 0) {
+			keys[slot] = key;
+			used++;
+		}
+		counts[slot] += count;
+	}
+
+	template <typename Visit>
+	void for_each(Visit&& visit) const {
+		/* Call `visit(key, count)` for every key. */
+
+		for (std::size_t slot = 0; slot < keys.size(); slot++)
+			if (keys[slot] != 0)
+				visit(keys[slot], counts[slot]);
+	}
+
+	std::size_t size() const { return used; }
+
+	void reserve(std::size_t count) {
+		/* Make room for `count` keys. Keys coming from another table in slot order must be added to
+		a table that has room for them all, or they pile up into long runs of linear probing. */
+
+		std::size_t capacity = NGRAM_MIN_CAPACITY;
+		while (capacity * 3 < count * 4)
+			capacity *= 2;
+		if (capacity > keys.size())
+			rehash(capacity);
+	}
+
+	void clear() {
+		/* Remove every key and free the table. */
+
+		keys = std::vector<Key>();
+		counts = std::vector<long long>();
+		used = 0;
+	}
+
+private:
+	std::vector<Key> keys; 			// key of every slot, 0 if empty; the size is a power of 2
+	std::vector<long long> counts; 	// count of every slot
+	std::size_t used = 0; 			// number of keys
+
+	void rehash(std::size_t capacity) {
+		std::vector<Key> oldKeys(capacity, 0);
+		std::vector<long long> oldCounts(capacity, 0);
+		oldKeys.swap(keys);
+		oldCounts.swap(counts);
+		std::size_t mask = capacity - 1;
+		for (std::size_t i = 0; i < oldKeys.size(); i++) {
+			if (oldKeys[i] == 0)
+				continue;
+			std::size_t slot = hash_key(oldKeys[i]) & mask;
+			while (keys[slot] != 0)
+				slot = (slot + 1) & mask;
+			keys[slot] = oldKeys[i];
+			counts[slot] = oldCounts[i];
+		}
+	}
+};
+
+template <typename Key>
+Key pack_ngram(const std::uint32_t* ids, int n) {
+	/* Pack the ids of the words of an n-gram into a key, the first word in the highest bits. */
+
+	Key key = 0;
+	for (int i = 0; i < n; i++)
+		key = (key << 32) | ids[i];
+	return key;
+}
+
+template <typename Key>
+void unpack_ngram(Key key, int n, std::uint32_t* ids) {
+	/* Inverse of `pack_ngram()`. */
+
+	for (int i = n - 1; i >= 0; i--) {
+		ids[i] = (std::uint32_t) key;
+		key >>= 32;
+	}
+}
+
+template <typename Key>
+void add_remapped(KeyCounter<Key>& to, const KeyCounter<Key>& from, const std::vector<std::uint32_t>& remap, int n) {
+	/* Add the n-grams of `from` to `to`, replacing every id i of their words by remap[i]. */
+
+	std::uint32_t ids[NGRAM_MAX];
+	to.reserve(to.size() + from.size());
+	from.for_each([&](Key key, long long count) {
+		unpack_ngram(key, n, ids);
+		for (int i = 0; i < n; i++)
+			ids[i] = remap[ids[i]];
+		to.add(pack_ngram<Key>(ids, n), count);
+	});
+}
+
+class WordDictionary {
+	/* Ids of words, from 1 on in order of first appearance. A Counter maps each word to its id, and
+	keeps its entries in insertion order, so the word of id i is entry i - 1. */
+
+public:
+	std::uint32_t id(std::string_view word) {
+		/* Return the id of a word, giving it the next id if it is new. */
+
+		std::size_t oldSize = words.size();
+		long long& id = words[word];
+		if (words.size() != oldSize)
+			id = oldSize + 1;
+		return id;
+	}
+
+	std::string_view word(std::uint32_t id) const {
+		return (words.begin() + (id - 1))->first;
+	}
+
+	std::size_t size() const { return words.size(); }
+
+	const Counter& counter() const { return words; }
+
+private:
+	Counter words; // id of every word
+};
+
+class NgramCounter {
+	/* N-gram counter of a thread or process: the dictionary of its words, and its n-grams packed
+	into 64-bit (N <= 2) or 128-bit keys. Words are fed in order with `add_word()`, and `end_line()`
+	is called wherever an n-gram must not run across. */
+
+public:
+	int n; 						// words per n-gram
+	WordDictionary dictionary;
+	KeyCounter<std::uint64_t> narrow; 	// n-grams of N <= 2
+	KeyCounter<NgramKey128> wide; 		// n-grams of N > 2
+	long long words = 0; 		// words fed, over every line
+
+	NgramCounter(int n = 2) : n(n) {
+		keyMask = n == NGRAM_MAX ? ~(NgramKey128) 0 : ((NgramKey128) 1 << (32 * n)) - 1;
+	}
+
+	void add_word(std::string_view word) {
+		/* Count the n-gram ending with this word, if the line has enough words so far. The key of
+		the last n words of the line is rolled along, one id at a time. */
+
+		lastWords = ((lastWords << 32) | dictionary.id(word)) & keyMask;
+		words++;
+		if (++lineWords < n)
+			return;
+		if (n <= 2)
+			narrow.add((std::uint64_t) lastWords, 1);
+		else
+			wide.add(lastWords, 1);
+	}
+
+	void end_line() {
+		lineWords = 0;
+	}
+
+	void merge(const NgramCounter& other) {
+		/* Add the n-grams of a counter with another dictionary to this one. */
+
+		std::vector<std::uint32_t> remap(other.dictionary.size() + 1);
+		for (std::uint32_t id = 1; id < remap.size(); id++)
+			remap[id] = dictionary.id(other.dictionary.word(id));
+		if (n <= 2)
+			add_remapped(narrow, other.narrow, remap, n);
+		else
+			add_remapped(wide, other.wide, remap, n);
+		words += other.words;
+	}
+
+	std::size_t size() const { return n <= 2 ? narrow.size() : wide.size(); }
+
+private:
+	NgramKey128 keyMask; 	// low 32 * n bits
+	NgramKey128 lastWords = 0; // ids of the last n words of the line
+	int lineWords = 0; 		// words of the line so far
+};
+
+struct NgramRow {
+	/* N-gram of the report, decoded back into words. */
+
+	std::string ngram; 	// words joined by single spaces
+	long long count;
+};
+
+template <typename Key>
+struct NgramCount {
+	Key key;
+	long long count;
+};
+
+template <typename Key>
+void encode_ngram_counts(const KeyCounter<Key>& grams, std::string& buffer) {
+	/* Append every n-gram of a KeyCounter to `buffer`, as raw NgramCount records. */
+
+	buffer.reserve(buffer.size() + grams.size() * sizeof(NgramCount<Key>));
+	grams.for_each([&buffer](Key key, long long count) {
+		NgramCount<Key> record = { key, count };
+		buffer.append((const char*) &record, sizeof(record));
+	});
+}
+
+template <typename Key>
+void encode_ngram_counts(const std::vector< NgramCount<Key> >& grams, std::string& buffer) {
+	buffer.append((const char*) grams.data(), grams.size() * sizeof(NgramCount<Key>));
+}
+
+template <typename Key>
+void decode_ngram_counts(const char* data, std::size_t size, KeyCounter<Key>& grams) {
+	/* Add the NgramCount records of a buffer to a KeyCounter. */
+
+	NgramCount<Key> record;
+	grams.reserve(grams.size() + size / sizeof(record));
+	for (std::size_t pos = 0; pos + sizeof(record) <= size; pos += sizeof(record)) {
+		std::memcpy(&record, data + pos, sizeof(record));
+		grams.add(record.key, record.count);
+	}
+}
+
+template <typename Key>
+void top_ngram_candidates(const KeyCounter<Key>& grams, long long top, std::vector< NgramCount<Key> >& candidates) {
+	/* Collect the `top` most common n-grams of a KeyCounter, plus every n-gram as common as the
+	last of them, so ties can be broken on the words once they are decoded. */
+
+	candidates.clear();
+	grams.for_each([&candidates](Key key, long long count) {
+		candidates.push_back({ key, count });
+	});
+	if ((long long) candidates.size() <= top)
+		return;
+	auto byCount = [](const NgramCount<Key>& x, const NgramCount<Key>& y) { return x.count > y.count; };
+	std::nth_element(candidates.begin(), candidates.begin() + (top - 1), candidates.end(), byCount);
+	long long threshold = candidates[top - 1].count;
+	candidates.erase(std::partition(candidates.begin(), candidates.end(), [threshold](const NgramCount<Key>& item) {
+		return item.count >= threshold;
+	}), candidates.end());
+}
+
+void merge_dictionaries(const WordDictionary& eachDictionary, WordDictionary& globalDictionary,
+	std::vector<std::uint32_t>& remap, int rank, int nprocs, bool frontCoded) {
+	/* Merge the dictionaries of every process into `globalDictionary` on ROOT, and give every
+	process the map from its ids to global ones: remap[i] is the global id of local id i. The
+	dictionaries travel as counters in the wire format of Counter.h, whose counts are the ids.
+	Collective over MPI_COMM_WORLD. */
+
+	std::string eachBuffer;
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		decompose_counter(eachDictionary.counter(), eachBuffer, frontCoded);
+	}
+	std::vector<char> gatheredBuf;
+	std::vector<int> bufOffsets;
+	gather_bytes(eachBuffer, gatheredBuf, bufOffsets, rank, nprocs);
+
+	// ROOT gives every word of every process its global id, in rank order
+	std::vector<std::uint32_t> allRemaps;
+	std::vector<int> remapSizes(nprocs), remapOffsets(nprocs);
+	if (rank == ROOT) {
+		PROFILE_SCOPE(PROF_DECODE);
+		for (int r = 0; r < nprocs; r++) {
+			Counter words;
+			std::size_t size = bufOffsets[r + 1] - bufOffsets[r];
+			if (compose_counter(words, gatheredBuf.data() + bufOffsets[r], size) != size) {
+				std::cout << "Error! Gathered dictionary data is corrupt. Aborting program." << std::endl;
+				exit(1);
+			}
+			remapOffsets[r] = allRemaps.size();
+			remapSizes[r] = words.size() + 1;
+			allRemaps.resize(allRemaps.size() + remapSizes[r], 0);
+			for (auto& entry: words)
+				allRemaps[remapOffsets[r] + entry.second] = globalDictionary.id(entry.first);
+		}
+	}
+
+	PROFILE_SCOPE(PROF_COMM);
+	remap.assign(eachDictionary.size() + 1, 0);
+	MPI_Scatterv(allRemaps.data(), remapSizes.data(), remapOffsets.data(), MPI_UINT32_T,
+		remap.data(), remap.size(), MPI_UINT32_T, ROOT, MPI_COMM_WORLD);
+}
+
+template <typename Key>
+void reduce_ngram_counts(const KeyCounter<Key>& eachGrams, const std::vector<std::uint32_t>& remap, int n,
+	bool shuffle, long long top, std::vector< NgramCount<Key> >& topGrams, long long& uniqueGrams,
+	int rank, int nprocs) {
+	/* Remap the n-grams of every process to global ids, combine them, and collect the candidates
+	of the `top` n-grams in `topGrams` on ROOT, with the number of distinct n-grams in
+	`uniqueGrams`. Collective over MPI_COMM_WORLD. */
+
+	KeyCounter<Key> grams; // n-grams of this process with global ids
+	add_remapped(grams, eachGrams, remap, n);
+
+	std::vector< NgramCount<Key> > candidates; // top n-grams owned by this process [shuffle]
+	if (shuffle) {
+		// Send every n-gram to its owner, which has all of its counts to add up
+		std::string sendBuf;
+		std::vector<int> sendAmounts(nprocs), sendOffsets(nprocs);
+		{
+			PROFILE_SCOPE(PROF_ENCODE);
+			std::vector< std::vector< NgramCount<Key> > > parts(nprocs);
+			grams.for_each([&parts, nprocs](Key key, long long count) {
+				parts[get_owner(hash_key(key), nprocs)].push_back({ key, count });
+			});
+			grams.clear();
+			for (int r = 0; r < nprocs; r++) {
+				sendOffsets[r] = sendBuf.size();
+				encode_ngram_counts(parts[r], sendBuf);
+				sendAmounts[r] = sendBuf.size() - sendOffsets[r];
+			}
+		}
+		KeyCounter<Key> owned;
+		std::vector<char> recvBuf;
+		exchange_bytes(sendBuf, sendAmounts, sendOffsets, recvBuf, nprocs);
+		{
+			PROFILE_SCOPE(PROF_DECODE);
+			decode_ngram_counts(recvBuf.data(), recvBuf.size(), owned);
+		}
+
+		// The owned n-grams are disjoint, so the local candidates of the processes hold the top
+		// n-grams, ties included
+		long long eachUnique = owned.size();
+		MPI_Reduce(&eachUnique, &uniqueGrams, 1, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+		top_ngram_candidates(owned, top, candidates);
+	}
+
+	// Gather the whole counters [gather] or the candidates [shuffle] on ROOT
+	std::string eachBuffer;
+	if (shuffle)
+		encode_ngram_counts(candidates, eachBuffer);
+	else
+		encode_ngram_counts(grams, eachBuffer);
+	std::vector<char> gatheredBuf;
+	std::vector<int> bufOffsets;
+	gather_bytes(eachBuffer, gatheredBuf, bufOffsets, rank, nprocs);
+	if (rank != ROOT)
+		return;
+
+	PROFILE_SCOPE(PROF_DECODE);
+	KeyCounter<Key> all;
+	decode_ngram_counts(gatheredBuf.data(), gatheredBuf.size(), all);
+	if (!shuffle)
+		uniqueGrams = all.size();
+	top_ngram_candidates(all, top, topGrams);
+}
+
+template <typename Key>
+void decode_ngrams(const std::vector< NgramCount<Key> >& grams, const WordDictionary& dictionary, int n,
+	long long top, std::vector<NgramRow>& rows) {
+	/* Decode n-grams into words, and keep the `top` most common, ordered by count and then
+	alphabetically. */
+
+	std::uint32_t ids[NGRAM_MAX];
+	for (const NgramCount<Key>& item: grams) {
+		unpack_ngram(item.key, n, ids);
+		std::string ngram(dictionary.word(ids[0]));
+		for (int i = 1; i < n; i++)
+			(ngram += ' ') += dictionary.word(ids[i]);
+		rows.push_back({ ngram, item.count });
+	}
+	std::sort(rows.begin(), rows.end(), [](const NgramRow& x, const NgramRow& y) {
+		return x.count != y.count ? x.count > y.count : x.ngram < y.ngram;
+	});
+	if ((long long) rows.size() > top)
+		rows.resize(top);
+}
+
+void reduce_ngrams(const NgramCounter& eachCounter, bool shuffle, bool frontCoded, long long top,
+	std::vector<NgramRow>& rows, long long& uniqueGrams, long long& uniqueWords, int rank, int nprocs) {
+	/* Reduce the n-gram counters of every process and decode the `top` most common n-grams into
+	`rows` on ROOT, with the number of distinct n-grams and words. Collective over MPI_COMM_WORLD. */
+
+	WordDictionary globalDictionary; // [ROOT use only]
+	std::vector<std::uint32_t> remap;
+	merge_dictionaries(eachCounter.dictionary, globalDictionary, remap, rank, nprocs, frontCoded);
+	uniqueWords = globalDictionary.size();
+
+	if (eachCounter.n <= 2) {
+		std::vector< NgramCount<std::uint64_t> > topGrams;
+		reduce_ngram_counts(eachCounter.narrow, remap, eachCounter.n, shuffle, top, topGrams, uniqueGrams, rank, nprocs);
+		decode_ngrams(topGrams, globalDictionary, eachCounter.n, top, rows);
+	} else {
+		std::vector< NgramCount<NgramKey128> > topGrams;
+		reduce_ngram_counts(eachCounter.wide, remap, eachCounter.n, shuffle, top, topGrams, uniqueGrams, rank, nprocs);
+		decode_ngrams(topGrams, globalDictionary, eachCounter.n, top, rows);
+	}
+}
+
+void print_ngram_report(const std::vector<NgramRow>& rows, int n) {
+	/* Print the most common n-grams with their counts. */
+
+	std::string heading = std::to_string(n) + "-gram";
+	std::cout << "---------------------------------------------------------" << std::endl;
+	std::cout << "| " << std::left << std::setw(41) << heading << " | " << std::right << std::setw(9) << "Frequency"
+		<< " |" << std::endl;
+	for (const NgramRow& row: rows)
+		std::cout << "| " << std::left << std::setw(41) << row.ngram << " | " << std::right << std::setw(9)
+			<< row.count << " |" << std::endl;
+	std::cout << "---------------------------------------------------------" << std::endl;
+	std::cout << std::endl;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+Group name: Kismet
+
+Node-aware reduction of --reduce hierarchical: the counters of the processes of a node are merged
+through shared memory first, so only one counter per node crosses the network to ROOT.
+
+The processes of a node are found with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) (and can be cut
+into smaller groups with --node-size, to try other layouts on one machine). Within a node:
+	1. every process splits its counter into one partition per process of the node (by word hash,
+	   like the shuffle reduction) and writes the partitions into its segment of a shared window
+	2. every process merges its partition of every segment, reading them in place, so the node's
+	   words are merged by all of its processes at once, and writes the result into a second window
+	3. the merged partitions lie back to back in the second window, so the first process of the node
+	   (its leader) sends them to ROOT as they are, in a gather over the leaders only
+*/
+
+#ifndef NODE_REDUCE_H
+#define NODE_REDUCE_H
+
+#include <cstring> 			// std::memcpy
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+#include "Reduce.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+struct NodeGroup {
+	/* Communicators of the two levels of the reduction. ROOT is the leader of its node, and rank 0
+	of the leaders. */
+
+	MPI_Comm node = MPI_COMM_NULL; 		// processes of this node (or group of --node-size)
+	MPI_Comm leaders = MPI_COMM_NULL; 	// first process of every node [leaders only]
+	int nodeRank = 0;
+	int nodeSize = 1;
+};
+
+NodeGroup make_node_group(int rank, int maxNodeSize) {
+	/* Group the processes by node, in groups of at most `maxNodeSize` processes if it is not 0.
+	Collective over MPI_COMM_WORLD. */
+
+	NodeGroup group;
+	MPI_Comm shared;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &shared);
+	if (maxNodeSize > 0) {
+		int sharedRank;
+		MPI_Comm_rank(shared, &sharedRank);
+		MPI_Comm_split(shared, sharedRank / maxNodeSize, sharedRank, &group.node);
+		MPI_Comm_free(&shared);
+	} else {
+		group.node = shared;
+	}
+	MPI_Comm_rank(group.node, &group.nodeRank);
+	MPI_Comm_size(group.node, &group.nodeSize);
+	MPI_Comm_split(MPI_COMM_WORLD, group.nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &group.leaders);
+	return group;
+}
+
+void free_node_group(NodeGroup& group) {
+	MPI_Comm_free(&group.node);
+	if (group.leaders != MPI_COMM_NULL)
+		MPI_Comm_free(&group.leaders);
+}
+
+char* share_bytes(const std::string& buffer, MPI_Comm node, MPI_Win& window) {
+	/* Copy a buffer into this process's segment of a new shared window of the node, and return the
+	segment. The window is left locked for shared access by every process; other segments can be
+	read once `wait_shared()` returns. Collective over `node`. */
+
+	char* segment;
+	MPI_Win_allocate_shared(buffer.size(), 1, MPI_INFO_NULL, node, &segment, &window);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+	std::memcpy(segment, buffer.data(), buffer.size());
+	return segment;
+}
+
+void wait_shared(MPI_Win window, MPI_Comm node) {
+	/* Wait until every process of the node has written its segment of a shared window. */
+
+	PROFILE_SCOPE(PROF_COMM);
+	MPI_Win_sync(window);
+	MPI_Barrier(node);
+	MPI_Win_sync(window);
+}
+
+void free_shared(MPI_Win& window) {
+	/* Release a shared window, once every process of the node is done reading it. Collective. */
+
+	MPI_Win_unlock_all(window);
+	MPI_Win_free(&window);
+}
+
+const char* shared_segment(MPI_Win window, int nodeRank, long long& size) {
+	/* Return the segment of a process of the node in a shared window, and its size. */
+
+	MPI_Aint segmentSize;
+	int dispUnit;
+	char* segment;
+	MPI_Win_shared_query(window, nodeRank, &segmentSize, &dispUnit, &segment);
+	size = segmentSize;
+	return segment;
+}
+
+void node_gather_counter(const Counter& eachWordCounter, Counter& mergedCounter, const NodeGroup& group,
+	int rank, bool frontCoded = false) {
+	/* Merge the counters of the processes of every node through shared memory, then gather the
+	merged counter of every node on ROOT and merge them into `mergedCounter` [ROOT use only].
+	Collective over MPI_COMM_WORLD. */
+
+	int nodeSize = group.nodeSize;
+
+	// Split the counter into one partition per process of the node, back to back
+	std::string partsBuf;
+	std::vector<int> partSizes(nodeSize), allPartSizes(nodeSize * nodeSize);
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		std::vector< std::vector<const CounterEntry*> > parts(nodeSize);
+		for (auto& entry: eachWordCounter)
+			parts[get_owner(hash_word(entry.first), nodeSize)].push_back(&entry);
+		for (int r = 0; r < nodeSize; r++) {
+			std::size_t begin = partsBuf.size();
+			encode_entries(partsBuf, parts[r].begin(), parts[r].end(), frontCoded);
+			partSizes[r] = partsBuf.size() - begin;
+		}
+	}
+	MPI_Win partsWindow;
+	share_bytes(partsBuf, group.node, partsWindow);
+	MPI_Allgather(partSizes.data(), nodeSize, MPI_INT, allPartSizes.data(), nodeSize, MPI_INT, group.node);
+	wait_shared(partsWindow, group.node);
+
+	// Merge this process's partition of every counter of the node, straight out of shared memory
+	Counter partCounter;
+	{
+		PROFILE_SCOPE(PROF_DECODE);
+		for (int r = 0; r < nodeSize; r++) {
+			long long segmentSize;
+			const char* segment = shared_segment(partsWindow, r, segmentSize);
+			long long offset = 0;
+			for (int p = 0; p < group.nodeRank; p++)
+				offset += allPartSizes[r * nodeSize + p];
+			if (!compose_counters(partCounter, segment + offset, allPartSizes[r * nodeSize + group.nodeRank])) {
+				std::cout << "Error! Shared counter data is corrupt. Aborting program." << std::endl;
+				exit(1);
+			}
+		}
+	}
+	free_shared(partsWindow);
+
+	// The merged partitions of the node lie back to back in a second window
+	std::string mergedBuf;
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		decompose_counter(partCounter, mergedBuf, frontCoded);
+	}
+	partCounter = Counter();
+	MPI_Win mergedWindow;
+	share_bytes(mergedBuf, group.node, mergedWindow);
+	wait_shared(mergedWindow, group.node);
+
+	// The leader of every node sends the whole window to ROOT
+	if (group.leaders != MPI_COMM_NULL) {
+		long long nodeBytes = 0, segmentSize;
+		const char* nodeBuf = shared_segment(mergedWindow, 0, segmentSize);
+		for (int r = 0; r < nodeSize; r++) {
+			shared_segment(mergedWindow, r, segmentSize);
+			nodeBytes += segmentSize;
+		}
+
+		int nleaders, sendAmount = nodeBytes;
+		MPI_Comm_size(group.leaders, &nleaders);
+		std::vector<int> recvAmounts(nleaders), bufOffsets(nleaders + 1, 0);
+		std::vector<char> gatheredBuf;
+		{
+			PROFILE_SCOPE(PROF_COMM);
+			MPI_Gather(&sendAmount, 1, MPI_INT, recvAmounts.data(), 1, MPI_INT, ROOT, group.leaders);
+			if (rank == ROOT) {
+				for (int r = 0; r < nleaders; r++)
+					bufOffsets[r + 1] = bufOffsets[r] + recvAmounts[r];
+				gatheredBuf.resize(bufOffsets[nleaders]);
+			}
+			MPI_Gatherv(nodeBuf, sendAmount, MPI_CHAR, gatheredBuf.data(), recvAmounts.data(), bufOffsets.data(),
+				MPI_CHAR, ROOT, group.leaders);
+			PROFILE_ADD(PROF_BYTES_SENT, sendAmount);
+			PROFILE_ADD(PROF_BYTES_RECEIVED, gatheredBuf.size());
+		}
+
+		PROFILE_SCOPE(PROF_DECODE);
+		if (rank == ROOT && !compose_counters(mergedCounter, gatheredBuf.data(), gatheredBuf.size())) {
+			std::cout << "Error! Gathered counter data is corrupt. Aborting program." << std::endl;
+			exit(1);
+		}
+	}
+	free_shared(mergedWindow);
+}
+
+#endif
@@ -0,0 +1,428 @@
+/*
+Group name: Kismet
+
+Command line options of the word counter. Every process parses its own copy of `argv` (and of the
+config file, if any), so the options do not need to be broadcast.
+
+A config file holds one option per line, written as on the command line without the leading
+dashes, e.g.:
+	# three files, words of 3 to 12 letters
+	file test-data/fruits1.txt
+	file test-data/fruits2.txt
+	file ascii-only/shelly.txt
+	min-length 3
+	max-length 12
+	threads 4
+*/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <algorithm> 		// std::max
+#include <cmath> 			// std::abs, std::round
+#include <cstdlib> 			// std::atoi, std::atoll, std::atof
+#include <fstream> 			// std::ifstream
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include "Sketch.h"
+#include "Ngram.h"
+#include "Pipeline.h"
+#include "NodeReduce.h"
+#include "Output.h"
+#include "Stream.h"
+
+enum InputMode { INPUT_MMAP, INPUT_FSTREAM, INPUT_STREAM, INPUT_MPIIO };
+enum ReduceMode { REDUCE_GATHER, REDUCE_SHUFFLE, REDUCE_PIPELINE, REDUCE_HIERARCHICAL };
+enum ScheduleMode { SCHEDULE_STATIC, SCHEDULE_DYNAMIC };
+
+#define DEFAULT_MIN_WORD_LEN 1 	// word length bounds when files are given but no bounds are
+#define DEFAULT_MAX_WORD_LEN 20
+
+struct Options {
+	std::vector<std::string> files; // text files to process, prompted for if empty
+	int minWordLen = 0; 			// minimum word length, 0 for the default (or prompt)
+	int maxWordLen = 0; 			// maximum word length, 0 for the default (or prompt)
+	InputMode input = INPUT_MMAP; 	// how each process reads its byte range of a file
+	bool reportThroughput = false; 	// print the input throughput of every process
+	long long blockSize = 1 << 20; 	// bytes per block of the streaming reader
+	int readBuffers = 2; 			// blocks in the ring of the streaming reader
+	int threads = 0; 				// threads per process, 0 for OMP_NUM_THREADS (or 1)
+	ReduceMode reduce = REDUCE_GATHER; 	// how the counters of the processes are merged
+	bool frontCoded = false; 		// send counters front-coded (sorted, prefix-compressed)
+	int pipelineDepth = DEFAULT_PIPELINE_DEPTH; 	// counters a process keeps in flight with --reduce pipeline
+	int nodeSize = 0; 				// processes per node group of --reduce hierarchical, 0 for whole nodes
+	ScheduleMode schedule = SCHEDULE_STATIC; 	// how the work is divided between the processes
+	long long chunkSize = 4 << 20; 	// bytes per chunk of the dynamic schedule
+	long long top = 0; 				// report only the N most common words, 0 for every word
+	bool alphabetical = false; 		// order the report by word instead of by count
+	std::string outputPath; 		// file to write the words to, sorted across the processes
+	OutputFormat outputFormat = OUTPUT_TABLE; 	// format of the output file
+	std::string indexPath; 			// file to write the word count index to, for IndexQuery
+	long long memoryBudget = 0; 	// bytes of counters a process keeps in memory before spilling, 0 for no limit
+	std::string spillDir; 			// directory of the spilled runs, empty for TMPDIR (or /tmp)
+	std::string cacheDir; 			// directory of the per-file counter cache, empty for no cache
+	bool cacheVerify = false; 		// check the content hash of cached files even if unchanged
+	bool approx = false; 			// count with fixed-size sketches instead of exact counters
+	SketchParams sketch; 			// error bounds of the sketches of --approx
+	int ngram = 0; 					// count the runs of N words of a line instead of words, 0 for words
+	std::string streamPath; 		// stream of lines to count over a sliding window ("-" for stdin), empty for files
+	StreamParams stream; 			// window, batching and dispatch of --stream
+	bool profile = false; 			// print the per-phase profile (needs -DWC_PROFILE)
+	std::string profileJson; 		// file to write the per-rank, per-file profile to, as JSON
+	std::string profileTrace; 		// file to write the timed phases to, as a Chrome trace
+};
+
+const char* reduce_mode_name(ReduceMode reduce) {
+	switch (reduce) {
+		case REDUCE_SHUFFLE: return "shuffle";
+		case REDUCE_PIPELINE: return "pipeline";
+		case REDUCE_HIERARCHICAL: return "hierarchical";
+		default: return "gather";
+	}
+}
+
+const char* input_mode_name(InputMode input) {
+	switch (input) {
+		case INPUT_FSTREAM: return "fstream";
+		case INPUT_STREAM: return "stream";
+		case INPUT_MPIIO: return "mpiio";
+		default: return "mmap";
+	}
+}
+
+void print_usage(const char* program) {
+	std::cout << "Usage: " << program << " [options] [file ...]" << std::endl
+		<< "  Without any file, the files and word lengths are prompted for. gzip and zstd files are" << std::endl
+		<< "  decompressed as they are read (compile with -DWC_GZIP -lz, -DWC_ZSTD -lzstd)." << std::endl
+		<< "  --file PATH            text file to process (same as a file argument), repeatable" << std::endl
+		<< "  --min-length N         minimum word length (default " << DEFAULT_MIN_WORD_LEN << " with files given)" << std::endl
+		<< "  --max-length N         maximum word length (default " << DEFAULT_MAX_WORD_LEN << " with files given)" << std::endl
+		<< "  --config PATH          read options from a file, one \"option value\" per line" << std::endl
+		<< "  --input mmap|fstream|stream|mpiio  read input through memory mapping (default)," << std::endl
+		<< "                         fstream, fixed-size blocks read ahead by a reader thread" << std::endl
+		<< "                         (bounded memory), or collective MPI-IO (static schedule only," << std::endl
+		<< "                         mmap otherwise)" << std::endl
+		<< "  --block-size KB        block size of --input stream (default 1024)" << std::endl
+		<< "  --read-buffers N       blocks read ahead by --input stream, at least 2 (default 2)" << std::endl
+		<< "  --throughput           report input throughput (MB/s) of each process" << std::endl
+		<< "  --threads N            worker threads per process (default: OMP_NUM_THREADS or 1)" << std::endl
+		<< "  --reduce gather|shuffle|pipeline|hierarchical  merge counters on the root process" << std::endl
+		<< "                         (default), on the owner process of each word via an all-to-all" << std::endl
+		<< "                         exchange, on the root process as they arrive, sent without" << std::endl
+		<< "                         waiting, or within each node through shared memory first, then" << std::endl
+		<< "                         on the root process, one counter per node (pipeline and" << std::endl
+		<< "                         hierarchical: not with --top/--approx/--ngram/--memory-budget)" << std::endl
+		<< "  --pipeline-depth N     counters a process keeps in flight with --reduce pipeline" << std::endl
+		<< "                         (default " << DEFAULT_PIPELINE_DEPTH << ")" << std::endl
+		<< "  --node-size N          group at most N processes of a node with --reduce hierarchical" << std::endl
+		<< "                         (default: every process of the node)" << std::endl
+		<< "  --front-coding         send counters sorted and prefix-compressed" << std::endl
+		<< "  --schedule static|dynamic  split each file equally between the processes, one file" << std::endl
+		<< "                         at a time (default), or let processes pull chunks of all files" << std::endl
+		<< "  --chunk-size MB        chunk size of the dynamic schedule (default 4)" << std::endl
+		<< "  --top N                report only the N most common words, without collecting" << std::endl
+		<< "                         every word on the root process" << std::endl
+		<< "  --sort frequency|alphabetical  order of the words in the report (default frequency)" << std::endl
+		<< "  --output PATH          write the words to PATH instead of the terminal, sorted across" << std::endl
+		<< "                         the processes and written in parallel (not with --approx/--ngram)" << std::endl
+		<< "  --format table|csv|binary  format of --output: the report table (default), CSV, or the" << std::endl
+		<< "                         binary counter format of Counter.h" << std::endl
+		<< "  --index PATH           also write the words to a memory-mapped index for IndexQuery" << std::endl
+		<< "                         (not with --top/--approx/--ngram/--memory-budget/--stream)" << std::endl
+		<< "  --cache DIR            keep the counter of every file in DIR and only count new or" << std::endl
+		<< "                         changed files (or appended bytes) again (static schedule); the" << std::endl
+		<< "                         counter of every counted file is collected on the root process to" << std::endl
+		<< "                         be cached, even with --reduce shuffle or --top" << std::endl
+		<< "  --cache-verify         check the content of cached files even if their size and" << std::endl
+		<< "                         modification time are unchanged" << std::endl
+		<< "  --approx               count approximately in fixed memory: Count-Min estimates," << std::endl
+		<< "                         SpaceSaving heavy hitters and a HyperLogLog unique count" << std::endl
+		<< "  --epsilon E            Count-Min error, as a fraction of all words (default " << DEFAULT_SKETCH_EPSILON << ")" << std::endl
+		<< "  --delta D              probability of exceeding the Count-Min error (default " << DEFAULT_SKETCH_DELTA << ")" << std::endl
+		<< "  --heavy-hitters N      words kept by the SpaceSaving summary (default " << DEFAULT_HEAVY_HITTERS << ")" << std::endl
+		<< "  --hll-precision P      2^P HyperLogLog registers, 4 to 18 (default " << DEFAULT_HLL_PRECISION << ")" << std::endl
+		<< "  --ngram N              count the runs of N consecutive words of a line (1 to " << NGRAM_MAX << ")," << std::endl
+		<< "                         reporting the --top N most common (default " << DEFAULT_NGRAM_TOP << ")" << std::endl
+		<< "  --stream PATH          count a stream of lines from a pipe or FIFO (- for stdin) until" << std::endl
+		<< "                         it ends, printing the --top N words (default " << DEFAULT_STREAM_TOP << ") of a sliding" << std::endl
+		<< "                         window of time after every slide" << std::endl
+		<< "  --window S             seconds of the stream in a window (default 60)" << std::endl
+		<< "  --slide S              seconds between windows, dividing --window (default: --window," << std::endl
+		<< "                         tumbling windows)" << std::endl
+		<< "  --batch-size KB        bytes of whole lines sent to a process at a time (default 256)" << std::endl
+		<< "  --stream-queue N       batches read ahead of the processes (default " << DEFAULT_STREAM_QUEUE << "); the" << std::endl
+		<< "                         stream is held back when they fall behind" << std::endl
+		<< "  --dispatch load|round-robin  send batches to the least busy process (default) or in turn" << std::endl
+		<< "  --target-rate MB/S     warn when the stream is held back below this ingest rate" << std::endl
+		<< "  --memory-budget MB     spill the counters of a process to sorted runs on disk beyond MB," << std::endl
+		<< "                         and merge the runs of every process at the end, so no process" << std::endl
+		<< "                         holds every word; the full report is then in alphabetical order" << std::endl
+		<< "                         (not with --approx/--ngram/--cache)" << std::endl
+		<< "  --spill-dir DIR        directory of the spilled runs (default: TMPDIR or /tmp)" << std::endl
+		<< "  --profile              print per-phase times and counters of the processes" << std::endl
+		<< "                         (compile with -DWC_PROFILE)" << std::endl
+		<< "  --profile-json PATH    also write the profile of every process and file as JSON" << std::endl
+		<< "  --profile-trace PATH   also write the timed phases as a Chrome trace" << std::endl;
+}
+
+bool parse_arguments(const std::vector<std::string>& args, Options& options);
+
+bool read_config(const std::string& filename, Options& options) {
+	/* Parse the options of a config file into `options`. Return false if the file cannot be read
+	or holds an invalid option. */
+
+	std::ifstream config(filename);
+	if (!config.is_open()) {
+		std::cout << "Error: could not open config file '" << filename << "'" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> args;
+	std::string line;
+	while (std::getline(config, line)) {
+		std::size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#')
+			continue; // blank line or comment
+		std::size_t keyEnd = line.find_first_of(" \t\r", begin);
+		args.push_back("--" + line.substr(begin, keyEnd - begin));
+		if (keyEnd == std::string::npos)
+			continue; // option without a value
+		std::size_t valueBegin = line.find_first_not_of(" \t", keyEnd);
+		std::size_t valueEnd = line.find_last_not_of(" \t\r");
+		if (valueBegin != std::string::npos && valueBegin <= valueEnd)
+			args.push_back(line.substr(valueBegin, valueEnd - valueBegin + 1)); // may contain spaces
+	}
+	return parse_arguments(args, options);
+}
+
+bool parse_arguments(const std::vector<std::string>& args, Options& options) {
+	/* Parse a list of arguments into `options`. Return false if any argument is invalid. */
+
+	int argc = args.size();
+	for (int i = 0; i < argc; i++) {
+		const std::string& arg = args[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--input" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "mmap")
+				options.input = INPUT_MMAP;
+			else if (value == "fstream")
+				options.input = INPUT_FSTREAM;
+			else if (value == "stream")
+				options.input = INPUT_STREAM;
+			else if (value == "mpiio")
+				options.input = INPUT_MPIIO;
+			else
+				return false;
+		} else if (arg == "--block-size" && hasValue) {
+			double kilobytes = std::atof(args[++i].c_str());
+			if (kilobytes <= 0)
+				return false;
+			options.blockSize = std::max(1LL, (long long) (kilobytes * 1024));
+		} else if (arg == "--read-buffers" && hasValue) {
+			options.readBuffers = std::atoi(args[++i].c_str());
+			if (options.readBuffers < 2)
+				return false;
+		} else if (arg == "--throughput") {
+			options.reportThroughput = true;
+		} else if (arg == "--reduce" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "gather")
+				options.reduce = REDUCE_GATHER;
+			else if (value == "shuffle")
+				options.reduce = REDUCE_SHUFFLE;
+			else if (value == "pipeline")
+				options.reduce = REDUCE_PIPELINE;
+			else if (value == "hierarchical")
+				options.reduce = REDUCE_HIERARCHICAL;
+			else
+				return false;
+		} else if (arg == "--pipeline-depth" && hasValue) {
+			options.pipelineDepth = std::atoi(args[++i].c_str());
+			if (options.pipelineDepth < 1)
+				return false;
+		} else if (arg == "--node-size" && hasValue) {
+			options.nodeSize = std::atoi(args[++i].c_str());
+			if (options.nodeSize < 1)
+				return false;
+		} else if (arg == "--front-coding") {
+			options.frontCoded = true;
+		} else if (arg == "--schedule" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "static")
+				options.schedule = SCHEDULE_STATIC;
+			else if (value == "dynamic")
+				options.schedule = SCHEDULE_DYNAMIC;
+			else
+				return false;
+		} else if (arg == "--chunk-size" && hasValue) {
+			double megabytes = std::atof(args[++i].c_str());
+			if (megabytes <= 0)
+				return false;
+			options.chunkSize = std::max(1LL, (long long) (megabytes * (1 << 20)));
+		} else if (arg == "--top" && hasValue) {
+			options.top = std::atoll(args[++i].c_str());
+			if (options.top < 1)
+				return false;
+		} else if (arg == "--sort" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "frequency")
+				options.alphabetical = false;
+			else if (value == "alphabetical")
+				options.alphabetical = true;
+			else
+				return false;
+		} else if (arg == "--output" && hasValue) {
+			options.outputPath = args[++i];
+		} else if (arg == "--index" && hasValue) {
+			options.indexPath = args[++i];
+		} else if (arg == "--format" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "table")
+				options.outputFormat = OUTPUT_TABLE;
+			else if (value == "csv")
+				options.outputFormat = OUTPUT_CSV;
+			else if (value == "binary")
+				options.outputFormat = OUTPUT_BINARY;
+			else
+				return false;
+		} else if (arg == "--cache" && hasValue) {
+			options.cacheDir = args[++i];
+		} else if (arg == "--cache-verify") {
+			options.cacheVerify = true;
+		} else if (arg == "--approx") {
+			options.approx = true;
+		} else if (arg == "--epsilon" && hasValue) {
+			options.approx = true;
+			options.sketch.epsilon = std::atof(args[++i].c_str());
+			if (options.sketch.epsilon <= 0 || options.sketch.epsilon >= 1)
+				return false;
+		} else if (arg == "--delta" && hasValue) {
+			options.approx = true;
+			options.sketch.delta = std::atof(args[++i].c_str());
+			if (options.sketch.delta <= 0 || options.sketch.delta >= 1)
+				return false;
+		} else if (arg == "--heavy-hitters" && hasValue) {
+			options.approx = true;
+			options.sketch.heavyHitters = std::atoi(args[++i].c_str());
+			if (options.sketch.heavyHitters < 1)
+				return false;
+		} else if (arg == "--hll-precision" && hasValue) {
+			options.approx = true;
+			options.sketch.hllPrecision = std::atoi(args[++i].c_str());
+			if (options.sketch.hllPrecision < 4 || options.sketch.hllPrecision > 18)
+				return false;
+		} else if (arg == "--ngram" && hasValue) {
+			options.ngram = std::atoi(args[++i].c_str());
+			if (options.ngram < 1 || options.ngram > NGRAM_MAX)
+				return false;
+		} else if (arg == "--memory-budget" && hasValue) {
+			double megabytes = std::atof(args[++i].c_str());
+			if (megabytes <= 0)
+				return false;
+			options.memoryBudget = std::max(1LL, (long long) (megabytes * (1 << 20)));
+		} else if (arg == "--spill-dir" && hasValue) {
+			options.spillDir = args[++i];
+		} else if (arg == "--stream" && hasValue) {
+			options.streamPath = args[++i];
+		} else if (arg == "--window" && hasValue) {
+			options.stream.window = std::atof(args[++i].c_str());
+			if (options.stream.window <= 0)
+				return false;
+		} else if (arg == "--slide" && hasValue) {
+			options.stream.slide = std::atof(args[++i].c_str());
+			if (options.stream.slide <= 0)
+				return false;
+		} else if (arg == "--batch-size" && hasValue) {
+			double kilobytes = std::atof(args[++i].c_str());
+			if (kilobytes <= 0)
+				return false;
+			options.stream.batchSize = std::max(1LL, (long long) (kilobytes * 1024));
+		} else if (arg == "--stream-queue" && hasValue) {
+			options.stream.queue = std::atoi(args[++i].c_str());
+			if (options.stream.queue < 1)
+				return false;
+		} else if (arg == "--dispatch" && hasValue) {
+			const std::string& value = args[++i];
+			if (value == "load")
+				options.stream.dispatch = DISPATCH_LOAD;
+			else if (value == "round-robin")
+				options.stream.dispatch = DISPATCH_ROUND_ROBIN;
+			else
+				return false;
+		} else if (arg == "--target-rate" && hasValue) {
+			options.stream.targetRate = std::atof(args[++i].c_str());
+			if (options.stream.targetRate <= 0)
+				return false;
+		} else if (arg == "--profile") {
+			options.profile = true;
+		} else if (arg == "--profile-json" && hasValue) {
+			options.profile = true;
+			options.profileJson = args[++i];
+		} else if (arg == "--profile-trace" && hasValue) {
+			options.profile = true;
+			options.profileTrace = args[++i];
+		} else if (arg == "--threads" && hasValue) {
+			options.threads = std::atoi(args[++i].c_str());
+			if (options.threads < 1)
+				return false;
+		} else if (arg == "--file" && hasValue) {
+			options.files.push_back(args[++i]);
+		} else if (arg == "--min-length" && hasValue) {
+			options.minWordLen = std::atoi(args[++i].c_str());
+			if (options.minWordLen < 1)
+				return false;
+		} else if (arg == "--max-length" && hasValue) {
+			options.maxWordLen = std::atoi(args[++i].c_str());
+			if (options.maxWordLen < 1)
+				return false;
+		} else if (arg == "--config" && hasValue) {
+			if (!read_config(args[++i], options))
+				return false;
+		} else if (arg.size() > 0 && arg[0] != '-') {
+			options.files.push_back(arg);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+	/* Parse the command line into `options`, filling in the default word length bounds when the
+	files are given. Return false if the command line is invalid. */
+
+	if (!parse_arguments(std::vector<std::string>(argv + 1, argv + argc), options))
+		return false;
+	if (!options.files.empty() || !options.streamPath.empty()) {
+		if (options.minWordLen == 0)
+			options.minWordLen = DEFAULT_MIN_WORD_LEN;
+		if (options.maxWordLen == 0)
+			options.maxWordLen = std::max(DEFAULT_MAX_WORD_LEN, options.minWordLen);
+	}
+	if (options.approx && options.ngram > 0)
+		return false; // n-grams are only counted exactly
+	if (!options.outputPath.empty() && (options.approx || options.ngram > 0))
+		return false; // only word counts are written out
+	if ((options.reduce == REDUCE_PIPELINE || options.reduce == REDUCE_HIERARCHICAL)
+		&& (options.top > 0 || options.approx || options.ngram > 0 || options.memoryBudget > 0))
+		return false; // only whole counters are pipelined to ROOT, or merged within the nodes
+	if (options.memoryBudget > 0 && (options.approx || options.ngram > 0 || !options.cacheDir.empty()))
+		return false; // sketches, n-gram tables and the whole-file counters of the cache are not spilled
+	if (!options.indexPath.empty() && (options.top > 0 || options.approx || options.ngram > 0 || options.memoryBudget > 0
+		|| !options.streamPath.empty()))
+		return false; // the index holds every word, collected on ROOT
+	if (!options.streamPath.empty()) {
+		if (options.approx || options.ngram > 0 || !options.outputPath.empty() || !options.files.empty())
+			return false; // a stream is counted exactly, word by word, and on its own
+		double slide = options.stream.slide > 0 ? options.stream.slide : options.stream.window;
+		double buckets = options.stream.window / slide;
+		if (buckets < 1 || std::abs(buckets - std::round(buckets)) > 1e-6)
+			return false; // the window is a whole number of slides
+	}
+	return options.maxWordLen == 0 || options.maxWordLen >= options.minWordLen;
+}
+
+#endif
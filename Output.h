@@ -0,0 +1,243 @@
+/*
+Group name: Kismet
+
+Distributed output of the full word count table (--output): instead of ROOT sorting and printing
+every word, the words are sorted across the processes with a sample sort, each process formats its
+slice of the sorted words, and the slices are written to the output file in parallel.
+
+Sample sort, for either order of the report (most common or alphabetical):
+	1. every process sorts its words, and picks regularly spaced samples of them, in proportion to
+	   its share of all the words
+	2. ROOT sorts the samples and picks nprocs - 1 splitters, which it broadcasts
+	3. every process sends the words between splitters r - 1 and r to process r (all-to-all), and
+	   sorts what it receives, so process r holds the r-th slice of the sorted words
+Each slice is then formatted (table, CSV, or the binary wire format of Counter.h), and written at
+the offset given by the sizes of the slices before it (MPI_Exscan).
+*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <algorithm> 		// std::sort, std::upper_bound, std::min
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+#include "Reduce.h"
+#include "TopK.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define SAMPLE_SORT_OVERSAMPLING 64 	// samples per process, so the slices come out even
+#define OUTPUT_WRITE_PIECE (1 << 30) 	// bytes per MPI-IO write call, well within an int count
+
+enum OutputFormat { OUTPUT_TABLE, OUTPUT_CSV, OUTPUT_BINARY };
+
+typedef bool (*EntryOrder)(const CounterEntry&, const CounterEntry&);
+
+void sample_sort(const Counter& eachCounter, EntryOrder order, bool frontCoded, Counter& slice,
+	std::vector<CounterEntry>& sorted, int rank, int nprocs) {
+	/* Sort the words of the counters of every process, which must not share words, across the
+	processes: `sorted` ends up holding this process's slice of all the words in `order`, viewing
+	the words of `slice`. Collective over MPI_COMM_WORLD. */
+
+	auto order_ptrs = [order](const CounterEntry* x, const CounterEntry* y) { return order(*x, *y); };
+
+	// Sort the local words
+	std::vector<const CounterEntry*> local;
+	{
+		PROFILE_SCOPE(PROF_SORT);
+		local.reserve(eachCounter.size());
+		for (auto& entry: eachCounter)
+			local.push_back(&entry);
+		std::sort(local.begin(), local.end(), order_ptrs);
+	}
+
+	// Samples in proportion to the local share of the words, gathered on ROOT, which picks the
+	// splitters out of them and broadcasts them
+	long long eachSize = local.size(), totalSize = 0;
+	MPI_Allreduce(&eachSize, &totalSize, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	long long stride = std::max(1LL, totalSize / ((long long) SAMPLE_SORT_OVERSAMPLING * nprocs));
+	std::vector<const CounterEntry*> samples;
+	for (long long i = stride / 2; i < eachSize; i += stride)
+		samples.push_back(local[i]);
+	std::string sampleBuffer;
+	encode_entries(sampleBuffer, samples.begin(), samples.end(), false);
+	std::vector<char> gatheredSamples;
+	std::vector<int> sampleOffsets;
+	gather_bytes(sampleBuffer, gatheredSamples, sampleOffsets, rank, nprocs);
+
+	std::string splitterBuffer;
+	if (rank == ROOT) {
+		Counter allSamples;
+		if (!compose_counters(allSamples, gatheredSamples.data(), gatheredSamples.size())) {
+			std::cout << "Error! Gathered sample data is corrupt. Aborting program." << std::endl;
+			exit(1);
+		}
+		std::vector<const CounterEntry*> sortedSamples;
+		for (auto& entry: allSamples)
+			sortedSamples.push_back(&entry);
+		std::sort(sortedSamples.begin(), sortedSamples.end(), order_ptrs);
+		std::vector<const CounterEntry*> splitters;
+		for (int r = 1; r < nprocs && !sortedSamples.empty(); r++)
+			splitters.push_back(sortedSamples[sortedSamples.size() * r / nprocs]);
+		encode_entries(splitterBuffer, splitters.begin(), splitters.end(), false);
+	}
+	broadcast_bytes(splitterBuffer, rank);
+	Counter splitterCounter;
+	compose_counter(splitterCounter, splitterBuffer.data(), splitterBuffer.size());
+	std::vector<CounterEntry> splitters(splitterCounter.begin(), splitterCounter.end()); // in order
+
+	// Send every process its slice of the local words: those after splitter r - 1, up to and
+	// including splitter r
+	std::string sendBuf;
+	std::vector<int> sendAmounts(nprocs), sendOffsets(nprocs);
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		auto begin = local.begin();
+		for (int r = 0; r < nprocs; r++) {
+			auto end = r < (int) splitters.size() ? std::upper_bound(begin, local.end(), &splitters[r], order_ptrs)
+				: local.end();
+			sendOffsets[r] = sendBuf.size();
+			encode_entries(sendBuf, begin, end, frontCoded);
+			sendAmounts[r] = sendBuf.size() - sendOffsets[r];
+			begin = end;
+		}
+	}
+	std::vector<char> recvBuf;
+	exchange_bytes(sendBuf, sendAmounts, sendOffsets, recvBuf, nprocs);
+	{
+		PROFILE_SCOPE(PROF_DECODE);
+		if (!compose_counters(slice, recvBuf.data(), recvBuf.size())) {
+			std::cout << "Error! Exchanged counter data is corrupt. Aborting program." << std::endl;
+			exit(1);
+		}
+	}
+
+	PROFILE_SCOPE(PROF_SORT);
+	sorted.assign(slice.begin(), slice.end());
+	std::sort(sorted.begin(), sorted.end(), order);
+}
+
+void append_csv_row(std::string& out, const CounterEntry& entry) {
+	/* Append the CSV row of a word-count pair to `out`. */
+
+	out += entry.first; // words never hold a comma or a quote
+	out += ',';
+	append_number(out, entry.first.length(), 0);
+	out += ',';
+	append_number(out, entry.second, 0);
+	out += '\n';
+}
+
+void append_output_header(std::string& out, OutputFormat format) {
+	/* Append what an output file of a format starts with to `out` (nothing for binary). */
+
+	if (format == OUTPUT_TABLE)
+		append_table_header(out);
+	else if (format == OUTPUT_CSV)
+		out += "word,length,count\n";
+}
+
+void append_output_footer(std::string& out, OutputFormat format) {
+	/* Append what an output file of a format ends with to `out` (nothing for CSV or binary). */
+
+	if (format == OUTPUT_TABLE)
+		append_table_footer(out);
+}
+
+void format_slice(const std::vector<CounterEntry>& sorted, OutputFormat format, bool frontCoded, bool first,
+	bool last, std::string& out) {
+	/* Format a slice of the sorted words into `out`, with the header of the output if it is the
+	`first` slice and its footer if it is the `last`. A binary slice is a counter in the wire format
+	of Counter.h, so the output file can be read back with `compose_counters()`. */
+
+	if (format == OUTPUT_BINARY) {
+		std::vector<const CounterEntry*> entries;
+		entries.reserve(sorted.size());
+		for (const CounterEntry& entry: sorted)
+			entries.push_back(&entry);
+		encode_entries(out, entries.begin(), entries.end(), frontCoded);
+		return;
+	}
+
+	if (first)
+		append_output_header(out, format);
+	for (const CounterEntry& entry: sorted) {
+		if (format == OUTPUT_TABLE)
+			append_table_row(out, entry);
+		else
+			append_csv_row(out, entry);
+	}
+	if (last)
+		append_output_footer(out, format);
+}
+
+long long output_offset(long long size, int rank) {
+	/* Return the offset in the output file of the slice of this process, of `size` bytes: the sizes
+	of the slices of the processes before it. Collective over MPI_COMM_WORLD. */
+
+	long long offset = 0;
+	MPI_Exscan(&size, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	return rank == ROOT ? 0 : offset; // MPI_Exscan leaves it undefined on the first process
+}
+
+MPI_File open_output(const std::string& path) {
+	/* Open the output file for writing by every process, emptied. Collective over MPI_COMM_WORLD. */
+
+	MPI_File file;
+	if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		std::cout << "Error: could not open output file '" << path << "'" << std::endl;
+		exit(1);
+	}
+	MPI_File_set_size(file, 0); // drop what an older, longer file held
+	return file;
+}
+
+void write_slices(const std::string& path, const std::string& slice, int rank) {
+	/* Write the slice of every process to a file, one after the other in rank order, with parallel
+	MPI-IO writes. Collective over MPI_COMM_WORLD. */
+
+	PROFILE_SCOPE(PROF_WRITE);
+	long long size = slice.size(), offset = output_offset(size, rank);
+	MPI_File file = open_output(path);
+
+	// Every process writes its slice in pieces of at most OUTPUT_WRITE_PIECE bytes; the collective
+	// writes need the same number of calls on every process
+	long long pieces = (size + OUTPUT_WRITE_PIECE - 1) / OUTPUT_WRITE_PIECE, maxPieces = 0;
+	MPI_Allreduce(&pieces, &maxPieces, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+	for (long long piece = 0; piece < maxPieces; piece++) {
+		long long begin = std::min(size, piece * OUTPUT_WRITE_PIECE);
+		int count = std::min<long long>(OUTPUT_WRITE_PIECE, size - begin);
+		if (MPI_File_write_at_all(file, offset + begin, slice.data() + begin, count, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+			std::cout << "Error: could not write output file '" << path << "'" << std::endl;
+			exit(1);
+		}
+	}
+	MPI_File_close(&file);
+	PROFILE_ADD(PROF_BYTES_WRITTEN, size);
+}
+
+void write_counter(const Counter& eachCounter, const std::string& path, OutputFormat format, EntryOrder order,
+	int rank, int nprocs) {
+	/* Write the words of the counters of every process, which must not share words, to a file in
+	`order`, sorting and formatting them across the processes. Collective over MPI_COMM_WORLD. */
+
+	bool frontCoded = order == alphabetical; // the words of the slices are in order already
+	Counter slice;
+	std::vector<CounterEntry> sorted;
+	sample_sort(eachCounter, order, frontCoded, slice, sorted, rank, nprocs);
+
+	std::string out;
+	{
+		PROFILE_SCOPE(PROF_FORMAT);
+		format_slice(sorted, format, frontCoded, rank == ROOT, rank == nprocs - 1, out);
+	}
+	write_slices(path, out, rank);
+}
+
+#endif
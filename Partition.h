@@ -0,0 +1,128 @@
+/*
+Group name: Kismet
+
+Byte-range partitioning of text files. A file is split by byte offsets computed from its size,
+and every split point is moved forward to the start of the next line so no line (and therefore
+no word) is shared by two ranges. Each process can compute its own range independently by
+probing only the few bytes around its two split points.
+*/
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <algorithm> 		// std::min
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <fcntl.h> 			// open
+#include <sys/stat.h> 		// stat
+#include <unistd.h> 		// pread, close
+
+#define PROBE_SIZE 4096 // bytes read at a time when looking for the end of a line
+
+struct ByteRange {
+	/* Half-open range [begin, end) of byte offsets in a file. */
+
+	long long begin;
+	long long end;
+
+	long long size() const { return end - begin; }
+};
+
+long long get_file_size(const std::string& filename) {
+	/* Return the size in bytes of a given file. */
+
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) {
+		std::cout << "Error: could not stat file '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	return st.st_size;
+}
+
+long long align_to_line(int fd, long long offset, long long fileSize) {
+	/* Move a byte offset forward to the start of the line it falls in, i.e. to just after the
+	first newline at or after `offset - 1`. Offsets at the start or end of the file are already
+	aligned.
+	*/
+
+	if (offset <= 0)
+		return 0;
+	if (offset >= fileSize)
+		return fileSize;
+
+	char probe[PROBE_SIZE];
+	long long pos = offset - 1; // the byte before the offset may be the newline itself
+	while (pos < fileSize) {
+		ssize_t bytesRead = pread(fd, probe, PROBE_SIZE, pos);
+		if (bytesRead <= 0)
+			break;
+		for (ssize_t i = 0; i < bytesRead; i++)
+			if (probe[i] == '\n')
+				return pos + i + 1;
+		pos += bytesRead;
+	}
+	return fileSize; // the last line has no newline
+}
+
+ByteRange get_split_range(int fd, ByteRange range, long long fileSize, int part, int nparts) {
+	/* Return the line-aligned byte range of split `part` out of `nparts` equal-sized splits of a
+	line-aligned byte range of an open file. Adjacent splits share their boundary, so together they
+	cover the range exactly once. */
+
+	long long size = range.size();
+	long long begin = range.begin + size / nparts * part + size % nparts * part / nparts;
+	long long end = range.begin + size / nparts * (part + 1) + size % nparts * (part + 1) / nparts;
+	return { align_to_line(fd, begin, fileSize), std::min(range.end, align_to_line(fd, end, fileSize)) };
+}
+
+ByteRange get_split_range(int fd, long long fileSize, int part, int nparts) {
+	/* Same as above, splitting the whole file. */
+
+	return get_split_range(fd, { 0, fileSize }, fileSize, part, nparts);
+}
+
+int open_or_exit(const std::string& filename) {
+	/* Open a file for reading and return its descriptor, exit if it cannot be opened. */
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "Error: could not open file '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	return fd;
+}
+
+ByteRange get_split_range(const std::string& filename, int part, int nparts) {
+	/* Same as above, given the name of the file. */
+
+	int fd = open_or_exit(filename);
+	ByteRange range = get_split_range(fd, get_file_size(filename), part, nparts);
+	close(fd);
+	return range;
+}
+
+ByteRange align_range(const std::string& filename, ByteRange range) {
+	/* Move both ends of an arbitrary byte range of a file to line boundaries. Ranges that tile the
+	file still tile it once aligned. */
+
+	int fd = open_or_exit(filename);
+	long long fileSize = get_file_size(filename);
+	ByteRange aligned = { align_to_line(fd, range.begin, fileSize), align_to_line(fd, range.end, fileSize) };
+	close(fd);
+	return aligned;
+}
+
+std::vector<ByteRange> split_range(const std::string& filename, ByteRange range, int nparts) {
+	/* Split a line-aligned byte range of a file into `nparts` line-aligned ranges. */
+
+	std::vector<ByteRange> parts;
+	int fd = open_or_exit(filename);
+	long long fileSize = get_file_size(filename);
+	for (int part = 0; part < nparts; part++)
+		parts.push_back(get_split_range(fd, range, fileSize, part, nparts));
+	close(fd);
+	return parts;
+}
+
+#endif
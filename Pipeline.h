@@ -0,0 +1,213 @@
+/*
+Group name: Kismet
+
+Pipelined reduction of --reduce pipeline: the counter of every file is sent to ROOT with
+nonblocking point-to-point messages, so a process goes on to the next file while the counter of the
+previous one is still in flight, and ROOT merges the counters in whatever order they arrive.
+
+Each counter travels as two messages: its size, then its bytes in the wire format of Counter.h.
+ROOT posts the size receives of a file as soon as it gets to the file itself, posts the byte
+receive of a counter when its size lands, and merges the counter when its bytes land. A process
+keeps at most `depth` counters in flight, waiting for the oldest beyond that.
+
+The time during which some message of a process is in flight, minus the time the process spends
+blocked waiting for one, is the communication hidden behind computation.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <deque> 			// std::deque
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define PIPELINE_TAGS 16384 	// counters of a process told apart by tag, far more than are ever in flight
+#define DEFAULT_PIPELINE_DEPTH 2
+
+class PipelinedGather {
+	/* Nonblocking gather of one counter per file from every process to ROOT. Every process calls
+	`send()` once per file, in the same order, then `finish()`. */
+
+public:
+	double inFlightTime = 0; 	// time during which some message of this process was in flight
+	double blockedTime = 0; 	// time spent blocked waiting for messages
+
+	PipelinedGather(int rank, int nprocs, int depth, bool frontCoded)
+		: rank(rank), nprocs(nprocs), depth(depth), frontCoded(frontCoded) {
+		MPI_Comm_dup(MPI_COMM_WORLD, &comm); // keeps the messages apart from any other traffic
+	}
+
+	~PipelinedGather() {
+		MPI_Comm_free(&comm);
+	}
+
+	void send(Counter& eachWordCounter, Counter& mergedCounter) {
+		/* Send the counter of this process for the next file to ROOT without waiting for it to
+		arrive, or merge it into `mergedCounter` on ROOT. Also merges [ROOT] or releases the
+		messages that completed in the meantime. */
+
+		int tag = 2 * (sequence++ % PIPELINE_TAGS);
+		if (rank == ROOT) {
+			// expect the counters of the other processes for this file
+			for (int r = 0; r < nprocs; r++) {
+				if (r == ROOT)
+					continue;
+				incoming.push_back({ r, tag, 0, std::vector<char>() });
+				requests.push_back(MPI_REQUEST_NULL);
+				Message& message = incoming.back();
+				MPI_Irecv(&message.size, 1, MPI_LONG_LONG, r, tag, comm, &requests.back());
+				track(1);
+			}
+			PROFILE_SCOPE(PROF_MERGE);
+			if (mergedCounter.empty())
+				mergedCounter = std::move(eachWordCounter);
+			else
+				update_counter(mergedCounter, eachWordCounter);
+		} else {
+			outgoing.push_back(Outgoing());
+			Outgoing& message = outgoing.back();
+			{
+				PROFILE_SCOPE(PROF_ENCODE);
+				decompose_counter(eachWordCounter, message.buffer, frontCoded);
+			}
+			message.size = message.buffer.size();
+			PROFILE_ADD(PROF_BYTES_SENT, message.size);
+			MPI_Isend(&message.size, 1, MPI_LONG_LONG, ROOT, tag, comm, &message.requests[0]);
+			MPI_Isend(message.buffer.data(), message.size, MPI_CHAR, ROOT, tag + 1, comm, &message.requests[1]);
+			track(1);
+			while ((int) outgoing.size() > depth)
+				wait_oldest();
+		}
+		eachWordCounter = Counter();
+		progress(mergedCounter);
+	}
+
+	void progress(Counter& mergedCounter) {
+		/* Merge the counters that arrived [ROOT], or release the messages that were sent, without
+		blocking. */
+
+		if (rank == ROOT) {
+			int index, done = 1;
+			while (!requests.empty()) {
+				MPI_Testany(requests.size(), requests.data(), &index, &done, MPI_STATUS_IGNORE);
+				if (!done || index == MPI_UNDEFINED)
+					break;
+				received(index, mergedCounter);
+			}
+		} else {
+			while (!outgoing.empty()) {
+				int done;
+				MPI_Testall(2, outgoing.front().requests, &done, MPI_STATUSES_IGNORE);
+				if (!done)
+					break;
+				outgoing.pop_front();
+				track(-1);
+			}
+		}
+	}
+
+	void finish(Counter& mergedCounter) {
+		/* Wait for every counter to arrive, merging each one as it lands [ROOT]. */
+
+		double waitStart = MPI_Wtime();
+		if (rank == ROOT) {
+			int index;
+			while (!requests.empty()) {
+				MPI_Waitany(requests.size(), requests.data(), &index, MPI_STATUS_IGNORE);
+				if (index == MPI_UNDEFINED)
+					break;
+				double mergeStart = MPI_Wtime();
+				received(index, mergedCounter);
+				waitStart += MPI_Wtime() - mergeStart; // merging is not waiting
+			}
+			blockedTime += MPI_Wtime() - waitStart;
+		} else {
+			while (!outgoing.empty())
+				wait_oldest();
+		}
+	}
+
+private:
+	struct Message {
+		int source;
+		int tag; 					// even while the size is expected, the next odd one while the bytes are
+		long long size; 			// bytes of the counter
+		std::vector<char> buffer; 	// the counter, once its size is known
+	};
+
+	struct Outgoing {
+		long long size = 0;
+		std::string buffer;
+		MPI_Request requests[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL }; // size, bytes
+	};
+
+	int rank;
+	int nprocs;
+	int depth; 			// counters a process keeps in flight before waiting
+	bool frontCoded;
+	MPI_Comm comm;
+	long long sequence = 0; 		// counters sent so far
+	std::deque<Outgoing> outgoing; 	// counters in flight, oldest first [not ROOT]
+	std::deque<Message> incoming; 	// counters expected, each with its request slot [ROOT]
+	std::vector<MPI_Request> requests; 	// size or byte receive of every expected counter [ROOT]
+	int pending = 0; 				// messages in flight
+	double inFlightStart = 0;
+
+	void track(int change) {
+		/* Keep account of the time during which messages are in flight. */
+
+		if (pending == 0 && change > 0)
+			inFlightStart = MPI_Wtime();
+		pending += change;
+		if (pending == 0)
+			inFlightTime += MPI_Wtime() - inFlightStart;
+	}
+
+	void wait_oldest() {
+		PROFILE_SCOPE(PROF_COMM);
+		double waitStart = MPI_Wtime();
+		MPI_Waitall(2, outgoing.front().requests, MPI_STATUSES_IGNORE);
+		blockedTime += MPI_Wtime() - waitStart;
+		outgoing.pop_front();
+		track(-1);
+	}
+
+	void received(int index, Counter& mergedCounter) {
+		/* Handle a completed receive: post the byte receive of a counter whose size landed, or merge
+		a counter whose bytes landed. */
+
+		Message& message = incoming[index];
+		if (message.tag % 2 == 0) {
+			message.buffer.resize(message.size);
+			message.tag++;
+			MPI_Irecv(message.buffer.data(), message.size, MPI_CHAR, message.source, message.tag, comm, &requests[index]);
+			return;
+		}
+		PROFILE_ADD(PROF_BYTES_RECEIVED, message.size);
+		{
+			PROFILE_SCOPE(PROF_DECODE);
+			if (!compose_counters(mergedCounter, message.buffer.data(), message.buffer.size())) {
+				std::cout << "Error! Gathered counter data is corrupt. Aborting program." << std::endl;
+				exit(1);
+			}
+		}
+		message.buffer = std::vector<char>();
+		track(-1);
+
+		// every counter expected so far has landed
+		if (pending == 0) {
+			incoming.clear();
+			requests.clear();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+Group name: Kismet
+
+Per-phase profiling of the word counter, compiled in with -DWC_PROFILE:
+	$ mpic++ -DWC_PROFILE ass.cpp -o ass
+
+Every process accumulates the wall time of each phase (scoped timers) and a few event counters
+(bytes read, tokens, hash table probes, bytes sent, received and written), separately for each input
+file. At the end the totals of every process are reduced to ROOT, which prints the min/mean/max over
+the processes and the imbalance factor (max / mean) of each phase and counter. The per-file totals
+of every process can also be written as JSON, and every timed interval as a Chrome trace (load it in
+chrome://tracing or https://ui.perfetto.dev).
+
+Without -DWC_PROFILE the PROFILE_* macros expand to nothing and the counter probes are not counted,
+so the hot path is unchanged. The profiler is only used by the thread making MPI calls; worker
+threads keep their own tallies, which that thread adds once they are done.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <algorithm> 		// std::min, std::max
+#include <fstream> 			// std::ofstream
+#include <iomanip> 			// std::setw, std::setprecision
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+enum ProfilePhase {
+	PROF_READ, 			// mapping and faulting in input pages
+	PROF_TOKENIZE, 		// tokenizing and counting words (a single pass), fstream reads included
+	PROF_MERGE, 		// merging the counters of the threads
+	PROF_SCHEDULE, 		// waiting for the next chunk of the dynamic schedule
+	PROF_ENCODE, 		// encoding counters into the wire format
+	PROF_COMM, 			// MPI collectives moving counters
+	PROF_DECODE, 		// decoding and merging received counters
+	PROF_SELECT, 		// selecting the top words
+	PROF_SORT, 			// sorting the words of the output
+	PROF_FORMAT, 		// formatting the output
+	PROF_WRITE, 		// writing the output file
+	PROF_PHASES
+};
+
+enum ProfileMetric {
+	PROF_BYTES_READ,
+	PROF_TOKENS,
+	PROF_PROBES,
+	PROF_BYTES_SENT,
+	PROF_BYTES_RECEIVED,
+	PROF_BYTES_WRITTEN,
+	PROF_METRICS
+};
+
+const char* profilePhaseNames[PROF_PHASES] = {
+	"read", "tokenize+count", "thread merge", "schedule", "encode", "communicate", "decode+merge", "top-k select",
+	"sort", "format", "write"
+};
+const char* profileMetricNames[PROF_METRICS] = {
+	"bytes read", "tokens", "probes", "bytes sent", "bytes received", "bytes written"
+};
+
+#define PROF_FIELDS (PROF_PHASES + PROF_METRICS) // phase seconds, then metric totals
+
+#ifdef WC_PROFILE
+
+struct ProfileEvent {
+	/* One timed interval, for the Chrome trace. */
+
+	int phase;
+	int file;
+	double start; // seconds since the profiler was started
+	double end;
+};
+
+class Profiler {
+	/* Phase times and metrics of this process, per file. Bucket 0 collects whatever happens
+	outside of a file (e.g. the final reduction), bucket f + 1 belongs to file f. */
+
+public:
+	void start() {
+		origin = MPI_Wtime();
+		events.clear();
+	}
+
+	void set_file(int file) {
+		currentFile = file;
+		reserve_files(file + 1);
+	}
+
+	void reserve_files(int nfiles) {
+		if ((int) totals.size() < nfiles + 1)
+			totals.resize(nfiles + 1, std::vector<double>(PROF_FIELDS, 0));
+	}
+
+	void add(ProfileMetric metric, double value) {
+		totals[currentFile + 1][PROF_PHASES + metric] += value;
+	}
+
+	void record(ProfilePhase phase, double startTime, double endTime) {
+		totals[currentFile + 1][phase] += endTime - startTime;
+		events.push_back({ phase, currentFile, startTime - origin, endTime - origin });
+	}
+
+	int file() const { return currentFile; }
+	const std::vector< std::vector<double> >& file_totals() const { return totals; }
+	const std::vector<ProfileEvent>& recorded_events() const { return events; }
+
+private:
+	std::vector< std::vector<double> > totals = std::vector< std::vector<double> >(1, std::vector<double>(PROF_FIELDS, 0));
+	std::vector<ProfileEvent> events;
+	int currentFile = -1;
+	double origin = 0;
+};
+
+Profiler& profiler() {
+	/* Profiler of this process. */
+
+	static Profiler instance;
+	return instance;
+}
+
+class ScopedTimer {
+	/* Adds the wall time of its lifetime to a phase. */
+
+public:
+	ScopedTimer(ProfilePhase phase) : phase(phase), startTime(MPI_Wtime()) {}
+	~ScopedTimer() { profiler().record(phase, startTime, MPI_Wtime()); }
+
+private:
+	ProfilePhase phase;
+	double startTime;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(phase)
+#define PROFILE_ADD(metric, value) profiler().add(metric, value)
+#define PROFILE_FILE(file) profiler().set_file(file)
+#define PROFILE_START() profiler().start()
+
+void write_profile_json(const std::string& path, const std::vector<double>& allTotals, int nprocs,
+	const std::vector<std::string>& filenames) {
+	/* Write the per-file totals of every process as JSON. */
+
+	std::ofstream out(path);
+	if (!out.is_open()) {
+		std::cout << "Error: could not write profile '" << path << "'" << std::endl;
+		return;
+	}
+	int nbuckets = filenames.size() + 1;
+	out << "{\n  \"ranks\": [\n";
+	for (int r = 0; r < nprocs; r++) {
+		out << "    {\"rank\": " << r << ", \"files\": [\n";
+		for (int b = 0; b < nbuckets; b++) {
+			const double* fields = &allTotals[(r * nbuckets + b) * PROF_FIELDS];
+			out << "      {\"file\": \"" << (b == 0 ? "" : filenames[b - 1]) << "\", \"seconds\": {";
+			for (int p = 0; p < PROF_PHASES; p++)
+				out << (p ? ", " : "") << "\"" << profilePhaseNames[p] << "\": " << fields[p];
+			out << "}, \"counts\": {";
+			for (int m = 0; m < PROF_METRICS; m++)
+				out << (m ? ", " : "") << "\"" << profileMetricNames[m] << "\": " << (long long) fields[PROF_PHASES + m];
+			out << "}}" << (b + 1 < nbuckets ? "," : "") << "\n";
+		}
+		out << "    ]}" << (r + 1 < nprocs ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+void write_profile_trace(const std::string& path, int rank, int nprocs, const std::vector<std::string>& filenames) {
+	/* Gather the timed intervals of every process on ROOT and write them as a Chrome trace, one
+	track per process. Collective over MPI_COMM_WORLD. */
+
+	std::vector<double> eachEvents;
+	for (const ProfileEvent& event: profiler().recorded_events()) {
+		eachEvents.push_back(event.phase);
+		eachEvents.push_back(event.file);
+		eachEvents.push_back(event.start);
+		eachEvents.push_back(event.end);
+	}
+	int eachSize = eachEvents.size();
+	std::vector<int> sizes(nprocs), offsets(nprocs + 1, 0);
+	MPI_Gather(&eachSize, 1, MPI_INT, sizes.data(), 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+	for (int r = 0; r < nprocs; r++)
+		offsets[r + 1] = offsets[r] + sizes[r];
+	std::vector<double> allEvents(rank == ROOT ? offsets[nprocs] : 0);
+	MPI_Gatherv(eachEvents.data(), eachSize, MPI_DOUBLE, allEvents.data(), sizes.data(), offsets.data(),
+		MPI_DOUBLE, ROOT, MPI_COMM_WORLD);
+	if (rank != ROOT)
+		return;
+
+	std::ofstream out(path);
+	if (!out.is_open()) {
+		std::cout << "Error: could not write trace '" << path << "'" << std::endl;
+		return;
+	}
+	out << "{\"traceEvents\": [\n";
+	bool first = true;
+	for (int r = 0; r < nprocs; r++) {
+		out << (first ? "" : ",\n") << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << r
+			<< ", \"args\": {\"name\": \"rank " << r << "\"}}";
+		first = false;
+		for (int i = offsets[r]; i < offsets[r + 1]; i += 4) {
+			int phase = allEvents[i], file = allEvents[i + 1];
+			out << ",\n{\"name\": \"" << profilePhaseNames[phase] << "\", \"ph\": \"X\", \"pid\": " << r
+				<< ", \"tid\": 0, \"ts\": " << std::fixed << std::setprecision(1) << allEvents[i + 2] * 1e6
+				<< ", \"dur\": " << (allEvents[i + 3] - allEvents[i + 2]) * 1e6 << std::defaultfloat
+				<< ", \"args\": {\"file\": \"" << (file < 0 ? "" : filenames[file]) << "\"}}";
+		}
+	}
+	out << "\n]}\n";
+}
+
+void report_profile(int rank, int nprocs, const std::vector<std::string>& filenames,
+	const std::string& jsonPath, const std::string& tracePath) {
+	/* Reduce the profile of every process to ROOT and print the min/mean/max and imbalance of
+	each phase and metric, then write the optional JSON and trace files. Collective over
+	MPI_COMM_WORLD. */
+
+	int nbuckets = filenames.size() + 1;
+	profiler().reserve_files(filenames.size()); // files never touched by this process
+	std::vector<double> eachTotals;
+	for (int b = 0; b < nbuckets; b++)
+		eachTotals.insert(eachTotals.end(), profiler().file_totals()[b].begin(), profiler().file_totals()[b].end());
+	std::vector<double> allTotals(rank == ROOT ? nprocs * nbuckets * PROF_FIELDS : 0);
+	MPI_Gather(eachTotals.data(), nbuckets * PROF_FIELDS, MPI_DOUBLE, allTotals.data(), nbuckets * PROF_FIELDS,
+		MPI_DOUBLE, ROOT, MPI_COMM_WORLD);
+
+	if (rank == ROOT) {
+		std::cout << "Profile (" << nprocs << " processes):" << std::endl;
+		std::cout << "| " << std::left << std::setw(16) << "Phase / counter" << std::right << " | " << std::setw(12)
+			<< "Min" << " | " << std::setw(12) << "Mean" << " | " << std::setw(12) << "Max" << " | "
+			<< std::setw(9) << "Imbalance" << " |" << std::endl;
+		for (int f = 0; f < PROF_FIELDS; f++) {
+			std::vector<double> perRank(nprocs, 0);
+			for (int r = 0; r < nprocs; r++)
+				for (int b = 0; b < nbuckets; b++)
+					perRank[r] += allTotals[(r * nbuckets + b) * PROF_FIELDS + f];
+			double lo = *std::min_element(perRank.begin(), perRank.end());
+			double hi = *std::max_element(perRank.begin(), perRank.end());
+			double mean = 0;
+			for (double value: perRank)
+				mean += value / nprocs;
+
+			bool seconds = f < PROF_PHASES;
+			std::cout << "| " << std::left << std::setw(16) << (seconds ? profilePhaseNames[f] : profileMetricNames[f - PROF_PHASES])
+				<< std::right << std::fixed << std::setprecision(seconds ? 6 : 0) << " | " << std::setw(12) << lo
+				<< " | " << std::setw(12) << mean << " | " << std::setw(12) << hi << " | " << std::setprecision(2)
+				<< std::setw(9) << (mean > 0 ? hi / mean : 1.0) << " |" << std::endl;
+		}
+		std::cout.unsetf(std::ios::fixed);
+		std::cout << std::setprecision(6);
+
+		if (!jsonPath.empty())
+			write_profile_json(jsonPath, allTotals, nprocs, filenames);
+	}
+	if (!tracePath.empty())
+		write_profile_trace(tracePath, rank, nprocs, filenames);
+}
+
+#else
+
+#define PROFILE_SCOPE(phase)
+#define PROFILE_ADD(metric, value)
+#define PROFILE_FILE(file)
+#define PROFILE_START()
+
+void report_profile(int rank, int, const std::vector<std::string>&, const std::string&, const std::string&) {
+	/* Profiling is not compiled in. */
+
+	if (rank == ROOT)
+		std::cout << "Profile: not available, compile with -DWC_PROFILE" << std::endl;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+/*
+Group name: Kismet
+
+Reduction of the per-process word counters of a file:
+	- gather: every process sends its whole counter to ROOT, which merges them all
+	- shuffle: every process sends each word to the process that owns it (chosen by hash) with a
+	  single all-to-all exchange, so each process only merges the words it owns
+*/
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <algorithm> 		// std::sort
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+void gather_bytes(const std::string& eachBuffer, std::vector<char>& gatheredBuf,
+	std::vector<int>& bufOffsets, int rank, int nprocs) {
+	/* Gather the buffer of every process into `gatheredBuf` on ROOT, in rank order. The bytes of
+	process r end up in [bufOffsets[r], bufOffsets[r + 1]) [ROOT use only]. Collective over
+	MPI_COMM_WORLD. */
+
+	PROFILE_SCOPE(PROF_COMM);
+
+	// Variables/arguments for gathering
+	int sendAmount = eachBuffer.size(); 	// number of bytes that each proc sends to ROOT proc
+	std::vector<int> recvAmounts(nprocs); 	// number of bytes the ROOT proc receives from each proc
+											// [ROOT use only]
+	bufOffsets.assign(nprocs + 1, 0);
+
+	// get the amount of bytes for each proc to send, then gather the amounts in ROOT proc
+	MPI_Gather(&sendAmount, 1, MPI_INT, recvAmounts.data(), 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+
+	// ROOT proc computes the offsets and total size of the large buffer, and allocates it
+	if (rank == ROOT) {
+		for (int r = 0; r < nprocs; r++)
+			bufOffsets[r + 1] = bufOffsets[r] + recvAmounts[r];
+		gatheredBuf.resize(bufOffsets[nprocs]);
+	}
+
+	// Gather the buffers into the large contiguous buffer
+	MPI_Gatherv(eachBuffer.data(), sendAmount, MPI_CHAR,
+		gatheredBuf.data(), recvAmounts.data(), bufOffsets.data(), MPI_CHAR,
+		ROOT, MPI_COMM_WORLD);
+	PROFILE_ADD(PROF_BYTES_SENT, sendAmount);
+	PROFILE_ADD(PROF_BYTES_RECEIVED, rank == ROOT ? bufOffsets[nprocs] : 0);
+}
+
+void exchange_bytes(const std::string& sendBuf, const std::vector<int>& sendAmounts, const std::vector<int>& sendOffsets,
+	std::vector<char>& recvBuf, int nprocs) {
+	/* Send bytes [sendOffsets[r], sendOffsets[r] + sendAmounts[r]) of `sendBuf` to every process r,
+	and receive what every process sends to this one into `recvBuf`, in rank order. The sizes are
+	exchanged first, then the bytes themselves. Collective over MPI_COMM_WORLD. */
+
+	PROFILE_SCOPE(PROF_COMM);
+	std::vector<int> recvAmounts(nprocs), recvOffsets(nprocs);
+	MPI_Alltoall(sendAmounts.data(), 1, MPI_INT, recvAmounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+	int recvSize = 0;
+	for (int r = 0; r < nprocs; r++) {
+		recvOffsets[r] = recvSize;
+		recvSize += recvAmounts[r];
+	}
+	recvBuf.resize(recvSize);
+	MPI_Alltoallv(sendBuf.data(), sendAmounts.data(), sendOffsets.data(), MPI_CHAR,
+		recvBuf.data(), recvAmounts.data(), recvOffsets.data(), MPI_CHAR, MPI_COMM_WORLD);
+	PROFILE_ADD(PROF_BYTES_SENT, sendBuf.size());
+	PROFILE_ADD(PROF_BYTES_RECEIVED, recvSize);
+}
+
+void gather_counter(const Counter& eachWordCounter, Counter& mergedCounter, int rank, int nprocs,
+	bool frontCoded = false) {
+	/* Gather the counter of every process on ROOT and merge them into `mergedCounter` [ROOT use
+	only]. Collective over MPI_COMM_WORLD. */
+
+	// Decompose the counter of each proc into a single contiguous buffer
+	std::string eachBuffer;
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		decompose_counter(eachWordCounter, eachBuffer, frontCoded);
+	}
+
+	// Gather the decomposed counters into a large contiguous buffer [ROOT use only]
+	std::vector<char> gatheredBuf;
+	std::vector<int> bufOffsets;
+	gather_bytes(eachBuffer, gatheredBuf, bufOffsets, rank, nprocs);
+
+	// Recompose the counters straight out of the receive buffer
+	PROFILE_SCOPE(PROF_DECODE);
+	if (rank == ROOT && !compose_counters(mergedCounter, gatheredBuf.data(), gatheredBuf.size())) {
+		std::cout << "Error! Gathered counter data is corrupt. Aborting program." << std::endl;
+		exit(1);
+	}
+}
+
+int get_owner(std::uint64_t hash, int nprocs) {
+	/* Return the rank of the process owning a word, given the word's `hash_word()`. Uses the high
+	bits of the hash, the low ones already pick the Counter slot. */
+
+	return (int) ((hash >> 32) % (std::uint64_t) nprocs);
+}
+
+void shuffle_counter(const Counter& eachWordCounter, Counter& ownedCounter, int nprocs,
+	bool frontCoded = false) {
+	/* Send every word of this process's counter, with its count, to the process that owns the
+	word, and merge the words received from every process into `ownedCounter`. Collective over
+	MPI_COMM_WORLD. */
+
+	// Split the entries by owner process, then decompose the partitions back to back into one send
+	// buffer, in rank order
+	std::string sendBuf;
+	std::vector<int> sendAmounts(nprocs), sendOffsets(nprocs);
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		std::vector< std::vector<const CounterEntry*> > parts(nprocs);
+		for (auto& entry: eachWordCounter)
+			parts[get_owner(hash_word(entry.first), nprocs)].push_back(&entry);
+
+		for (int r = 0; r < nprocs; r++) {
+			if (frontCoded)
+				std::sort(parts[r].begin(), parts[r].end(), [](const CounterEntry* x, const CounterEntry* y) {
+					return x->first < y->first;
+				});
+			sendOffsets[r] = sendBuf.size();
+			encode_entries(sendBuf, parts[r].begin(), parts[r].end(), frontCoded);
+			sendAmounts[r] = sendBuf.size() - sendOffsets[r];
+		}
+	}
+
+	// Exchange the partitions
+	std::vector<char> recvBuf;
+	exchange_bytes(sendBuf, sendAmounts, sendOffsets, recvBuf, nprocs);
+
+	// Merge the received words, which are all owned by this process
+	PROFILE_SCOPE(PROF_DECODE);
+	if (!compose_counters(ownedCounter, recvBuf.data(), recvBuf.size())) {
+		std::cout << "Error! Exchanged counter data is corrupt. Aborting program." << std::endl;
+		exit(1);
+	}
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+Group name: Kismet
+
+Dynamic scheduling of the work of every input file. All files are cut up front into fixed-size
+byte chunks, the same list on every process. A single shared counter of handed-out chunks lives
+in an MPI window on ROOT; processes grab the next chunk with an atomic fetch-and-add on it
+(MPI_Fetch_and_op) whenever they are done with the previous one, so faster processes simply
+take more chunks and nobody waits for anybody until all chunks are gone.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Partition.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+struct Chunk {
+	/* A byte range of one of the input files, not yet aligned to lines. */
+
+	int file; 			// index of the file in the list of file names
+	ByteRange range;
+};
+
+std::vector<Chunk> make_chunks(const std::vector<std::string>& filenames, long long chunkSize) {
+	/* Cut every file into chunks of `chunkSize` bytes (the last chunk of a file may be smaller). */
+
+	std::vector<Chunk> chunks;
+	for (int i = 0; i < (int) filenames.size(); i++) {
+		long long fileSize = get_file_size(filenames[i]);
+		for (long long begin = 0; begin < fileSize; begin += chunkSize)
+			chunks.push_back({ i, { begin, std::min(fileSize, begin + chunkSize) } });
+	}
+	return chunks;
+}
+
+class ChunkQueue {
+	/* Shared queue of chunk indices 0, 1, 2, ... backed by a counter in an MPI window on ROOT.
+	Construction and destruction are collective over `comm`. */
+
+public:
+	ChunkQueue(long long chunkCount, MPI_Comm comm) : chunkCount(chunkCount) {
+		int rank;
+		MPI_Comm_rank(comm, &rank);
+		MPI_Win_allocate(rank == ROOT ? sizeof(long long) : 0, sizeof(long long), MPI_INFO_NULL, comm,
+			&nextChunk, &window);
+		if (rank == ROOT)
+			*nextChunk = 0;
+		MPI_Barrier(comm); // the counter is initialized before anybody reads it
+		MPI_Win_lock_all(0, window);
+	}
+
+	~ChunkQueue() {
+		MPI_Win_unlock_all(window);
+		MPI_Win_free(&window);
+	}
+
+	ChunkQueue(const ChunkQueue&) = delete;
+	ChunkQueue& operator=(const ChunkQueue&) = delete;
+
+	bool next(long long& chunk) {
+		/* Take the next chunk index off the queue. Return false once every chunk has been taken. */
+
+		const long long one = 1;
+		MPI_Fetch_and_op(&one, &chunk, MPI_LONG_LONG, ROOT, 0, MPI_SUM, window);
+		MPI_Win_flush(ROOT, window);
+		return chunk < chunkCount;
+	}
+
+private:
+	long long chunkCount;
+	MPI_Win window;
+	long long* nextChunk = NULL; // the shared counter [ROOT use only]
+};
+
+#endif
@@ -0,0 +1,492 @@
+/*
+Group name: Kismet
+
+Approximate word counting in fixed memory, for vocabularies too large to count exactly. A
+WordSketch holds three mergeable summaries of a stream of words:
+	- a Count-Min sketch (Cormode & Muthukrishnan 2005) with conservative update: `depth` rows of
+	  `width` counters, width = ceil(e / epsilon) and depth = ceil(ln(1 / delta)). The estimate of a
+	  word (the minimum of its counters) is never below its true count, and is at most
+	  epsilon * N above it with probability at least 1 - delta, N being the number of words
+	- a SpaceSaving summary (Metwally et al. 2005) of the `capacity` heaviest words, each with an
+	  overestimated count and the most it may be overestimated by. Every word occurring more than
+	  N / capacity times is in the summary
+	- a HyperLogLog sketch (Flajolet et al. 2007) of 2^precision registers, estimating the number of
+	  distinct words with a standard error of 1.04 / sqrt(2^precision)
+The memory of a WordSketch does not depend on the input, and sketches of different threads or
+processes are merged by adding (Count-Min), taking the maximum (HyperLogLog) or combining the
+summaries (SpaceSaving, Agarwal et al. 2012). The sketches of every process are merged with a single
+MPI_Reduce, over a fixed-size buffer and a user-defined reduction operation.
+*/
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <algorithm> 		// std::min, std::max, std::nth_element, std::sort, std::find_if
+#include <cmath> 			// std::ceil, std::log, std::exp, std::sqrt, std::llround
+#include <cstdint> 			// std::uint8_t, std::uint32_t, std::uint64_t
+#include <cstring> 			// std::memcpy
+#include <iomanip> 			// std::setw
+#include <iostream> 		// std::cout
+#include <string> 			// std::string
+#include <string_view> 		// std::string_view
+#include <unordered_map> 	// std::unordered_map
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Profile.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define SKETCH_MAGIC 0x31534357u 		// "WCS1"
+#define DEFAULT_SKETCH_EPSILON 1e-4 	// Count-Min error, relative to the number of words
+#define DEFAULT_SKETCH_DELTA 0.01 		// probability of the Count-Min error being exceeded
+#define DEFAULT_HEAVY_HITTERS 10000 	// words kept by the SpaceSaving summary
+#define DEFAULT_HLL_PRECISION 14 		// log2 of the number of HyperLogLog registers
+
+struct SketchParams {
+	double epsilon = DEFAULT_SKETCH_EPSILON;
+	double delta = DEFAULT_SKETCH_DELTA;
+	int heavyHitters = DEFAULT_HEAVY_HITTERS;
+	int hllPrecision = DEFAULT_HLL_PRECISION;
+	int maxWordLen = 20; 	// longest word kept by the SpaceSaving summary
+};
+
+class CountMinSketch {
+	/* Count-Min sketch with conservative update: a word only raises the counters that are below
+	its new estimate, which keeps the overestimates smaller than plain updates. */
+
+public:
+	CountMinSketch(double epsilon = DEFAULT_SKETCH_EPSILON, double delta = DEFAULT_SKETCH_DELTA)
+		: width((std::size_t) std::ceil(std::exp(1.0) / epsilon)),
+		  depth(std::max(1, (int) std::ceil(std::log(1 / delta)))),
+		  cells(width * depth, 0) {}
+
+	void add(std::uint64_t hash, long long count = 1) {
+		long long target = estimate(hash) + count;
+		for (int row = 0; row < depth; row++) {
+			long long& cell = cells[cell_index(hash, row)];
+			cell = std::max(cell, target);
+		}
+	}
+
+	long long estimate(std::uint64_t hash) const {
+		/* Return the estimated count of the word with the given `hash_word()`. */
+
+		long long minimum = cells[cell_index(hash, 0)];
+		for (int row = 1; row < depth; row++)
+			minimum = std::min(minimum, cells[cell_index(hash, row)]);
+		return minimum;
+	}
+
+	void merge(const CountMinSketch& other) {
+		for (std::size_t i = 0; i < cells.size(); i++)
+			cells[i] += other.cells[i];
+	}
+
+	std::size_t width;
+	int depth;
+	std::vector<long long> cells; // row after row
+
+private:
+	std::size_t cell_index(std::uint64_t hash, int row) const {
+		/* Counter of a word in a row, from two halves of its hash (Kirsch & Mitzenmacher). */
+
+		std::uint64_t h1 = (std::uint32_t) hash, h2 = (hash >> 32) | 1;
+		return row * width + (h1 + row * h2) % width;
+	}
+};
+
+struct HeavyHitter {
+	std::string word;
+	long long count; 	// overestimated count
+	long long error; 	// the most `count` may be above the true count
+};
+
+class SpaceSaving {
+	/* SpaceSaving summary of the `capacity` heaviest words. The summary is a min-heap on the
+	counts; a word that is not in a full summary replaces the lightest one, taking over its count
+	(as its error) plus its own. */
+
+public:
+	SpaceSaving(int capacity = DEFAULT_HEAVY_HITTERS) : capacity(std::max(1, capacity)) {
+		items.reserve(this->capacity); // never reallocated, `index` holds views of the words
+		index.reserve(this->capacity);
+	}
+
+	SpaceSaving(const SpaceSaving& other) : SpaceSaving(other.capacity) {
+		for (const HeavyHitter& item: other.items)
+			push(item);
+	}
+
+	SpaceSaving(SpaceSaving&&) = default; // moving the items keeps the views of `index` valid
+	SpaceSaving& operator=(SpaceSaving&&) = default;
+	SpaceSaving& operator=(const SpaceSaving& other) {
+		if (this != &other) {
+			clear();
+			capacity = other.capacity;
+			items.reserve(capacity);
+			assign(other.items);
+		}
+		return *this;
+	}
+
+	void add(std::string_view word, long long count = 1) {
+		auto it = index.find(word);
+		if (it != index.end()) {
+			items[it->second].count += count;
+			sift_down(position[it->second]);
+		} else if ((int) items.size() < capacity) {
+			push({ std::string(word), count, 0 });
+		} else {
+			int lightest = heap[0];
+			HeavyHitter& item = items[lightest];
+			index.erase(item.word);
+			item.word.assign(word);
+			item.error = item.count;
+			item.count += count;
+			index.emplace(item.word, lightest);
+			sift_down(0);
+		}
+	}
+
+	long long min_count() const {
+		/* Return the most any word missing from the summary may occur, 0 if the summary is not full. */
+
+		return (int) items.size() < capacity ? 0 : items[heap[0]].count;
+	}
+
+	void merge(const SpaceSaving& other) {
+		/* Merge another summary into this one. A word missing from a summary is counted as that
+		summary's `min_count()`, both as count and as error, and the `capacity` heaviest words of
+		the union are kept. */
+
+		long long thisMin = min_count(), otherMin = other.min_count();
+		std::vector<HeavyHitter> merged;
+		merged.reserve(items.size() + other.items.size());
+		for (const HeavyHitter& item: items) {
+			auto it = other.index.find(item.word);
+			const HeavyHitter* match = it != other.index.end() ? &other.items[it->second] : NULL;
+			merged.push_back({ item.word, item.count + (match ? match->count : otherMin),
+				item.error + (match ? match->error : otherMin) });
+		}
+		for (const HeavyHitter& item: other.items)
+			if (index.find(item.word) == index.end())
+				merged.push_back({ item.word, item.count + thisMin, item.error + thisMin });
+
+		if ((int) merged.size() > capacity) {
+			std::nth_element(merged.begin(), merged.begin() + capacity, merged.end(),
+				[](const HeavyHitter& x, const HeavyHitter& y) { return x.count > y.count; });
+			merged.resize(capacity);
+		}
+		assign(merged);
+	}
+
+	void assign(const std::vector<HeavyHitter>& words) {
+		/* Replace the words of the summary by (at most `capacity` of) the given ones. */
+
+		clear();
+		for (const HeavyHitter& item: words)
+			if ((int) items.size() < capacity)
+				push(item);
+	}
+
+	const std::vector<HeavyHitter>& entries() const { return items; }
+
+	void clear() {
+		items.clear();
+		heap.clear();
+		position.clear();
+		index.clear();
+	}
+
+	int capacity;
+
+private:
+	std::vector<HeavyHitter> items; 	// the words, in no particular order
+	std::vector<int> heap; 				// indices of `items`, min-heap on the counts
+	std::vector<int> position; 			// position in `heap` of every item
+	std::unordered_map<std::string_view, int> index; // word -> index in `items`
+
+	void push(const HeavyHitter& item) {
+		items.push_back(item);
+		int i = items.size() - 1;
+		index.emplace(items[i].word, i);
+		heap.push_back(i);
+		position.push_back(heap.size() - 1);
+		sift_up(heap.size() - 1);
+	}
+
+	void swap_nodes(int a, int b) {
+		std::swap(heap[a], heap[b]);
+		position[heap[a]] = a;
+		position[heap[b]] = b;
+	}
+
+	void sift_up(int node) {
+		while (node > 0) {
+			int parent = (node - 1) / 2;
+			if (items[heap[parent]].count <= items[heap[node]].count)
+				return;
+			swap_nodes(node, parent);
+			node = parent;
+		}
+	}
+
+	void sift_down(int node) {
+		int size = heap.size();
+		while (true) {
+			int smallest = node, left = 2 * node + 1, right = left + 1;
+			if (left < size && items[heap[left]].count < items[heap[smallest]].count)
+				smallest = left;
+			if (right < size && items[heap[right]].count < items[heap[smallest]].count)
+				smallest = right;
+			if (smallest == node)
+				return;
+			swap_nodes(node, smallest);
+			node = smallest;
+		}
+	}
+};
+
+class HyperLogLog {
+	/* HyperLogLog distinct counter: each register keeps the longest run of leading zeros (+ 1)
+	seen in the hashes that fall into it. */
+
+public:
+	HyperLogLog(int precision = DEFAULT_HLL_PRECISION) : precision(precision), registers(1 << precision, 0) {}
+
+	void add(std::uint64_t hash) {
+		std::size_t i = hash >> (64 - precision);
+		std::uint64_t rest = (hash << precision) | (1ull << (precision - 1)); // never all zeros
+		std::uint8_t rank = __builtin_clzll(rest) + 1;
+		registers[i] = std::max(registers[i], rank);
+	}
+
+	void merge(const HyperLogLog& other) {
+		for (std::size_t i = 0; i < registers.size(); i++)
+			registers[i] = std::max(registers[i], other.registers[i]);
+	}
+
+	double estimate() const {
+		/* Return the estimated number of distinct words, with linear counting for small numbers. */
+
+		double m = registers.size(), sum = 0;
+		int zeros = 0;
+		for (std::uint8_t rank: registers) {
+			sum += std::ldexp(1.0, -rank);
+			zeros += rank == 0;
+		}
+		double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+		if (estimate <= 2.5 * m && zeros > 0)
+			estimate = m * std::log(m / zeros);
+		return estimate;
+	}
+
+	double standard_error() const { return 1.04 / std::sqrt((double) registers.size()); }
+
+	int precision;
+	std::vector<std::uint8_t> registers;
+};
+
+struct SketchHeader {
+	std::uint32_t magic;
+	std::uint32_t depth; 		// Count-Min rows
+	std::uint64_t width; 		// Count-Min counters per row
+	std::uint32_t capacity; 	// SpaceSaving words
+	std::uint32_t wordSize; 	// bytes reserved per SpaceSaving word
+	std::uint32_t precision; 	// HyperLogLog precision
+	std::uint32_t used; 		// SpaceSaving words held
+	std::int64_t total; 		// number of words counted
+};
+
+struct SketchRecord {
+	/* Fixed-size head of a SpaceSaving word in an encoded sketch, followed by `wordSize` bytes. */
+
+	std::int64_t count;
+	std::int64_t error;
+	std::uint64_t length;
+};
+
+class WordSketch {
+	/* Count-Min, SpaceSaving and HyperLogLog summaries of the same stream of words. */
+
+public:
+	WordSketch(const SketchParams& params)
+		: cms(params.epsilon, params.delta), heavy(params.heavyHitters), hll(params.hllPrecision),
+		  wordSize(params.maxWordLen) {}
+
+	void add(std::string_view word) {
+		std::uint64_t hash = hash_word(word);
+		cms.add(hash);
+		hll.add(hash);
+		heavy.add(word);
+		total++;
+	}
+
+	void merge(const WordSketch& other) {
+		cms.merge(other.cms);
+		heavy.merge(other.heavy);
+		hll.merge(other.hll);
+		total += other.total;
+	}
+
+	long long estimate(std::string_view word) const {
+		/* Best known upper bound of the count of a word. */
+
+		long long estimate = cms.estimate(hash_word(word));
+		for (const HeavyHitter& item: heavy.entries())
+			if (item.word == word)
+				estimate = std::min(estimate, item.count);
+		return estimate;
+	}
+
+	std::size_t encoded_size() const {
+		return sizeof(SketchHeader) + cms.cells.size() * sizeof(long long)
+			+ heavy.capacity * record_size() + hll.registers.size();
+	}
+
+	void encode(char* buffer) const {
+		/* Write the sketch into `encoded_size()` bytes of `buffer`. */
+
+		SketchHeader header = { SKETCH_MAGIC, (std::uint32_t) cms.depth, cms.width, (std::uint32_t) heavy.capacity,
+			(std::uint32_t) wordSize, (std::uint32_t) hll.precision, (std::uint32_t) heavy.entries().size(), total };
+		std::memcpy(buffer, &header, sizeof(SketchHeader));
+		char* pos = buffer + sizeof(SketchHeader);
+		std::memcpy(pos, cms.cells.data(), cms.cells.size() * sizeof(long long));
+		pos += cms.cells.size() * sizeof(long long);
+		for (const HeavyHitter& item: heavy.entries()) {
+			SketchRecord record = { item.count, item.error, std::min<std::uint64_t>(item.word.size(), wordSize) };
+			std::memcpy(pos, &record, sizeof(SketchRecord));
+			std::memcpy(pos + sizeof(SketchRecord), item.word.data(), record.length);
+			pos += record_size();
+		}
+		pos += (heavy.capacity - heavy.entries().size()) * record_size();
+		std::memcpy(pos, hll.registers.data(), hll.registers.size());
+	}
+
+	static WordSketch decode(const char* buffer) {
+		/* Rebuild a sketch written by `encode()`. */
+
+		SketchHeader header;
+		std::memcpy(&header, buffer, sizeof(SketchHeader));
+		WordSketch sketch(header);
+		const char* pos = buffer + sizeof(SketchHeader);
+		std::memcpy(sketch.cms.cells.data(), pos, sketch.cms.cells.size() * sizeof(long long));
+		pos += sketch.cms.cells.size() * sizeof(long long);
+		std::vector<HeavyHitter> items(header.used);
+		for (HeavyHitter& item: items) {
+			SketchRecord record;
+			std::memcpy(&record, pos, sizeof(SketchRecord));
+			item = { std::string(pos + sizeof(SketchRecord), record.length), record.count, record.error };
+			pos += sketch.record_size();
+		}
+		sketch.heavy.assign(items);
+		pos += (header.capacity - header.used) * sketch.record_size();
+		std::memcpy(sketch.hll.registers.data(), pos, sketch.hll.registers.size());
+		sketch.total = header.total;
+		return sketch;
+	}
+
+	CountMinSketch cms;
+	SpaceSaving heavy;
+	HyperLogLog hll;
+	int wordSize;
+	long long total = 0;
+
+private:
+	WordSketch(const SketchHeader& header) : heavy(header.capacity), hll(header.precision), wordSize(header.wordSize) {
+		cms.width = header.width;
+		cms.depth = header.depth;
+		cms.cells.assign(header.width * header.depth, 0);
+	}
+
+	std::size_t record_size() const { return (sizeof(SketchRecord) + wordSize + 7) / 8 * 8; }
+};
+
+void merge_sketch_buffers(void* in, void* inout, int* len, MPI_Datatype* type) {
+	/* MPI reduction operation of encoded WordSketches, each one element of `type`. */
+
+	int size;
+	MPI_Type_size(*type, &size);
+	for (int i = 0; i < *len; i++) {
+		WordSketch merged = WordSketch::decode((char*) inout + (std::size_t) i * size);
+		merged.merge(WordSketch::decode((char*) in + (std::size_t) i * size));
+		merged.encode((char*) inout + (std::size_t) i * size);
+	}
+}
+
+void reduce_sketch(WordSketch& sketch, int rank) {
+	/* Merge the sketch of every process into the sketch of ROOT, with one MPI_Reduce. Every
+	process must use the same sketch parameters. Collective over MPI_COMM_WORLD. */
+
+	std::size_t size = sketch.encoded_size();
+	std::vector<char> eachBuffer(size), mergedBuffer(rank == ROOT ? size : 0);
+	{
+		PROFILE_SCOPE(PROF_ENCODE);
+		sketch.encode(eachBuffer.data());
+	}
+
+	MPI_Datatype sketchType;
+	MPI_Op mergeOp;
+	MPI_Type_contiguous(size, MPI_BYTE, &sketchType);
+	MPI_Type_commit(&sketchType);
+	MPI_Op_create(merge_sketch_buffers, 1, &mergeOp);
+	{
+		PROFILE_SCOPE(PROF_COMM);
+		MPI_Reduce(eachBuffer.data(), mergedBuffer.data(), 1, sketchType, mergeOp, ROOT, MPI_COMM_WORLD);
+		PROFILE_ADD(PROF_BYTES_SENT, size);
+	}
+	MPI_Op_free(&mergeOp);
+	MPI_Type_free(&sketchType);
+
+	PROFILE_SCOPE(PROF_DECODE);
+	if (rank == ROOT)
+		sketch = WordSketch::decode(mergedBuffer.data());
+}
+
+void print_sketch_report(const WordSketch& sketch, long long top) {
+	/* Print the heaviest words of a sketch (the `top` ones, or all those the SpaceSaving summary
+	guarantees to hold if `top` is 0) with their estimated counts and error bounds, and the
+	estimated number of distinct words. */
+
+	double countError = std::exp(1.0) / sketch.cms.width * sketch.total; // epsilon * N
+	double confidence = 1 - std::exp(-(double) sketch.cms.depth);
+	long long heavyError = sketch.total / sketch.heavy.capacity;
+
+	// Both summaries overestimate, so the smaller estimate is the better one; the SpaceSaving error
+	// gives a guaranteed lower bound
+	struct Row { std::string_view word; long long estimate, atLeast; };
+	std::vector<Row> rows;
+	for (const HeavyHitter& item: sketch.heavy.entries())
+		rows.push_back({ item.word, std::min(item.count, sketch.cms.estimate(hash_word(item.word))),
+			std::max(0LL, item.count - item.error) });
+	std::sort(rows.begin(), rows.end(), [](const Row& x, const Row& y) {
+		return x.estimate != y.estimate ? x.estimate > y.estimate : x.word < y.word;
+	});
+	if (top > 0 && (long long) rows.size() > top)
+		rows.resize(top);
+	else if (top == 0)
+		rows.erase(std::find_if(rows.begin(), rows.end(), [heavyError](const Row& row) {
+			return row.estimate <= heavyError;
+		}), rows.end());
+
+	std::cout << "---------------------------------------------------------" << std::endl;
+	std::cout << "| " << std::left << std::setw(20) << "Word" << " | " << std::right << std::setw(6) << "Length"
+		<< " | " << std::setw(9) << "Estimate" << " | " << std::setw(9) << "At least" << " |" << std::endl;
+	for (const Row& row: rows)
+		std::cout << "| " << std::left << std::setw(20) << row.word << " | " << std::right << std::setw(6)
+			<< row.word.length() << " | " << std::setw(9) << row.estimate << " | " << std::setw(9)
+			<< row.atLeast << " |" << std::endl;
+	std::cout << "---------------------------------------------------------" << std::endl;
+	std::cout << "Estimates are at most " << (long long) std::ceil(countError) << " over the true counts with probability "
+		<< confidence << " (Count-Min " << sketch.cms.depth << " x " << sketch.cms.width << ")" << std::endl;
+	std::cout << "Every word occurring more than " << heavyError << " times is listed (SpaceSaving, "
+		<< sketch.heavy.capacity << " words)" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Unique words: ~" << (long long) std::llround(sketch.hll.estimate()) << " (HyperLogLog, +/- "
+		<< 100 * sketch.hll.standard_error() << "% standard error)" << std::endl;
+}
+
+#endif
@@ -0,0 +1,628 @@
+/*
+Group name: Kismet
+
+Out-of-core counting for vocabularies larger than memory (--memory-budget). A counter that
+outgrows its share of the budget is sorted and spilled to a temporary file as a sorted run, and
+cleared. At the end every word is counted in some run of some process, and the runs are combined
+by streaming merges of sorted runs, so no process ever holds the whole vocabulary:
+	1. every process merges its runs (k-way, adding up the counts of equal words), and sends the
+	   merged words to the processes owning them, in blocks: process r owns the words between
+	   splitters r - 1 and r, picked by ROOT out of samples of every run
+	2. every process appends the blocks it receives from each process to a run of that process,
+	   and merges the runs it received into its own range of the words, in alphabetical order
+Only the top words of each range are kept (--top), or each range is formatted into a file, which
+is then printed or written out a block at a time.
+
+A run is a sequence of chunks, each a front-coded counter in the wire format of Counter.h (so a run
+can be read whole with `compose_counters()`, and is written out as is by --format binary).
+*/
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <algorithm> 		// std::sort
+#include <cstdio> 			// std::FILE, std::fopen, std::fread, std::fwrite, std::remove
+#include <cstdlib> 			// std::getenv
+#include <deque> 			// std::deque
+#include <functional> 		// std::function
+#include <iostream> 		// std::cout
+#include <memory> 			// std::unique_ptr
+#include <mutex> 			// std::mutex, std::lock_guard
+#include <queue> 			// std::priority_queue
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <unistd.h> 		// getpid
+#include <mpi.h>
+#include "Counter.h"
+#include "Output.h"
+#include "Profile.h"
+#include "Reduce.h"
+#include "TopK.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define SPILL_CHUNK_BYTES (1 << 20) 	// bytes of words per chunk of a run, and per block sent
+#define SPILL_SAMPLES 64 				// samples per run, for the splitters of the final merge
+#define SPILL_MERGE_FANIN 64 			// runs merged at once, each holding one chunk in memory
+#define SPILL_CHECK_WORDS 65536 		// words counted by a thread between checks of its memory
+#define SPILL_SENDS_IN_FLIGHT 4 		// blocks a process has in flight to the other processes
+#define SPILL_TAG 1
+
+[[noreturn]] inline void corrupt_run(const std::string& path) {
+	std::cout << "Error! Spilled run '" << path << "' is corrupt. Aborting program." << std::endl;
+	exit(1);
+}
+
+class RunWriter {
+	/* Writes word-count pairs given in alphabetical order as a sorted run, handing every full chunk
+	(and the last one, on `flush()`) to `sink`. */
+
+public:
+	typedef std::function<void(std::string&)> Sink;
+
+	RunWriter(Sink sink) : sink(sink) {}
+
+	void add(std::string_view word, long long count) {
+		records.push_back({ words.size(), word.size(), count });
+		words.append(word);
+		if (words.size() >= SPILL_CHUNK_BYTES)
+			flush();
+	}
+
+	void flush() {
+		/* Encode the pairs added since the last chunk into a chunk of their own. */
+
+		if (records.empty())
+			return;
+		std::vector<CounterEntry> entries;
+		std::vector<const CounterEntry*> pointers;
+		entries.reserve(records.size());
+		for (const Record& record: records)
+			entries.push_back({ std::string_view(words.data() + record.offset, record.length), record.count });
+		for (const CounterEntry& entry: entries)
+			pointers.push_back(&entry);
+		std::string chunk;
+		encode_entries(chunk, pointers.begin(), pointers.end(), true);
+		records.clear();
+		words.clear();
+		sink(chunk);
+	}
+
+private:
+	struct Record {
+		std::size_t offset;
+		std::size_t length;
+		long long count;
+	};
+
+	Sink sink;
+	std::string words; 				// the words of the chunk, back to back
+	std::vector<Record> records;
+};
+
+class RunReader {
+	/* Reads the word-count pairs of a sorted run one at a time, a chunk in memory at a time. */
+
+public:
+	std::string word; 		// current pair, after `next()` returned true
+	long long count = 0;
+
+	RunReader(const std::string& path) : path(path) {
+		file = std::fopen(path.c_str(), "rb");
+		if (!file) {
+			std::cout << "Error: could not open spilled run '" << path << "'" << std::endl;
+			exit(1);
+		}
+	}
+
+	~RunReader() {
+		std::fclose(file);
+	}
+
+	RunReader(const RunReader&) = delete;
+	RunReader& operator=(const RunReader&) = delete;
+
+	bool next() {
+		/* Move on to the next pair. Return false at the end of the run. */
+
+		while (left == 0) {
+			if (!load_chunk())
+				return false;
+		}
+		std::uint64_t shared, length, value;
+		if (!get_varint(pos, end, shared) || shared > word.size() || !get_varint(pos, end, length)
+			|| length > (std::uint64_t) (end - pos))
+			corrupt_run(path);
+		word.resize(shared);
+		word.append(pos, length);
+		pos += length;
+		if (!get_varint(pos, end, value))
+			corrupt_run(path);
+		count = (long long) value;
+		left--;
+		return true;
+	}
+
+private:
+	std::string path;
+	std::FILE* file;
+	std::vector<char> payload; 	// the current chunk
+	const char* pos = nullptr;
+	const char* end = nullptr;
+	std::uint64_t left = 0; 	// pairs left in the current chunk
+
+	bool load_chunk() {
+		CounterHeader header;
+		std::size_t got = std::fread(&header, 1, sizeof(header), file);
+		if (got == 0 && std::feof(file))
+			return false;
+		if (got != sizeof(header) || header.magic != COUNTER_MAGIC || !(header.flags & COUNTER_FRONT_CODED))
+			corrupt_run(path);
+		payload.resize(header.payloadSize);
+		if (std::fread(payload.data(), 1, payload.size(), file) != payload.size()
+			|| hash_bytes(payload.data(), payload.size()) != header.checksum)
+			corrupt_run(path);
+		pos = payload.data();
+		end = pos + payload.size();
+		left = header.entries;
+		word.clear(); // front coding starts over in every chunk
+		return true;
+	}
+};
+
+template <typename Emit>
+void merge_runs(const std::vector<std::string>& paths, Emit&& emit) {
+	/* Merge sorted runs, calling `emit(word, count)` for every word of any of them in alphabetical
+	order, with the sum of its counts. A run holds a word at most once. */
+
+	std::vector< std::unique_ptr<RunReader> > readers;
+	auto later = [&readers](int x, int y) { return readers[x]->word > readers[y]->word; };
+	std::priority_queue<int, std::vector<int>, decltype(later)> heap(later);
+	for (const std::string& path: paths) {
+		readers.emplace_back(new RunReader(path));
+		if (readers.back()->next())
+			heap.push(readers.size() - 1);
+	}
+
+	std::string word;
+	while (!heap.empty()) {
+		int i = heap.top();
+		heap.pop();
+		word = readers[i]->word;
+		long long count = readers[i]->count;
+		if (readers[i]->next())
+			heap.push(i);
+		while (!heap.empty() && readers[heap.top()]->word == word) {
+			int j = heap.top();
+			heap.pop();
+			count += readers[j]->count;
+			if (readers[j]->next())
+				heap.push(j);
+		}
+		emit(std::string_view(word), count);
+	}
+}
+
+class SpillRuns {
+	/* The sorted runs spilled by a process, in temporary files removed along with the object.
+	`spill()` may be called by several threads at once. */
+
+public:
+	long long budget; 				// bytes of counters the process keeps in memory
+	std::vector<std::string> runs;
+	std::vector<std::string> samples; 	// regularly spaced words of every run
+	long long spilledRuns = 0; 		// runs spilled, merged ones excluded
+	long long spilledBytes = 0;
+
+	SpillRuns(const std::string& dir, long long budget, int rank) : budget(budget) {
+		std::string base = !dir.empty() ? dir : std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+		prefix = base + "/wc-spill-" + std::to_string(getpid()) + "-" + std::to_string(rank) + "-";
+	}
+
+	~SpillRuns() {
+		for (const std::string& path: created)
+			std::remove(path.c_str());
+	}
+
+	SpillRuns(const SpillRuns&) = delete;
+	SpillRuns& operator=(const SpillRuns&) = delete;
+
+	bool over_budget(const Counter& counter, int share) const {
+		/* Return true if a counter takes more than 1 / `share` of the budget. */
+
+		return (long long) counter.memory_usage() * share > budget;
+	}
+
+	std::string new_path() {
+		std::lock_guard<std::mutex> lock(mutex);
+		created.push_back(prefix + std::to_string(created.size()) + ".run");
+		return created.back();
+	}
+
+	std::FILE* create(const std::string& path) {
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			std::cout << "Error: could not create spill file '" << path << "'" << std::endl;
+			exit(1);
+		}
+		return file;
+	}
+
+	void append(std::FILE* file, const std::string& path, const char* data, std::size_t size) {
+		if (std::fwrite(data, 1, size, file) != size) {
+			std::cout << "Error: could not write spill file '" << path << "'" << std::endl;
+			exit(1);
+		}
+	}
+
+	void spill(Counter& counter) {
+		/* Write the words of a counter to a new sorted run, and empty the counter. */
+
+		if (counter.empty())
+			return;
+		std::vector<const CounterEntry*> sorted;
+		sorted.reserve(counter.size());
+		for (auto& entry: counter)
+			sorted.push_back(&entry);
+		std::sort(sorted.begin(), sorted.end(), [](const CounterEntry* x, const CounterEntry* y) {
+			return x->first < y->first;
+		});
+
+		std::string path = new_path();
+		std::FILE* file = create(path);
+		long long bytes = 0;
+		RunWriter writer([&](std::string& chunk) {
+			append(file, path, chunk.data(), chunk.size());
+			bytes += chunk.size();
+		});
+		std::vector<std::string> runSamples;
+		std::size_t stride = std::max<std::size_t>(1, sorted.size() / SPILL_SAMPLES);
+		for (std::size_t i = 0; i < sorted.size(); i++) {
+			writer.add(sorted[i]->first, sorted[i]->second);
+			if (i % stride == stride / 2)
+				runSamples.emplace_back(sorted[i]->first);
+		}
+		writer.flush();
+		std::fclose(file);
+		counter = Counter(); // gives the memory back, unlike clear()
+
+		std::lock_guard<std::mutex> lock(mutex);
+		runs.push_back(path);
+		samples.insert(samples.end(), runSamples.begin(), runSamples.end());
+		spilledRuns++;
+		spilledBytes += bytes;
+	}
+
+	void merge_down(std::size_t fanIn) {
+		/* Merge the runs, `fanIn` at a time, until there are at most `fanIn` of them. */
+
+		while (runs.size() > fanIn) {
+			std::vector<std::string> group(runs.begin(), runs.begin() + fanIn);
+			std::string path = new_path();
+			std::FILE* file = create(path);
+			RunWriter writer([&](std::string& chunk) { append(file, path, chunk.data(), chunk.size()); });
+			merge_runs(group, [&writer](std::string_view word, long long count) { writer.add(word, count); });
+			writer.flush();
+			std::fclose(file);
+			for (const std::string& merged: group)
+				std::remove(merged.c_str());
+			runs.erase(runs.begin(), runs.begin() + fanIn);
+			runs.push_back(path);
+		}
+	}
+
+private:
+	std::string prefix;
+	std::vector<std::string> created; 	// every file made, to be removed
+	std::mutex mutex;
+};
+
+std::vector<std::string> pick_splitters(const SpillRuns& spills, int rank, int nprocs) {
+	/* Split the words in `nprocs` ranges of about as many words of the runs of every process, from
+	the samples of the runs: words up to splitter r belong to process r, the rest to the last one.
+	Collective over MPI_COMM_WORLD. */
+
+	std::string sampleBuf;
+	for (const std::string& sample: spills.samples)
+		sampleBuf += sample + '\n'; // words never hold a newline
+	std::vector<char> gathered;
+	std::vector<int> offsets;
+	gather_bytes(sampleBuf, gathered, offsets, rank, nprocs);
+
+	std::string splitterBuf;
+	if (rank == ROOT) {
+		std::vector<std::string> all;
+		std::size_t start = 0;
+		for (std::size_t i = 0; i < gathered.size(); i++) {
+			if (gathered[i] == '\n') {
+				all.emplace_back(gathered.data() + start, i - start);
+				start = i + 1;
+			}
+		}
+		std::sort(all.begin(), all.end());
+		for (int r = 1; r < nprocs && !all.empty(); r++)
+			splitterBuf += all[all.size() * r / nprocs] + '\n';
+	}
+	broadcast_bytes(splitterBuf, rank);
+
+	std::vector<std::string> splitters;
+	std::size_t start = 0;
+	for (std::size_t i = 0; i < splitterBuf.size(); i++) {
+		if (splitterBuf[i] == '\n') {
+			splitters.push_back(splitterBuf.substr(start, i - start));
+			start = i + 1;
+		}
+	}
+	return splitters;
+}
+
+template <typename Emit>
+void reduce_spilled(SpillRuns& spills, int rank, int nprocs, Emit&& emit) {
+	/* Merge the sorted runs of every process, calling `emit(word, count)` for every word of the
+	range this process owns, in alphabetical order, with its count over every process. The ranges
+	of the processes follow each other in rank order. Collective over MPI_COMM_WORLD. */
+
+	spills.merge_down(SPILL_MERGE_FANIN);
+	std::vector<std::string> splitters = pick_splitters(spills, rank, nprocs);
+
+	MPI_Comm comm;
+	MPI_Comm_dup(MPI_COMM_WORLD, &comm); // keeps the blocks apart from any other traffic
+
+	// the blocks received from each process make a run of their own
+	std::vector<std::string> receivedPaths(nprocs);
+	std::vector<std::FILE*> received(nprocs, nullptr);
+	auto append = [&](int source, const char* data, std::size_t size) {
+		if (!received[source]) {
+			receivedPaths[source] = spills.new_path();
+			received[source] = spills.create(receivedPaths[source]);
+		}
+		spills.append(received[source], receivedPaths[source], data, size);
+	};
+
+	// a zero-length block is the end of the blocks of a process
+	int ended = 1;
+	std::vector<char> recvBuf;
+	auto receive = [&](bool wait) {
+		MPI_Status status;
+		int arrived = 1, size;
+		if (wait)
+			MPI_Probe(MPI_ANY_SOURCE, SPILL_TAG, comm, &status);
+		else
+			MPI_Iprobe(MPI_ANY_SOURCE, SPILL_TAG, comm, &arrived, &status);
+		if (!arrived)
+			return false;
+		MPI_Get_count(&status, MPI_CHAR, &size);
+		recvBuf.resize(size);
+		MPI_Recv(recvBuf.data(), size, MPI_CHAR, status.MPI_SOURCE, SPILL_TAG, comm, MPI_STATUS_IGNORE);
+		PROFILE_ADD(PROF_BYTES_RECEIVED, size);
+		if (size == 0)
+			ended++;
+		else
+			append(status.MPI_SOURCE, recvBuf.data(), size);
+		return true;
+	};
+
+	// blocks in flight; a process waiting for its own to go keeps taking in the others' blocks, so
+	// no two processes wait on each other
+	struct Outgoing {
+		std::string buffer;
+		MPI_Request request;
+	};
+	std::deque<Outgoing> sends;
+	auto send = [&](int dest, std::string& block) {
+		sends.push_back({ std::move(block), MPI_REQUEST_NULL });
+		MPI_Isend(sends.back().buffer.data(), sends.back().buffer.size(), MPI_CHAR, dest, SPILL_TAG, comm,
+			&sends.back().request);
+		PROFILE_ADD(PROF_BYTES_SENT, sends.back().buffer.size());
+		while (receive(false)) {}
+		while (sends.size() > SPILL_SENDS_IN_FLIGHT) {
+			int done;
+			MPI_Test(&sends.front().request, &done, MPI_STATUS_IGNORE);
+			if (done)
+				sends.pop_front();
+			else
+				receive(false);
+		}
+	};
+
+	// Merge the local runs, sending every word to its owner
+	{
+		std::vector<RunWriter> writers;
+		for (int r = 0; r < nprocs; r++) {
+			writers.emplace_back([&, r](std::string& chunk) {
+				if (r == rank)
+					append(rank, chunk.data(), chunk.size());
+				else
+					send(r, chunk);
+			});
+		}
+		int owner = 0;
+		merge_runs(spills.runs, [&](std::string_view word, long long count) {
+			while (owner < (int) splitters.size() && word > splitters[owner])
+				owner++;
+			writers[owner].add(word, count);
+		});
+		for (RunWriter& writer: writers)
+			writer.flush();
+	}
+	for (int r = 0; r < nprocs; r++) {
+		if (r != rank) {
+			std::string end;
+			send(r, end);
+		}
+	}
+	while (ended < nprocs)
+		receive(true);
+	for (Outgoing& message: sends)
+		MPI_Wait(&message.request, MPI_STATUS_IGNORE);
+	MPI_Comm_free(&comm);
+
+	// The local runs are all sent; merge the runs received into the range of this process
+	for (const std::string& path: spills.runs)
+		std::remove(path.c_str());
+	spills.runs.clear();
+	std::vector<std::string> ownedRuns;
+	for (int r = 0; r < nprocs; r++) {
+		if (received[r]) {
+			std::fclose(received[r]);
+			ownedRuns.push_back(receivedPaths[r]);
+		}
+	}
+	merge_runs(ownedRuns, emit);
+	for (const std::string& path: ownedRuns)
+		std::remove(path.c_str());
+}
+
+void reduce_spilled_counts(SpillRuns& spills, long long top, OutputFormat format, Counter& topCounter,
+	std::string& slicePath, long long& uniqueWords, long long& totalWords, int rank, int nprocs) {
+	/* Merge the sorted runs of every process. With `top`, the top words over every process end up
+	in `topCounter` [ROOT use only]; otherwise the words of the range of this process are formatted
+	into the file `slicePath`, without the header or footer of the format. Also count the unique
+	words and all the words [ROOT use only]. Collective over MPI_COMM_WORLD. */
+
+	// the least common of the top words so far on top of the heap
+	typedef std::pair<std::string, long long> TopWord;
+	auto less_common = [](const TopWord& x, const TopWord& y) {
+		return most_common({ x.first, x.second }, { y.first, y.second });
+	};
+	std::priority_queue<TopWord, std::vector<TopWord>, decltype(less_common)> heap(less_common);
+	std::FILE* slice = nullptr;
+	std::unique_ptr<RunWriter> binary;
+	std::string out;
+	if (top == 0) {
+		slicePath = spills.new_path();
+		slice = spills.create(slicePath);
+		if (format == OUTPUT_BINARY)
+			binary.reset(new RunWriter([&](std::string& chunk) {
+				spills.append(slice, slicePath, chunk.data(), chunk.size());
+			}));
+	}
+
+	long long eachCounts[2] = { 0, 0 }, counts[2] = { 0, 0 };
+	reduce_spilled(spills, rank, nprocs, [&](std::string_view word, long long count) {
+		eachCounts[0]++;
+		eachCounts[1] += count;
+		if (top > 0) {
+			if ((long long) heap.size() < top || most_common({ word, count }, { heap.top().first, heap.top().second })) {
+				heap.push({ std::string(word), count });
+				if ((long long) heap.size() > top)
+					heap.pop();
+			}
+		} else if (binary) {
+			binary->add(word, count);
+		} else {
+			if (format == OUTPUT_TABLE)
+				append_table_row(out, { word, count });
+			else
+				append_csv_row(out, { word, count });
+			if (out.size() >= SPILL_CHUNK_BYTES) {
+				spills.append(slice, slicePath, out.data(), out.size());
+				out.clear();
+			}
+		}
+	});
+	if (binary)
+		binary->flush();
+	if (slice) {
+		spills.append(slice, slicePath, out.data(), out.size());
+		std::fclose(slice);
+	}
+
+	MPI_Reduce(eachCounts, counts, 2, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+	uniqueWords = counts[0];
+	totalWords = counts[1];
+	if (top > 0) {
+		Counter heapTop;
+		while (!heap.empty()) {
+			heapTop.add(heap.top().first, heap.top().second);
+			heap.pop();
+		}
+		top_k_disjoint(heapTop, top, topCounter, rank, nprocs);
+	}
+}
+
+template <typename Write>
+void read_slice(const std::string& slicePath, Write&& write) {
+	/* Pass the bytes of a formatted slice file to `write(data, size)`, a block at a time. */
+
+	std::FILE* file = std::fopen(slicePath.c_str(), "rb");
+	if (!file) {
+		std::cout << "Error: could not open spill file '" << slicePath << "'" << std::endl;
+		exit(1);
+	}
+	std::vector<char> block(SPILL_CHUNK_BYTES);
+	std::size_t got;
+	while ((got = std::fread(block.data(), 1, block.size(), file)) > 0)
+		write(block.data(), got);
+	std::fclose(file);
+}
+
+void print_spilled(const std::string& slicePath, int rank, int nprocs) {
+	/* Print the report table of the formatted slices of every process on ROOT, in rank order, a
+	block at a time. Collective over MPI_COMM_WORLD. */
+
+	if (rank != ROOT) {
+		read_slice(slicePath, [](const char* data, std::size_t size) {
+			MPI_Send(data, size, MPI_CHAR, ROOT, SPILL_TAG, MPI_COMM_WORLD);
+		});
+		MPI_Send(nullptr, 0, MPI_CHAR, ROOT, SPILL_TAG, MPI_COMM_WORLD);
+		return;
+	}
+
+	std::string header;
+	append_table_header(header);
+	std::cout << header;
+	read_slice(slicePath, [](const char* data, std::size_t size) { std::cout.write(data, size); });
+	std::vector<char> block;
+	for (int r = 1; r < nprocs; r++) {
+		while (true) {
+			MPI_Status status;
+			int size;
+			MPI_Probe(r, SPILL_TAG, MPI_COMM_WORLD, &status);
+			MPI_Get_count(&status, MPI_CHAR, &size);
+			block.resize(size);
+			MPI_Recv(block.data(), size, MPI_CHAR, r, SPILL_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			if (size == 0)
+				break;
+			std::cout.write(block.data(), size);
+		}
+	}
+	std::string footer;
+	append_table_footer(footer);
+	std::cout << footer;
+}
+
+void write_spilled(const std::string& slicePath, const std::string& path, OutputFormat format, int rank,
+	int nprocs) {
+	/* Write the formatted slices of every process to a file, one after the other in rank order,
+	a block at a time, with the header and footer of the format. Collective over MPI_COMM_WORLD. */
+
+	PROFILE_SCOPE(PROF_WRITE);
+	std::string head, tail;
+	if (rank == ROOT)
+		append_output_header(head, format);
+	if (rank == nprocs - 1)
+		append_output_footer(tail, format);
+
+	std::FILE* file = std::fopen(slicePath.c_str(), "rb");
+	std::fseek(file, 0, SEEK_END);
+	long long size = head.size() + std::ftell(file) + tail.size(), offset = output_offset(size, rank);
+	std::fclose(file);
+	MPI_File output = open_output(path);
+	auto write = [&](const char* data, std::size_t bytes) {
+		if (MPI_File_write_at(output, offset, data, bytes, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+			std::cout << "Error: could not write output file '" << path << "'" << std::endl;
+			exit(1);
+		}
+		offset += bytes;
+	};
+	write(head.data(), head.size());
+	read_slice(slicePath, write);
+	write(tail.data(), tail.size());
+	MPI_File_close(&output);
+	PROFILE_ADD(PROF_BYTES_WRITTEN, size);
+}
+
+#endif
@@ -0,0 +1,528 @@
+/*
+Group name: Kismet
+
+Continuous counting of a stream of lines (--stream), such as a live log piped into stdin or a FIFO,
+over a sliding window of time instead of fixed files.
+
+	- A reader thread on ROOT cuts the stream into batches of whole lines, and hands them over
+	  through a queue of at most --stream-queue batches. When the queue is full the reader stops
+	  reading, so a source faster than the counters is held back by the pipe itself (backpressure)
+	  rather than buffered without bound; the time the reader spends stalled is reported.
+	- ROOT sends the batches to the other processes, round-robin or to the one with the fewest
+	  batches outstanding (by load). A process acknowledges every batch it has counted, and has at
+	  most STREAM_CREDITS of them outstanding. With a single process ROOT counts the batches itself.
+	- Time is cut into buckets of --slide seconds, and the window holds the last --window seconds
+	  (a whole number of buckets; tumbling windows when both are equal). Every process counts into
+	  the open bucket; when ROOT closes the bucket, every process adds it to its window counter and
+	  subtracts the bucket falling out of the window, so no count is ever recounted.
+	- After every bucket the top words of the window over all the processes are picked with TPUT
+	  (TopK.h) and ROOT prints them, with the ingest rate of the bucket.
+
+Memory is bounded by (--stream-queue + STREAM_CREDITS * processes) batches of --batch-size bytes,
+plus the counters of the buckets of the window.
+*/
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <algorithm> 			// std::min
+#include <chrono> 				// std::chrono::duration
+#include <condition_variable> 	// std::condition_variable
+#include <deque> 				// std::deque
+#include <iostream> 			// std::cout
+#include <mutex> 				// std::mutex, std::unique_lock
+#include <string> 				// std::string
+#include <thread> 				// std::thread, std::this_thread
+#include <vector> 				// std::vector
+#include <cerrno> 				// errno
+#include <cmath> 				// std::floor
+#include <cstring> 				// std::memcpy
+#include <fcntl.h> 				// open
+#include <poll.h> 				// poll
+#include <unistd.h> 			// read, close
+#include <mpi.h>
+#include "Counter.h"
+#include "Tokenizer.h"
+#include "TopK.h"
+
+#ifndef ROOT
+#define ROOT 0
+#endif
+
+#define STREAM_CREDITS 2 			// batches a process has outstanding: one being counted, one waiting
+#define DEFAULT_STREAM_QUEUE 8 		// batches read ahead by ROOT
+#define DEFAULT_STREAM_TOP 10
+#define STREAM_POLL_SECONDS 0.0002 	// pause of ROOT while every process is busy
+#define STREAM_TAG_WORK 1 			// ROOT -> process: a batch, or the close of buckets
+#define STREAM_TAG_ACK 2 			// process -> ROOT: a batch was counted
+
+enum DispatchMode { DISPATCH_LOAD, DISPATCH_ROUND_ROBIN };
+
+struct StreamParams {
+	double window = 60; 			// seconds of the stream counted by a snapshot
+	double slide = 0; 				// seconds between snapshots, 0 for the window (tumbling)
+	long long batchSize = 256 << 10; 	// bytes of whole lines per batch
+	int queue = DEFAULT_STREAM_QUEUE; 	// batches read ahead by ROOT
+	DispatchMode dispatch = DISPATCH_LOAD;
+	double targetRate = 0; 			// MB/s the stream must be taken in at, 0 for none
+};
+
+class LineBatcher {
+	/* Reads a stream on a reader thread and cuts it into batches of whole lines of at most
+	`batchSize` bytes, queueing at most `capacity` of them. A batch is queued as soon as the source
+	has nothing more to give for now, so a slow stream is not held up waiting for a full batch. */
+
+public:
+	enum Status { BATCH_READY, BATCH_TIMEOUT, BATCH_END };
+
+	LineBatcher(const std::string& path, std::size_t batchSize, int capacity)
+		: batchSize(batchSize), capacity(capacity < 1 ? 1 : capacity) {
+		fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cout << "Error: could not open stream '" << path << "'" << std::endl;
+			exit(1);
+		}
+		reader = std::thread(&LineBatcher::read_loop, this);
+	}
+
+	~LineBatcher() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		spaceFree.notify_all();
+		reader.join();
+		if (fd != STDIN_FILENO)
+			close(fd);
+	}
+
+	LineBatcher(const LineBatcher&) = delete;
+	LineBatcher& operator=(const LineBatcher&) = delete;
+
+	Status next(std::string& batch, double timeout) {
+		/* Take the next batch, waiting at most `timeout` seconds for one. */
+
+		std::unique_lock<std::mutex> lock(mutex);
+		batchReady.wait_for(lock, std::chrono::duration<double>(std::max(0.0, timeout)),
+			[this] { return !batches.empty() || ended; });
+		if (failed) {
+			std::cout << "Error: could not read stream" << std::endl;
+			exit(1);
+		}
+		if (batches.empty())
+			return ended ? BATCH_END : BATCH_TIMEOUT;
+		batch = std::move(batches.front());
+		batches.pop_front();
+		spaceFree.notify_one();
+		return BATCH_READY;
+	}
+
+	void take_stats(long long& bytes, double& stalled) {
+		/* Bytes read and seconds spent stalled on a full queue since the last call. */
+
+		std::unique_lock<std::mutex> lock(mutex);
+		bytes = bytesRead;
+		stalled = stalledTime;
+		bytesRead = 0;
+		stalledTime = 0;
+	}
+
+private:
+	std::size_t batchSize;
+	std::size_t capacity;
+	int fd;
+	std::deque<std::string> batches;
+	long long bytesRead = 0;
+	double stalledTime = 0;
+	bool ended = false;
+	bool stopping = false;
+	bool failed = false;
+	std::mutex mutex;
+	std::condition_variable batchReady;
+	std::condition_variable spaceFree;
+	std::thread reader;
+
+	bool readable() {
+		/* Return true if the stream has more to give right away (data or its end). */
+
+		pollfd entry = { fd, POLLIN, 0 };
+		return poll(&entry, 1, 0) > 0;
+	}
+
+	void push(std::string& batch) {
+		/* Queue a batch, waiting while the queue is full. */
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (batches.size() >= capacity) {
+			auto stallStart = std::chrono::steady_clock::now();
+			spaceFree.wait(lock, [this] { return stopping || batches.size() < capacity; });
+			stalledTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+		}
+		batches.push_back(std::move(batch));
+		batchReady.notify_one();
+	}
+
+	void read_loop() {
+		/* Reader thread: read the stream until its end, batch after batch. */
+
+		std::string carry; // start of a line cut by the previous batch
+		bool end = false;
+		while (!end) {
+			std::string batch = std::move(carry);
+			carry.clear();
+			std::size_t used = batch.size();
+			batch.resize(std::max(batchSize, used + 1));
+
+			// read until the batch is full, or the stream has nothing more for now
+			do {
+				ssize_t got = read(fd, &batch[used], batch.size() - used);
+				if (got < 0 && errno == EINTR)
+					continue;
+				if (got < 0) {
+					std::unique_lock<std::mutex> lock(mutex);
+					failed = true;
+				}
+				if (got <= 0) {
+					end = true;
+					break;
+				}
+				used += got;
+				std::unique_lock<std::mutex> lock(mutex);
+				bytesRead += got;
+				if (stopping)
+					return;
+			} while (used < batch.size() && readable());
+			bool full = used == batch.size();
+			batch.resize(used);
+
+			// keep the last, unfinished line for the next batch; a line longer than a batch is cut
+			// after a delimiter, which never splits a word
+			if (!end) {
+				std::size_t cut = batch.rfind('\n');
+				if (cut == std::string::npos && full) {
+					cut = used;
+					while (cut > 0 && !tok_is_delimiter(batch[cut - 1]))
+						cut--;
+					cut = cut > 0 ? cut - 1 : used - 1;
+				}
+				if (cut == std::string::npos) {
+					carry = std::move(batch);
+					continue;
+				}
+				carry.assign(batch, cut + 1, std::string::npos);
+				batch.resize(cut + 1);
+			}
+			if (!batch.empty())
+				push(batch);
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		ended = true;
+		batchReady.notify_one();
+	}
+};
+
+class WindowCounter {
+	/* Counts of the words of the last `nbuckets` closed buckets of time, and of the open bucket.
+	A closed bucket is added to the window once, and subtracted once when it falls out of it. */
+
+public:
+	Counter window; 		// counts of the closed buckets of the window
+	long long words = 0; 	// words counted since the start of the stream
+
+	WindowCounter(int nbuckets) : nbuckets(nbuckets) {}
+
+	void add(std::string_view word) {
+		update_counter(open, word);
+		words++;
+	}
+
+	void close_bucket() {
+		/* Close the open bucket: add it to the window, and subtract the bucket that falls out. */
+
+		update_counter(window, open);
+		closed.push_back(std::move(open));
+		open = Counter();
+		if ((int) closed.size() > nbuckets) {
+			for (auto& entry: closed.front()) {
+				if (window.add(entry.first, -entry.second) == 0)
+					zeros++;
+			}
+			closed.pop_front();
+		}
+
+		// words gone from the window stay in its table with a count of 0 until they make up half of
+		// it, so the table is rebuilt once for every so many subtractions
+		if (zeros * 2 > (long long) window.size())
+			compact();
+	}
+
+	void compact() {
+		/* Drop the words with a count of 0 from the window. */
+
+		Counter kept;
+		kept.reserve(window.size() - zeros);
+		for (auto& entry: window) {
+			if (entry.second != 0)
+				kept.add(entry.first, entry.second);
+		}
+		window = std::move(kept);
+		zeros = 0;
+	}
+
+private:
+	int nbuckets;
+	Counter open; 					// counts of the open bucket
+	std::deque<Counter> closed; 	// the closed buckets of the window, oldest first
+	long long zeros = 0; 			// words of `window` with a count of 0
+};
+
+void window_snapshot(WindowCounter& counter, long long k, Counter& topCounter, long long& windowWords,
+	int rank, int nprocs) {
+	/* Top `k` words of the windows of every process, and the number of words in them [ROOT use
+	only]. Collective over MPI_COMM_WORLD. */
+
+	Counter top;
+	top_k_tput(counter.window, k, top, rank, nprocs);
+	topCounter = Counter();
+	for (auto& entry: top) {
+		if (entry.second > 0) // words gone from the windows, when fewer than k are left
+			topCounter.add(entry.first, entry.second);
+	}
+	long long eachWords = get_counter_total(counter.window);
+	MPI_Reduce(&eachWords, &windowWords, 1, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+}
+
+void print_snapshot(const Counter& topCounter, long long k, long long windowWords, double windowStart,
+	double windowEnd, long long bytes, double seconds, double stalled, double targetRate, bool final) {
+	/* Print a snapshot of the window, with the ingest rate of the stream since the last one. */
+
+	double rate = seconds > 0 ? bytes / 1e6 / seconds : 0;
+	std::cout << (final ? "Final window " : "Window ") << windowStart << " - " << windowEnd << " s: "
+		<< windowWords << " words, ingest " << rate << " MB/s, reader stalled " << stalled << " s" << std::endl;
+	if (targetRate > 0 && stalled > 0 && rate < targetRate)
+		std::cout << "Warning: falling behind the target ingest rate of " << targetRate << " MB/s" << std::endl;
+	std::cout << "Top " << k << " words:" << std::endl;
+	print_counter(topCounter, most_common);
+}
+
+class StreamDispatcher {
+	/* ROOT's side of the stream: sends the batches to the processes, keeping track of the batches
+	outstanding on each, and tells them when to close a bucket. */
+
+public:
+	StreamDispatcher(MPI_Comm comm, int nprocs, DispatchMode dispatch)
+		: comm(comm), nprocs(nprocs), dispatch(dispatch), outstanding(nprocs, 0) {
+		MPI_Irecv(nullptr, 0, MPI_CHAR, MPI_ANY_SOURCE, STREAM_TAG_ACK, comm, &ackRequest);
+	}
+
+	int pick() {
+		/* Return the process to send the next batch to, or -1 if it has no credit left. */
+
+		progress();
+		int r = next;
+		if (dispatch == DISPATCH_LOAD) {
+			for (int i = 1; i < nprocs; i++) {
+				int candidate = 1 + (next - 1 + i) % (nprocs - 1);
+				if (outstanding[candidate] < outstanding[r])
+					r = candidate;
+			}
+		}
+		return outstanding[r] < STREAM_CREDITS ? r : -1;
+	}
+
+	void send_batch(int r, std::string& batch) {
+		batch.insert(batch.begin(), 'B');
+		send(r, batch);
+		outstanding[r]++;
+		next = 1 + r % (nprocs - 1);
+	}
+
+	void send_close(long long buckets, bool final) {
+		/* Tell every process to close `buckets` buckets, the last one if `final`. */
+
+		std::string message(1, final ? 'F' : 'C');
+		message.append((const char*) &buckets, sizeof(buckets));
+		for (int r = 1; r < nprocs; r++) {
+			std::string copy = message;
+			send(r, copy);
+		}
+	}
+
+	void finish() {
+		/* Wait for the last acknowledgements and sends, once the processes have stopped. */
+
+		long long left = 0;
+		for (int count: outstanding)
+			left += count;
+		while (left-- > 0) {
+			MPI_Status status;
+			MPI_Wait(&ackRequest, &status);
+			outstanding[status.MPI_SOURCE]--;
+			MPI_Irecv(nullptr, 0, MPI_CHAR, MPI_ANY_SOURCE, STREAM_TAG_ACK, comm, &ackRequest);
+		}
+		MPI_Cancel(&ackRequest);
+		MPI_Wait(&ackRequest, MPI_STATUS_IGNORE);
+		for (auto& message: sends)
+			MPI_Wait(&message.request, MPI_STATUS_IGNORE);
+		sends.clear();
+	}
+
+private:
+	struct Outgoing {
+		std::string buffer;
+		MPI_Request request;
+	};
+
+	MPI_Comm comm;
+	int nprocs;
+	DispatchMode dispatch;
+	std::vector<int> outstanding; 	// batches sent to each process and not yet acknowledged
+	int next = 1; 					// next process in turn
+	MPI_Request ackRequest;
+	std::deque<Outgoing> sends; 	// messages in flight, oldest first
+
+	void send(int r, std::string& buffer) {
+		sends.push_back({ std::move(buffer), MPI_REQUEST_NULL });
+		Outgoing& message = sends.back();
+		MPI_Isend(message.buffer.data(), message.buffer.size(), MPI_CHAR, r, STREAM_TAG_WORK, comm, &message.request);
+	}
+
+	void progress() {
+		/* Take in the acknowledgements, and release the messages sent, without blocking. */
+
+		int done = 1;
+		while (done) {
+			MPI_Status status;
+			MPI_Test(&ackRequest, &done, &status);
+			if (done) {
+				outstanding[status.MPI_SOURCE]--;
+				MPI_Irecv(nullptr, 0, MPI_CHAR, MPI_ANY_SOURCE, STREAM_TAG_ACK, comm, &ackRequest);
+			}
+		}
+		while (!sends.empty()) {
+			MPI_Test(&sends.front().request, &done, MPI_STATUS_IGNORE);
+			if (!done)
+				break;
+			sends.pop_front();
+		}
+	}
+};
+
+void stream_count(const std::string& path, const StreamParams& params, int minWordLen, int maxWordLen,
+	long long top, int rank, int nprocs) {
+	/* Count the words of a stream of lines ("-" for stdin) over a sliding window until its end,
+	printing the top words of the window after every bucket [ROOT]. Collective over
+	MPI_COMM_WORLD. */
+
+	double slide = params.slide > 0 ? params.slide : params.window;
+	int nbuckets = (int) (params.window / slide + 0.5);
+	long long k = top > 0 ? top : DEFAULT_STREAM_TOP;
+	MPI_Comm comm;
+	MPI_Comm_dup(MPI_COMM_WORLD, &comm); // keeps the stream apart from the snapshot collectives
+
+	Tokenizer tokenizer(minWordLen, maxWordLen);
+	WindowCounter counter(nbuckets);
+	auto count_batch = [&](const char* data, std::size_t size) {
+		tokenizer.tokenize(data, size, [&counter](std::string_view word) { counter.add(word); });
+	};
+
+	Counter topCounter;
+	long long windowWords = 0, bytes = 0, totalBytes = 0;
+	double stalled = 0, totalStalled = 0;
+	MPI_Barrier(MPI_COMM_WORLD);
+	double startTime = MPI_Wtime();
+
+	if (rank == ROOT) {
+		LineBatcher batcher(path, params.batchSize, params.queue);
+		StreamDispatcher dispatcher(comm, nprocs, params.dispatch);
+		long long closedBuckets = 0; // buckets closed so far
+		double lastSnapshot = startTime;
+		std::string batch;
+		bool final = false;
+
+		while (!final) {
+			double now = MPI_Wtime();
+			double bucketEnd = startTime + (closedBuckets + 1) * slide;
+			LineBatcher::Status status = LineBatcher::BATCH_TIMEOUT;
+			if (now < bucketEnd) {
+				// a process with a credit left, or ROOT itself when it is the only one
+				int r = nprocs > 1 ? dispatcher.pick() : ROOT;
+				if (r < 0) {
+					std::this_thread::sleep_for(std::chrono::duration<double>(STREAM_POLL_SECONDS));
+					continue;
+				}
+				status = batcher.next(batch, bucketEnd - now);
+				if (status == LineBatcher::BATCH_READY) {
+					if (r == ROOT)
+						count_batch(batch.data(), batch.size());
+					else
+						dispatcher.send_batch(r, batch);
+					continue;
+				}
+				now = MPI_Wtime();
+			}
+
+			// close the buckets that are over (several, if ROOT fell behind), or the last one at the
+			// end of the stream
+			final = status == LineBatcher::BATCH_END;
+			long long buckets = final ? 1 : (long long) std::floor((now - startTime) / slide) - closedBuckets;
+			if (buckets < 1)
+				continue;
+			closedBuckets += buckets;
+			dispatcher.send_close(buckets, final);
+			for (long long i = 0; i < buckets; i++)
+				counter.close_bucket();
+			window_snapshot(counter, k, topCounter, windowWords, rank, nprocs);
+
+			batcher.take_stats(bytes, stalled);
+			totalBytes += bytes;
+			totalStalled += stalled;
+			double windowEnd = final ? now - startTime : closedBuckets * slide;
+			double windowStart = std::max(0.0, (closedBuckets - nbuckets) * slide);
+			print_snapshot(topCounter, k, windowWords, windowStart, windowEnd, bytes, now - lastSnapshot, stalled,
+				params.targetRate, final);
+			lastSnapshot = now;
+		}
+		dispatcher.finish();
+	} else {
+		std::string message;
+		while (true) {
+			MPI_Status status;
+			int size;
+			MPI_Probe(ROOT, STREAM_TAG_WORK, comm, &status);
+			MPI_Get_count(&status, MPI_CHAR, &size);
+			message.resize(size);
+			MPI_Recv(&message[0], size, MPI_CHAR, ROOT, STREAM_TAG_WORK, comm, MPI_STATUS_IGNORE);
+			if (message[0] == 'B') {
+				count_batch(message.data() + 1, message.size() - 1);
+				MPI_Send(nullptr, 0, MPI_CHAR, ROOT, STREAM_TAG_ACK, comm);
+				continue;
+			}
+			long long buckets;
+			std::memcpy(&buckets, message.data() + 1, sizeof(buckets));
+			for (long long i = 0; i < buckets; i++)
+				counter.close_bucket();
+			window_snapshot(counter, k, topCounter, windowWords, rank, nprocs);
+			if (message[0] == 'F')
+				break;
+		}
+	}
+
+	// Summary of the whole stream
+	counter.compact();
+	long long uniqueWords = count_unique_words(counter.window, nprocs);
+	long long totalWords = 0;
+	MPI_Reduce(&counter.words, &totalWords, 1, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+	MPI_Comm_free(&comm);
+	if (rank == ROOT) {
+		double seconds = MPI_Wtime() - startTime;
+		std::cout << "Unique words in the final window: " << uniqueWords << std::endl;
+		std::cout << "Stream: " << totalBytes / 1e6 << " MB in " << seconds << " s ("
+			<< (seconds > 0 ? totalBytes / 1e6 / seconds : 0) << " MB/s), reader stalled " << totalStalled << " s" << std::endl;
+		std::cout << "Total words : " << totalWords << std::endl;
+		std::cout << "Total time : " << seconds << std::endl;
+	}
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+Group name: Kismet
+
+Small fixed-size thread pool used to parallelize work within a single MPI process. The pool
+runs one task on all of its threads at once (fork-join), the calling thread taking part as
+thread 0. Worker threads never call MPI, so MPI_THREAD_FUNNELED is enough.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable> 	// std::condition_variable
+#include <cstdlib> 				// std::getenv, std::atoi
+#include <functional> 			// std::function
+#include <mutex> 				// std::mutex, std::unique_lock
+#include <thread> 				// std::thread
+#include <vector> 				// std::vector
+
+class ThreadPool {
+public:
+	explicit ThreadPool(int nthreads) : nthreads(nthreads < 1 ? 1 : nthreads) {
+		for (int t = 1; t < this->nthreads; t++)
+			workers.emplace_back(&ThreadPool::worker_loop, this, t);
+	}
+
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+			generation++;
+		}
+		taskReady.notify_all();
+		for (std::thread& worker: workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int size() const { return nthreads; }
+
+	void run(const std::function<void(int)>& task) {
+		/* Call `task(t)` on every thread t of the pool and wait until all calls have returned. */
+
+		if (nthreads == 1) {
+			task(0);
+			return;
+		}
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			currentTask = &task;
+			running = nthreads - 1;
+			generation++;
+		}
+		taskReady.notify_all();
+
+		task(0); // the calling thread is thread 0
+
+		std::unique_lock<std::mutex> lock(mutex);
+		taskDone.wait(lock, [this] { return running == 0; });
+		currentTask = nullptr;
+	}
+
+private:
+	int nthreads;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable taskReady;
+	std::condition_variable taskDone;
+	const std::function<void(int)>* currentTask = nullptr;
+	int running = 0; 				// number of worker threads still running the current task
+	unsigned long generation = 0; 	// incremented every time a task is started
+	bool stopping = false;
+
+	void worker_loop(int t) {
+		unsigned long seen = 0;
+		while (true) {
+			const std::function<void(int)>* task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				taskReady.wait(lock, [this, seen] { return generation != seen; });
+				seen = generation;
+				if (stopping)
+					return;
+				task = currentTask;
+			}
+			(*task)(t);
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (--running == 0)
+					taskDone.notify_one();
+			}
+		}
+	}
+};
+
+int get_default_thread_count() {
+	/* Number of threads to use when none is given on the command line: OMP_NUM_THREADS if it is
+	set, otherwise 1. */
+
+	const char* env = std::getenv("OMP_NUM_THREADS");
+	int nthreads = env ? std::atoi(env) : 1;
+	return nthreads > 0 ? nthreads : 1;
+}
+
+#endif
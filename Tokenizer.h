@@ -0,0 +1,419 @@
+/*
+Group name: Kismet
+
+Word tokenizer used by `process_lines()`. Produces exactly the same words as the regex
+	((?!\d)[^\W_]+(?:['_-][^\W_]+)*)
+followed by the min/max word length filter and conversion to lowercase, i.e. a word
+	- starts with a letter (leading digits of a run are skipped),
+	- is made of alphanumeric runs joined by a single `'`, `_` or `-` character.
+
+Work is done in two passes over a window of the input:
+	1. classify: every byte is lowercased into a scratch buffer while a bitmap of alphanumeric
+	   positions is built (lookup table, SSE2 or AVX2, picked at runtime)
+	2. extract: words are found by bit-scanning the bitmap and are handed out as
+	   `std::string_view`s into the lowercased scratch buffer
+*/
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <algorithm> 		// std::min
+#include <cstddef> 			// std::size_t
+#include <cstdint> 			// std::uint8_t, std::uint64_t
+#include <cstring> 			// std::memchr
+#include <string> 			// std::string
+#include <string_view> 		// std::string_view
+#include <vector> 			// std::vector
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> 		// SSE2/AVX2 intrinsics
+#define TOKENIZER_X86 1
+#endif
+
+// character classes of the lookup table
+#define TOK_ALNUM 	0x01 // [A-Za-z0-9]
+#define TOK_DIGIT 	0x02 // [0-9]
+#define TOK_JOINER 	0x04 // ['_-]
+
+// size of a window of input that is classified and extracted in one go
+#define TOK_WINDOW_SIZE (64 * 1024)
+
+enum TokenizerIsa { TOK_ISA_SCALAR, TOK_ISA_SSE2, TOK_ISA_AVX2 };
+
+struct TokenizerTables {
+	/* Byte classification and lowercase lookup tables, built once. */
+
+	std::uint8_t cls[256];
+	char lower[256];
+
+	TokenizerTables() {
+		for (int c = 0; c < 256; c++) {
+			cls[c] = 0;
+			lower[c] = (char) c;
+			if (c >= 'A' && c <= 'Z') {
+				cls[c] = TOK_ALNUM;
+				lower[c] = (char) (c - 'A' + 'a');
+			}
+			if (c >= 'a' && c <= 'z')
+				cls[c] = TOK_ALNUM;
+			if (c >= '0' && c <= '9')
+				cls[c] = TOK_ALNUM | TOK_DIGIT;
+			if (c == '\'' || c == '_' || c == '-')
+				cls[c] = TOK_JOINER;
+		}
+	}
+};
+
+static const TokenizerTables tokTables;
+
+inline bool tok_is_delimiter(char c) {
+	/* A delimiter can never be part of a word, so the input can be safely split right after it. */
+
+	return tokTables.cls[(std::uint8_t) c] == 0;
+}
+
+static void classify_scalar(const char* in, std::size_t n, char* out, std::uint64_t* mask) {
+	/* Lowercase `n` bytes of `in` into `out` and set the bit of every alphanumeric byte in
+	`mask` (which holds at least (n + 63) / 64 zeroed words). */
+
+	for (std::size_t i = 0; i < n; i++) {
+		std::uint8_t c = (std::uint8_t) in[i];
+		out[i] = tokTables.lower[c];
+		mask[i >> 6] |= (std::uint64_t) (tokTables.cls[c] & TOK_ALNUM) << (i & 63);
+	}
+}
+
+#ifdef TOKENIZER_X86
+static void classify_sse2(const char* in, std::size_t n, char* out, std::uint64_t* mask) {
+	/* SSE2 version of `classify_scalar()`, 16 bytes at a time. Signed byte comparisons keep
+	non-ASCII bytes (negative values) out of every range. */
+
+	const __m128i upperLo = _mm_set1_epi8('A' - 1), upperHi = _mm_set1_epi8('Z' + 1);
+	const __m128i lowerLo = _mm_set1_epi8('a' - 1), lowerHi = _mm_set1_epi8('z' + 1);
+	const __m128i digitLo = _mm_set1_epi8('0' - 1), digitHi = _mm_set1_epi8('9' + 1);
+	const __m128i caseBit = _mm_set1_epi8(0x20);
+
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (in + i));
+		__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, upperLo), _mm_cmplt_epi8(v, upperHi));
+		__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, lowerLo), _mm_cmplt_epi8(v, lowerHi));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, digitLo), _mm_cmplt_epi8(v, digitHi));
+		__m128i alnum = _mm_or_si128(_mm_or_si128(upper, lower), digit);
+
+		_mm_storeu_si128((__m128i*) (out + i), _mm_or_si128(v, _mm_and_si128(upper, caseBit)));
+		std::uint64_t bits = (std::uint32_t) _mm_movemask_epi8(alnum);
+		mask[i >> 6] |= bits << (i & 63);
+	}
+	for (; i < n; i++) { // tail shorter than a vector
+		std::uint8_t c = (std::uint8_t) in[i];
+		out[i] = tokTables.lower[c];
+		mask[i >> 6] |= (std::uint64_t) (tokTables.cls[c] & TOK_ALNUM) << (i & 63);
+	}
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* in, std::size_t n, char* out, std::uint64_t* mask) {
+	/* AVX2 version of `classify_scalar()`, 32 bytes at a time. */
+
+	const __m256i upperLo = _mm256_set1_epi8('A' - 1), upperHi = _mm256_set1_epi8('Z' + 1);
+	const __m256i lowerLo = _mm256_set1_epi8('a' - 1), lowerHi = _mm256_set1_epi8('z' + 1);
+	const __m256i digitLo = _mm256_set1_epi8('0' - 1), digitHi = _mm256_set1_epi8('9' + 1);
+	const __m256i caseBit = _mm256_set1_epi8(0x20);
+
+	std::size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (in + i));
+		__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, upperLo), _mm256_cmpgt_epi8(upperHi, v));
+		__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, lowerLo), _mm256_cmpgt_epi8(lowerHi, v));
+		__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, digitLo), _mm256_cmpgt_epi8(digitHi, v));
+		__m256i alnum = _mm256_or_si256(_mm256_or_si256(upper, lower), digit);
+
+		_mm256_storeu_si256((__m256i*) (out + i), _mm256_or_si256(v, _mm256_and_si256(upper, caseBit)));
+		std::uint64_t bits = (std::uint32_t) _mm256_movemask_epi8(alnum);
+		mask[i >> 6] |= bits << (i & 63);
+	}
+	for (; i < n; i++) {
+		std::uint8_t c = (std::uint8_t) in[i];
+		out[i] = tokTables.lower[c];
+		mask[i >> 6] |= (std::uint64_t) (tokTables.cls[c] & TOK_ALNUM) << (i & 63);
+	}
+}
+#endif
+
+inline TokenizerIsa tokenizer_best_isa() {
+	/* Return the widest instruction set supported by the running CPU. */
+
+#ifdef TOKENIZER_X86
+	static const TokenizerIsa best = __builtin_cpu_supports("avx2") ? TOK_ISA_AVX2
+		: (__builtin_cpu_supports("sse2") ? TOK_ISA_SSE2 : TOK_ISA_SCALAR);
+	return best;
+#else
+	return TOK_ISA_SCALAR;
+#endif
+}
+
+inline const char* tokenizer_isa_name(TokenizerIsa isa) {
+	switch (isa) {
+		case TOK_ISA_AVX2: return "avx2";
+		case TOK_ISA_SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+class Tokenizer {
+	/* Split text into lowercased words of `minWordLen` to `maxWordLen` characters. A Tokenizer
+	keeps its scratch buffers between calls, so keep one per thread and reuse it. Words handed to
+	the callback are only valid until the callback returns.
+	*/
+
+public:
+	Tokenizer(int minWordLen, int maxWordLen, TokenizerIsa isa = tokenizer_best_isa())
+		: minWordLen(minWordLen), maxWordLen(maxWordLen), isa(isa) {
+		switch (isa) {
+#ifdef TOKENIZER_X86
+			case TOK_ISA_AVX2: classify = classify_avx2; break;
+			case TOK_ISA_SSE2: classify = classify_sse2; break;
+#endif
+			default: classify = classify_scalar; this->isa = TOK_ISA_SCALAR; break;
+		}
+	}
+
+	TokenizerIsa get_isa() const { return isa; }
+
+	template <typename Emit>
+	void tokenize(const char* data, std::size_t size, Emit&& emit) {
+		/* Call `emit(std::string_view word)` for every word in `data`. The input is processed in
+		windows which always end right after a delimiter, so no word is ever split. */
+
+		std::size_t pos = 0;
+		while (pos < size) {
+			std::size_t end = size;
+			if (size - pos > TOK_WINDOW_SIZE) {
+				// move the end of the window back to just after the last delimiter, or forward
+				// past the first one if the window has none (e.g. a giant run of letters)
+				end = pos + TOK_WINDOW_SIZE;
+				std::size_t cut = end;
+				while (cut > pos && !tok_is_delimiter(data[cut - 1]))
+					cut--;
+				if (cut == pos) {
+					while (end < size && !tok_is_delimiter(data[end - 1]))
+						end++;
+				} else {
+					end = cut;
+				}
+			}
+			tokenize_window(data + pos, end - pos, emit);
+			pos = end;
+		}
+	}
+
+	template <typename Emit>
+	void tokenize(std::string_view text, Emit&& emit) {
+		tokenize(text.data(), text.size(), emit);
+	}
+
+private:
+	int minWordLen;
+	int maxWordLen;
+	TokenizerIsa isa;
+	void (*classify)(const char*, std::size_t, char*, std::uint64_t*);
+	std::string lowered; 				// lowercased copy of the current window
+	std::vector<std::uint64_t> mask; 	// bit i set if byte i of the window is alphanumeric
+
+	bool is_alnum(std::size_t i) const {
+		return (mask[i >> 6] >> (i & 63)) & 1;
+	}
+
+	std::size_t next_set(std::size_t i, std::size_t n) const {
+		/* Return the position of the first alphanumeric byte at or after `i`, or `n`. */
+
+		while (i < n) {
+			std::uint64_t bits = mask[i >> 6] >> (i & 63);
+			if (bits)
+				return std::min(n, i + __builtin_ctzll(bits));
+			i = (i | 63) + 1; // start of the next mask word
+		}
+		return n;
+	}
+
+	std::size_t next_clear(std::size_t i, std::size_t n) const {
+		/* Return the position of the first non-alphanumeric byte at or after `i`, or `n`. */
+
+		while (i < n) {
+			std::uint64_t bits = ~mask[i >> 6] >> (i & 63);
+			if (bits)
+				return std::min(n, i + __builtin_ctzll(bits));
+			i = (i | 63) + 1;
+		}
+		return n;
+	}
+
+	template <typename Emit>
+	void tokenize_window(const char* data, std::size_t n, Emit& emit) {
+		if (lowered.size() < n)
+			lowered.resize(n);
+		mask.assign((n + 63) / 64, 0);
+		classify(data, n, &lowered[0], mask.data());
+
+		const char* text = lowered.data();
+		std::size_t i = 0;
+		while ((i = next_set(i, n)) < n) {
+			// a word cannot start with a digit, skip the digits at the front of the run
+			while (i < n && (tokTables.cls[(std::uint8_t) text[i]] & TOK_DIGIT))
+				i++;
+			if (i == n || !is_alnum(i))
+				continue;
+
+			// consume alphanumeric runs, joined by a single joiner character
+			std::size_t start = i;
+			i = next_clear(i, n);
+			while (i + 1 < n && (tokTables.cls[(std::uint8_t) text[i]] & TOK_JOINER) && is_alnum(i + 1))
+				i = next_clear(i + 1, n);
+
+			std::size_t len = i - start;
+			if (len < (std::size_t) minWordLen || len > (std::size_t) maxWordLen)
+				continue; // skip if word length is smaller than min or larger than max
+			emit(std::string_view(text + start, len));
+		}
+	}
+};
+
+class StreamTokenizer {
+	/* Tokenizer for text arriving in blocks that may cut words anywhere, e.g. fixed-size reads
+	of a file. Produces the same words as tokenizing the concatenated blocks in one go.
+
+	Most of each block is handed to the Tokenizer: everything from the first point where no word
+	is in progress up to just after its last delimiter. Only the edges of a block (the word carried
+	over from the previous block and the tail after the last delimiter) go byte by byte through a
+	small state machine, which keeps at most `maxWordLen` characters of the word in progress, so
+	memory stays bounded however long a run without delimiters is. Call `finish()` after the last
+	block.
+	*/
+
+public:
+	StreamTokenizer(int minWordLen, int maxWordLen, TokenizerIsa isa = tokenizer_best_isa())
+		: tokenizer(minWordLen, maxWordLen, isa), minWordLen(minWordLen), maxWordLen(maxWordLen) {
+		word.reserve(maxWordLen);
+	}
+
+	template <typename Emit>
+	void tokenize(const char* data, std::size_t size, Emit&& emit) {
+		/* Call `emit(std::string_view word)` for every word completed by this block. */
+
+		// finish the word (or digit run) carried over from the previous block
+		std::size_t begin = 0;
+		while (begin < size && state != EDGE_IDLE)
+			step(data[begin++], emit);
+
+		// the bulk of the block, up to just after its last delimiter
+		std::size_t end = size;
+		while (end > begin && !tok_is_delimiter(data[end - 1]))
+			end--;
+		if (end > begin)
+			tokenizer.tokenize(data + begin, end - begin, emit);
+
+		// the tail may end in the middle of a word
+		for (std::size_t i = std::max(begin, end); i < size; i++)
+			step(data[i], emit);
+	}
+
+	template <typename Emit>
+	void finish(Emit&& emit) {
+		/* Emit the word in progress at the end of the stream, if any. */
+
+		if (state == EDGE_WORD || state == EDGE_JOINER)
+			end_word(emit);
+		state = EDGE_IDLE;
+	}
+
+private:
+	enum EdgeState {
+		EDGE_IDLE, 		// not in a word, the next letter starts one
+		EDGE_DIGITS, 	// skipping the leading digits of an alphanumeric run
+		EDGE_WORD, 		// in a word, after an alphanumeric character
+		EDGE_JOINER 	// in a word, after a joiner that still needs an alphanumeric to follow
+	};
+
+	Tokenizer tokenizer;
+	int minWordLen;
+	int maxWordLen;
+	EdgeState state = EDGE_IDLE;
+	std::string word; 		// lowercased start of the word in progress, at most maxWordLen chars
+	std::size_t wordLen = 0; // full length of the word in progress
+	char joiner = 0; 		// pending joiner of EDGE_JOINER
+
+	void append(char c) {
+		if (wordLen++ < (std::size_t) maxWordLen)
+			word += tokTables.lower[(std::uint8_t) c];
+	}
+
+	template <typename Emit>
+	void end_word(Emit& emit) {
+		if (wordLen >= (std::size_t) minWordLen && wordLen <= (std::size_t) maxWordLen)
+			emit(std::string_view(word));
+		word.clear();
+		wordLen = 0;
+	}
+
+	template <typename Emit>
+	void step(char c, Emit& emit) {
+		/* Advance the state machine by one byte, mirroring `Tokenizer::tokenize_window()`. */
+
+		std::uint8_t cls = tokTables.cls[(std::uint8_t) c];
+		switch (state) {
+			case EDGE_IDLE:
+			case EDGE_DIGITS:
+				if (cls & TOK_DIGIT) {
+					state = EDGE_DIGITS;
+				} else if (cls & TOK_ALNUM) {
+					append(c);
+					state = EDGE_WORD;
+				} else {
+					state = EDGE_IDLE;
+				}
+				break;
+			case EDGE_WORD:
+				if (cls & TOK_ALNUM) {
+					append(c);
+				} else if (cls & TOK_JOINER) {
+					joiner = c;
+					state = EDGE_JOINER;
+				} else {
+					end_word(emit);
+					state = EDGE_IDLE;
+				}
+				break;
+			case EDGE_JOINER:
+				if (cls & TOK_ALNUM) {
+					append(joiner);
+					append(c);
+					state = EDGE_WORD;
+				} else {
+					end_word(emit); // the joiner is not part of the word
+					state = EDGE_IDLE;
+				}
+				break;
+		}
+	}
+};
+
+template <typename AnyTokenizer, typename Emit>
+void tokenize_by_line(AnyTokenizer& tokenizer, const char* data, std::size_t size, Emit&& emit) {
+	/* Same as `tokenizer.tokenize(data, size, emit)` (for a Tokenizer or a StreamTokenizer), but
+	also calls `emit` with an empty word after every newline, so the caller can tell which words
+	share a line (a word is never empty). A newline ends any word, so a StreamTokenizer never
+	carries a word over one. */
+
+	const char* end = data + size;
+	while (data < end) {
+		const char* newline = (const char*) std::memchr(data, '\n', end - data);
+		const char* lineEnd = newline ? newline + 1 : end;
+		tokenizer.tokenize(data, lineEnd - data, emit);
+		if (newline)
+			emit(std::string_view());
+		data = lineEnd;
+	}
+}
+
+#endif
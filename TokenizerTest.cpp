@@ -0,0 +1,215 @@
+/*
+Differential test for the Tokenizer in "Tokenizer.h"; checks that every instruction set path
+produces exactly the same words as the regex previously used by `process_lines()`, that the
+StreamTokenizer does too whatever the block boundaries, and that `tokenize_by_line()` marks the
+end of every line.
+
+Compile with:
+	$ g++ -std=c++17 -O2 TokenizerTest.cpp -o TokenizerTest
+
+Run with (from the repository root, so the test files can be found):
+	$ ./TokenizerTest
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Tokenizer.h"
+
+std::vector<std::string> regex_words(const std::string& text, int minWordLen, int maxWordLen) {
+	/* Reference implementation: the word extraction loop of the original `process_lines()`,
+	applied line by line. */
+
+	std::regex wordRegex("((?!\\d)[^\\W_]+(?:['_-][^\\W_]+)*)");
+	std::vector<std::string> words;
+	std::stringstream ss(text);
+	std::string line;
+
+	while (std::getline(ss, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.erase(line.end() - 1);
+		for (std::sregex_iterator it(line.begin(), line.end(), wordRegex), end; it != end; ++it) {
+			std::string word = it->str();
+			if (word.length() < (size_t) minWordLen || word.length() > (size_t) maxWordLen)
+				continue;
+			std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+			words.push_back(word);
+		}
+	}
+	return words;
+}
+
+std::vector<std::string> tokenizer_words(const std::string& text, int minWordLen, int maxWordLen,
+	TokenizerIsa isa) {
+	/* Words of the whole text, tokenized in one call (no line splitting). */
+
+	Tokenizer tokenizer(minWordLen, maxWordLen, isa);
+	std::vector<std::string> words;
+	tokenizer.tokenize(text.data(), text.size(), [&words](std::string_view word) {
+		words.emplace_back(word);
+	});
+	return words;
+}
+
+std::vector<std::string> stream_words(const std::string& text, int minWordLen, int maxWordLen,
+	std::size_t blockSize) {
+	/* Words of the whole text, fed to a StreamTokenizer in blocks of `blockSize` bytes. */
+
+	StreamTokenizer tokenizer(minWordLen, maxWordLen);
+	std::vector<std::string> words;
+	auto addWord = [&words](std::string_view word) {
+		words.emplace_back(word);
+	};
+	for (std::size_t pos = 0; pos < text.size(); pos += blockSize)
+		tokenizer.tokenize(text.data() + pos, std::min(blockSize, text.size() - pos), addWord);
+	tokenizer.finish(addWord);
+	return words;
+}
+
+std::vector<std::string> regex_line_words(const std::string& text, int minWordLen, int maxWordLen) {
+	/* Reference for `tokenize_by_line()`: the words of every line, each line followed by an empty
+	word if it ends with a newline. */
+
+	std::vector<std::string> words;
+	std::size_t begin = 0;
+	while (begin < text.size()) {
+		std::size_t newline = text.find('\n', begin);
+		std::size_t end = newline == std::string::npos ? text.size() : newline;
+		for (std::string& word : regex_words(text.substr(begin, end - begin), minWordLen, maxWordLen))
+			words.push_back(word);
+		if (newline == std::string::npos)
+			break;
+		words.push_back("");
+		begin = newline + 1;
+	}
+	return words;
+}
+
+std::vector<std::string> stream_line_words(const std::string& text, int minWordLen, int maxWordLen,
+	std::size_t blockSize) {
+	/* Words and line ends of the whole text, fed to `tokenize_by_line()` with a StreamTokenizer in
+	blocks of `blockSize` bytes. */
+
+	StreamTokenizer tokenizer(minWordLen, maxWordLen);
+	std::vector<std::string> words;
+	auto addWord = [&words](std::string_view word) {
+		words.emplace_back(word);
+	};
+	for (std::size_t pos = 0; pos < text.size(); pos += blockSize)
+		tokenize_by_line(tokenizer, text.data() + pos, std::min(blockSize, text.size() - pos), addWord);
+	tokenizer.finish(addWord);
+	return words;
+}
+
+bool compare(const std::string& name, const std::string& text, int minWordLen, int maxWordLen) {
+	/* Compare the tokenizer with the regex for every supported instruction set. */
+
+	std::vector<std::string> expected = regex_words(text, minWordLen, maxWordLen);
+	bool ok = true;
+
+	for (TokenizerIsa isa : {TOK_ISA_SCALAR, TOK_ISA_SSE2, TOK_ISA_AVX2}) {
+		if (isa > tokenizer_best_isa())
+			continue; // not supported by this CPU
+
+		std::vector<std::string> actual = tokenizer_words(text, minWordLen, maxWordLen, isa);
+		if (actual != expected) {
+			size_t i = 0;
+			while (i < actual.size() && i < expected.size() && actual[i] == expected[i])
+				i++;
+			std::cout << "FAIL " << name << " [" << minWordLen << ", " << maxWordLen << "] "
+				<< tokenizer_isa_name(isa) << ": word #" << i << " is '"
+				<< (i < actual.size() ? actual[i] : "<none>") << "', expected '"
+				<< (i < expected.size() ? expected[i] : "<none>") << "'" << std::endl;
+			ok = false;
+		}
+	}
+	for (std::size_t blockSize : {1, 3, 64, 4097, TOK_WINDOW_SIZE + 1}) {
+		if (stream_words(text, minWordLen, maxWordLen, blockSize) != expected) {
+			std::cout << "FAIL " << name << " [" << minWordLen << ", " << maxWordLen << "] stream, "
+				<< blockSize << " byte blocks" << std::endl;
+			ok = false;
+		}
+	}
+	if (ok)
+		std::cout << "ok   " << name << " [" << minWordLen << ", " << maxWordLen << "] "
+			<< expected.size() << " words" << std::endl;
+	return ok;
+}
+
+int main() {
+	bool ok = true;
+	int lengthBounds[][2] = { {1, 20}, {3, 8}, {1, 1000}, {5, 5} };
+
+	// The corpora shipped with the repository ...
+	std::vector<std::string> filenames = {
+		"test-data/fruits1.txt", "test-data/fruits2.txt", "test-data/fruits3.txt",
+		"test-data/fruits-all.txt", "ascii-only/shelly.txt"
+	};
+	for (std::string& filename : filenames) {
+		std::ifstream inFile(filename, std::ios::binary);
+		if (!inFile.is_open()) {
+			std::cout << "Error: could not open file '" << filename << "'" << std::endl;
+			return 1;
+		}
+		std::string text((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+		for (auto& bounds : lengthBounds)
+			ok &= compare(filename, text, bounds[0], bounds[1]);
+	}
+
+	// Hand-picked edge cases ...
+	std::string edgeCases =
+		"Don't stop-me now\n"
+		"9am 12-ab 1a2b3c a1-2 x_9y 2nd-hand\n"
+		"a--b a-b- -a- a''b 'quoted' __init__ co-op's\n"
+		"MiXeD CaSe ÄÖÜ caf\xc3\xa9 na\xefve \x80\xff" "abc\n"
+		"tab\tseparated\r\n"
+		"trailing-";
+	for (auto& bounds : lengthBounds)
+		ok &= compare("edge cases", edgeCases, bounds[0], bounds[1]);
+
+	// Random text biased towards the interesting characters, long enough to span many windows ...
+	std::mt19937 rng(3151);
+	const std::string alphabet = "aZ09'_- \n\r.\x80\xe9";
+	std::string randomText;
+	for (int i = 0; i < 3 * TOK_WINDOW_SIZE; i++)
+		randomText += alphabet[rng() % alphabet.size()];
+	for (auto& bounds : lengthBounds)
+		ok &= compare("random text", randomText, bounds[0], bounds[1]);
+
+	// A run of letters longer than a window (too deep for the recursive std::regex, so the
+	// expected words are built by hand) ...
+	std::string longRun = "head " + std::string(TOK_WINDOW_SIZE + 100, 'q') + " tail";
+	std::vector<std::string> expected = { "head", "tail" };
+	for (TokenizerIsa isa : {TOK_ISA_SCALAR, TOK_ISA_SSE2, TOK_ISA_AVX2}) {
+		if (isa > tokenizer_best_isa())
+			continue;
+		bool same = tokenizer_words(longRun, 1, 1000, isa) == expected;
+		std::cout << (same ? "ok   " : "FAIL ") << "long run " << tokenizer_isa_name(isa) << std::endl;
+		ok &= same;
+	}
+	for (std::size_t blockSize : {7, 4096}) {
+		bool same = stream_words(longRun, 1, 1000, blockSize) == expected;
+		std::cout << (same ? "ok   " : "FAIL ") << "long run stream, " << blockSize << " byte blocks" << std::endl;
+		ok &= same;
+	}
+
+	// Line ends, in one call and in blocks ...
+	for (auto& bounds : lengthBounds) {
+		std::vector<std::string> expectedLines = regex_line_words(edgeCases + randomText, bounds[0], bounds[1]);
+		for (std::size_t blockSize : {(std::size_t) 7, (std::size_t) 4096, edgeCases.size() + randomText.size()}) {
+			bool same = stream_line_words(edgeCases + randomText, bounds[0], bounds[1], blockSize) == expectedLines;
+			std::cout << (same ? "ok   " : "FAIL ") << "line ends [" << bounds[0] << ", " << bounds[1] << "], "
+				<< blockSize << " byte blocks" << std::endl;
+			ok &= same;
+		}
+	}
+
+	std::cout << (ok ? "All tests passed" : "Some tests FAILED") << " (best ISA: "
+		<< tokenizer_isa_name(tokenizer_best_isa()) << ")" << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+/*
+Group name: Kismet
+
+Exact global top-K words without collecting whole vocabularies on ROOT.
+	- When every word is owned by a single process (after a shuffle reduction), the global top K
+	  is among the union of each process's local top K, so only K words per process are gathered.
+	- Otherwise the counts of a word are spread over the processes and the three-phase uniform
+	  threshold algorithm (TPUT, Cao & Wang 2004) is used:
+		1. every process sends its local top K; the K-th highest partial sum gives a lower bound
+		   tau1 of the K-th highest total, so T = tau1 / nprocs
+		2. every process sends its remaining words with a count of at least T; a word not sent by a
+		   process has a count below T there, which bounds its total from above; words whose upper
+		   bound is below tau2 (the new K-th highest partial sum) cannot be in the top K
+		3. the exact counts of the remaining candidates are collected and the top K is picked
+Ties are broken alphabetically so the result does not depend on the number of processes.
+*/
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <algorithm> 		// std::nth_element, std::sort
+#include <string> 			// std::string
+#include <vector> 			// std::vector
+#include <mpi.h>
+#include "Counter.h"
+#include "Reduce.h"
+#include "Profile.h"
+
+bool more_common(const CounterEntry* x, const CounterEntry* y) {
+	/* `most_common()` for pointers to Counter items. */
+
+	return most_common(*x, *y);
+}
+
+std::vector<const CounterEntry*> local_top_k(const Counter& counter, std::size_t k) {
+	/* Return the `k` most common entries of a counter, most common first, in O(n + k log k)
+	without sorting (or copying) the whole counter. */
+
+	PROFILE_SCOPE(PROF_SELECT);
+	std::vector<const CounterEntry*> entries;
+	entries.reserve(counter.size());
+	for (auto& entry: counter)
+		entries.push_back(&entry);
+	if (entries.size() > k) {
+		std::nth_element(entries.begin(), entries.begin() + k, entries.end(), more_common);
+		entries.resize(k);
+	}
+	std::sort(entries.begin(), entries.end(), more_common);
+	return entries;
+}
+
+void keep_top_k(const Counter& counter, std::size_t k, Counter& topCounter) {
+	/* Copy the `k` most common entries of a counter into `topCounter`. */
+
+	for (const CounterEntry* entry: local_top_k(counter, k))
+		topCounter.add(entry->first, entry->second);
+}
+
+void top_k_disjoint(const Counter& ownedCounter, std::size_t k, Counter& topCounter, int rank,
+	int nprocs) {
+	/* Global top `k` of counters that have no word in common (e.g. the owned counters of a
+	shuffle reduction), stored in `topCounter` [ROOT use only]. Collective over MPI_COMM_WORLD. */
+
+	Counter eachTop;
+	keep_top_k(ownedCounter, k, eachTop);
+
+	Counter candidates; // union of the local top-k lists [ROOT use only]
+	gather_counter(eachTop, candidates, rank, nprocs);
+	if (rank == ROOT)
+		keep_top_k(candidates, k, topCounter);
+}
+
+void broadcast_bytes(std::string& buffer, int rank) {
+	/* Broadcast a buffer of ROOT to every process. */
+
+	PROFILE_SCOPE(PROF_COMM);
+	long long size = buffer.size();
+	MPI_Bcast(&size, 1, MPI_LONG_LONG, ROOT, MPI_COMM_WORLD);
+	if (rank != ROOT)
+		buffer.resize(size);
+	MPI_Bcast(&buffer[0], size, MPI_CHAR, ROOT, MPI_COMM_WORLD);
+	PROFILE_ADD(rank == ROOT ? PROF_BYTES_SENT : PROF_BYTES_RECEIVED, size);
+}
+
+long long kth_highest_count(const Counter& counter, std::size_t k) {
+	/* Return the `k`-th highest count of a counter, or 0 if it has fewer than `k` words. */
+
+	if (counter.size() < k || k == 0)
+		return 0;
+	return local_top_k(counter, k).back()->second;
+}
+
+void top_k_tput(const Counter& eachCounter, std::size_t k, Counter& topCounter, int rank, int nprocs) {
+	/* Global top `k` of counters that may share words, stored in `topCounter` [ROOT use only],
+	using the TPUT algorithm described above. Collective over MPI_COMM_WORLD. */
+
+	std::vector<char> gatheredBuf;
+	std::vector<int> bufOffsets;
+	Counter partialSums; // sum of the counts reported for each word [ROOT use only]
+	Counter reporters; 	// number of processes that reported each word [ROOT use only]
+
+	// Adds the counts reported by every process to the partial sums [ROOT use only]
+	auto collect_reports = [&]() {
+		PROFILE_SCOPE(PROF_DECODE);
+		for (int r = 0; r < nprocs; r++) {
+			Counter reported;
+			if (!compose_counters(reported, gatheredBuf.data() + bufOffsets[r], bufOffsets[r + 1] - bufOffsets[r])) {
+				std::cout << "Error! Gathered counter data is corrupt. Aborting program." << std::endl;
+				exit(1);
+			}
+			for (auto& entry: reported) {
+				partialSums.add(entry.first, entry.second);
+				reporters.add(entry.first, 1);
+			}
+		}
+	};
+
+	// Phase 1: local top-k lists
+	std::vector<const CounterEntry*> eachTop = local_top_k(eachCounter, k);
+	std::string eachBuffer;
+	encode_entries(eachBuffer, eachTop.begin(), eachTop.end(), false);
+	gather_bytes(eachBuffer, gatheredBuf, bufOffsets, rank, nprocs);
+
+	double threshold = 0;
+	if (rank == ROOT) {
+		collect_reports();
+		threshold = (double) kth_highest_count(partialSums, k) / nprocs;
+	}
+	MPI_Bcast(&threshold, 1, MPI_DOUBLE, ROOT, MPI_COMM_WORLD);
+
+	// Phase 2: every other word with a count of at least the threshold
+	Counter sentTop;
+	for (const CounterEntry* entry: eachTop)
+		sentTop.add(entry->first, 0);
+	std::vector<const CounterEntry*> aboveThreshold;
+	for (auto& entry: eachCounter)
+		if (entry.second >= threshold && sentTop.find(entry.first) == sentTop.end())
+			aboveThreshold.push_back(&entry);
+	eachBuffer.clear();
+	encode_entries(eachBuffer, aboveThreshold.begin(), aboveThreshold.end(), false);
+	gather_bytes(eachBuffer, gatheredBuf, bufOffsets, rank, nprocs);
+
+	// ROOT prunes every word whose upper bound is below the k-th highest partial sum
+	std::string candidateBuffer;
+	if (rank == ROOT) {
+		collect_reports();
+		long long tau2 = kth_highest_count(partialSums, k);
+		std::vector<const CounterEntry*> candidates;
+		for (auto& entry: partialSums) {
+			double upperBound = entry.second + (nprocs - reporters[entry.first]) * threshold;
+			if (upperBound >= tau2)
+				candidates.push_back(&entry);
+		}
+		encode_entries(candidateBuffer, candidates.begin(), candidates.end(), false);
+	}
+
+	// Phase 3: exact counts of the candidates
+	broadcast_bytes(candidateBuffer, rank);
+	Counter candidates;
+	if (!compose_counter(candidates, candidateBuffer.data(), candidateBuffer.size())) {
+		std::cout << "Error! Broadcast candidate data is corrupt. Aborting program." << std::endl;
+		exit(1);
+	}
+	Counter eachCandidates;
+	for (auto& candidate: candidates) {
+		auto it = eachCounter.find(candidate.first);
+		if (it != eachCounter.end())
+			eachCandidates.add(it->first, it->second);
+	}
+	Counter exactCounts; // [ROOT use only]
+	gather_counter(eachCandidates, exactCounts, rank, nprocs);
+	if (rank == ROOT)
+		keep_top_k(exactCounts, k, topCounter);
+}
+
+long long count_unique_words(const Counter& eachCounter, int nprocs) {
+	/* Return the number of distinct words over the counters of every process (valid on every
+	process), sending only the 64-bit hash of each word to the process owning it. Collective over
+	MPI_COMM_WORLD. */
+
+	std::vector< std::vector<std::uint64_t> > parts(nprocs);
+	for (auto& entry: eachCounter) {
+		std::uint64_t hash = hash_word(entry.first);
+		parts[get_owner(hash, nprocs)].push_back(hash);
+	}
+
+	std::vector<std::uint64_t> sendHashes;
+	std::vector<int> sendAmounts(nprocs), sendOffsets(nprocs), recvAmounts(nprocs), recvOffsets(nprocs);
+	for (int r = 0; r < nprocs; r++) {
+		sendOffsets[r] = sendHashes.size();
+		sendAmounts[r] = parts[r].size();
+		sendHashes.insert(sendHashes.end(), parts[r].begin(), parts[r].end());
+	}
+	MPI_Alltoall(sendAmounts.data(), 1, MPI_INT, recvAmounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+	int recvSize = 0;
+	for (int r = 0; r < nprocs; r++) {
+		recvOffsets[r] = recvSize;
+		recvSize += recvAmounts[r];
+	}
+	std::vector<std::uint64_t> recvHashes(recvSize);
+	{
+		PROFILE_SCOPE(PROF_COMM);
+		MPI_Alltoallv(sendHashes.data(), sendAmounts.data(), sendOffsets.data(), MPI_UINT64_T,
+			recvHashes.data(), recvAmounts.data(), recvOffsets.data(), MPI_UINT64_T, MPI_COMM_WORLD);
+		PROFILE_ADD(PROF_BYTES_SENT, sendHashes.size() * sizeof(std::uint64_t));
+		PROFILE_ADD(PROF_BYTES_RECEIVED, recvHashes.size() * sizeof(std::uint64_t));
+	}
+
+	std::sort(recvHashes.begin(), recvHashes.end());
+	long long eachUnique = std::unique(recvHashes.begin(), recvHashes.end()) - recvHashes.begin();
+	long long unique = 0;
+	MPI_Allreduce(&eachUnique, &unique, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	return unique;
+}
+
+#endif
@@ -4,22 +4,86 @@ Group name: Kismet
 Compile with:
 	$ mpic++ ass.cpp -o ass
 
-Run with:
+Run with (prompts for the files and word length bounds):
 	$ mpirun ./ass
+or give them on the command line (word lengths default to 1 to 20), or in a config file:
+	$ mpirun -n 4 ./ass test-data/fruits1.txt ascii-only/shelly.txt --min-length 3 --max-length 12
+	$ mpirun -n 4 ./ass --config run.conf
 or with specified number of processors (e.g. 4):
 	$ mpirun -n 4 ./ass
 or run and redirect output to a text file:
 	$ mpirun ./ass > results.txt
+or read the input through fstream instead of memory mapping, and report input throughput:
+	$ mpirun -n 4 ./ass --input fstream --throughput
+or read the input in fixed-size blocks on a reader thread, overlapping reads with tokenizing:
+	$ mpirun -n 4 ./ass --input stream --block-size 1024
+or read each file collectively through MPI-IO (static schedule):
+	$ mpirun -n 4 ./ass --input mpiio
+or with several threads per process (or set OMP_NUM_THREADS):
+	$ mpirun -n 2 ./ass --threads 8
+or merge the counters with an all-to-all exchange instead of gathering them on the root process:
+	$ mpirun -n 4 ./ass --reduce shuffle
+or send the counter of each file to the root process without waiting, overlapping the transfer with
+counting the next file:
+	$ mpirun -n 4 ./ass --reduce pipeline --pipeline-depth 2
+or merge the counters of the processes of each node through shared memory first, so only one
+counter per node is sent to the root process:
+	$ mpirun -n 16 ./ass --reduce hierarchical
+or send the counters sorted and prefix-compressed (front-coded), which is smaller on the wire:
+	$ mpirun -n 4 ./ass --front-coding
+or let the processes pull fixed-size chunks of all the files from a shared queue (chunk size in MB):
+	$ mpirun -n 4 ./ass --schedule dynamic --chunk-size 4
+or report only the 10 most common words, without collecting every word on the root process:
+	$ mpirun -n 4 ./ass --top 10
+or count the most common runs of 2 (up to 4) consecutive words of a line instead of words:
+	$ mpirun -n 4 ./ass --ngram 2 --top 20
+or count approximately in fixed memory per process, for huge vocabularies (with error bounds):
+	$ mpirun -n 4 ./ass --approx --epsilon 0.0001 --heavy-hitters 10000 --top 20
+or, compiled with -DWC_GZIP -lz and/or -DWC_ZSTD -lzstd, read gzip and zstd compressed files as they
+are (BGZF and seekable zstd files are split between the processes):
+	$ mpic++ -DWC_GZIP -DWC_ZSTD ass.cpp -o ass -lz -lzstd
+	$ mpirun -n 4 ./ass corpus.txt.gz corpus.txt.zst
+or count a live stream of lines from stdin (or a FIFO), printing the top words of the last 60
+seconds every 10 seconds:
+	$ tail -F app.log | mpirun -n 4 ./ass --stream - --window 60 --slide 10 --top 20
+or write every word to a file, sorted alphabetically across the processes, as CSV (or table, binary):
+	$ mpirun -n 4 ./ass --reduce shuffle --output counts.csv --format csv --sort alphabetical
+or write every word to an index file, then look words up without counting again (IndexQuery.cpp):
+	$ mpirun -n 4 ./ass --index words.idx && ./IndexQuery words.idx count apple
+or keep the counter of every file on disk, and only count the files changed since the last run:
+	$ mpirun -n 4 ./ass --cache .wc-cache
+or, compiled with profiling (mpic++ -DWC_PROFILE ass.cpp -o ass), print where the time goes:
+	$ mpirun -n 4 ./ass --profile --profile-trace trace.json
 */
 
 #include <iostream>
 #include <fstream>
-#include <regex>
 #include <string>
 #include <sstream>
 #include <limits>
+#include <memory>
 #include <mpi.h>
 #include "Counter.h"
+#include "Tokenizer.h"
+#include "Partition.h"
+#include "MappedFile.h"
+#include "BlockReader.h"
+#include "MpiInput.h"
+#include "Options.h"
+#include "ThreadPool.h"
+#include "Reduce.h"
+#include "Scheduler.h"
+#include "TopK.h"
+#include "Profile.h"
+#include "Cache.h"
+#include "Sketch.h"
+#include "Compressed.h"
+#include "Ngram.h"
+#include "Pipeline.h"
+#include "Output.h"
+#include "Stream.h"
+#include "Spill.h"
+#include "Index.h"
 
 #define ROOT 0
 #define FILENAME_SIZE 256
@@ -27,86 +91,301 @@ or run and redirect output to a text file:
 using namespace std;
 
 bool is_file_exists(string filename) {
-    fstream file(filename);
+    ifstream file(filename);
     return file.good();
 }
 
-int get_line_count(string filename) {
-	/* Return the number of lines in a given text file. */
+template <typename Emit>
+void tokenize_lines(string filename, ByteRange range, Tokenizer& tokenizer, bool lineEnds, Emit&& emit) {
+	/* Read a line-aligned byte range of a text file line by line through an fstream and pass the
+	words of every line to `emit`, followed by an empty word if `lineEnds`. Fallback for when memory
+	mapping is not wanted. */
 
 	fstream inFile; // input file object
 	string line; // temporary variable to store each line as a string of chars
-	int lineCount = 0;
+	long long pos = range.begin; // byte offset of the current line
 
-	inFile.open(filename);
+	inFile.open(filename, ios::in | ios::binary);
 	if (!inFile.is_open()) {
 		cout << "Error: could not open file '" << filename << "'" << endl;
 		exit(1);
 	}
 
-	// count the number of lines in the input file
-	while ( getline(inFile, line) ) {
-		if (line.back() == '\r')
+	// Seek straight to the start of the range and process the text lines up to but not including
+	// the end of the range.
+	inFile.seekg(range.begin);
+	while (pos < range.end && getline(inFile, line)) {
+		pos += line.size() + 1; // account for the newline removed by getline
+
+		if (!line.empty() && line.back() == '\r')
 			line.erase(line.end() - 1); // remove last 'CR' or \r character if exists
-		lineCount++;
+
+        // Extract the lowercased words of the line, skipping those not within min/max word length
+        tokenizer.tokenize(line.data(), line.size(), emit);
+		if (lineEnds)
+			emit(string_view());
 	}
 
 	inFile.close();
-	return lineCount;
 }
 
-void process_lines(string filename, int eachLines, int startPos, Counter& counter, int minWordLen, int maxWordLen) {
-	/* Count the words in a specified section of a given text file, using the given starting line
-	position and number of lines to determine which section of the text file to process. Store the
-	results in the provided Counter object.
+template <typename Emit>
+void tokenize_blocks(string filename, ByteRange range, int minWordLen, int maxWordLen, const Options& options,
+	Emit&& emit) {
+	/* Read a byte range of a text file in fixed-size blocks on a reader thread and pass the words to
+	`emit`, tokenizing each block while the next ones are being read. Memory use is bounded by the
+	block size, whatever the length of the lines. */
+
+	BlockReader reader(filename, range, options.blockSize, options.readBuffers);
+	StreamTokenizer tokenizer(minWordLen, maxWordLen); // carries words cut by block boundaries
+	const char* block;
+	size_t blockSize;
+	while (reader.next(block, blockSize)) {
+		if (options.ngram > 0)
+			tokenize_by_line(tokenizer, block, blockSize, emit);
+		else
+			tokenizer.tokenize(block, blockSize, emit);
+	}
+	tokenizer.finish(emit);
+}
+
+struct alignas(64) ThreadCounter {
+	/* Counter owned by a single thread, padded to its own cache line(s). */
+
+	Counter counter;
+	long long words = 0; // words counted since the counter was last checked against the memory budget
+};
+
+void count_word(ThreadCounter& threadCounter, string_view word, SpillRuns* spills, int nthreads) {
+	/* Count a word into the counter of a thread. With a memory budget, the counter is spilled to a
+	sorted run whenever it outgrows its share: half of the budget goes to the threads, the other
+	half to the counter of the process. */
+
+	update_counter(threadCounter.counter, word);
+	if (spills && ++threadCounter.words % SPILL_CHECK_WORDS == 0 && spills->over_budget(threadCounter.counter, 2 * nthreads))
+		spills->spill(threadCounter.counter);
+}
+
+void merge_thread_counters(vector<ThreadCounter>& counters, ThreadPool& pool) {
+	/* Merge the counters of every thread into the first one as a parallel binary tree: in each
+	round, thread t merges the counter of thread t + stride into its own. */
+
+	int nthreads = counters.size();
+	for (int stride = 1; stride < nthreads; stride *= 2) {
+		pool.run([&counters, stride, nthreads](int t) {
+			if (t % (2 * stride) == 0 && t + stride < nthreads) {
+				update_counter(counters[t].counter, counters[t + stride].counter);
+				counters[t + stride].counter.clear();
+			}
+		});
+	}
+}
+
+template <typename CountWord>
+void tokenize_range(string filename, ByteRange range, int minWordLen, int maxWordLen, const Options& options,
+	ThreadPool& pool, CountWord&& countWord) {
+	/* Pass the words in a line-aligned byte range of a text file to `countWord(t, word)`, t being
+	the thread of the pool that found the word. With --ngram, the end of every line (and of every
+	thread's range) is passed as an empty word too.
+
+	The range is split again into one line-aligned range per thread of the pool. Each thread either
+	tokenizes the memory-mapped bytes in place, streams blocks read ahead by a reader thread, or
+	reads lines through an fstream (fallback).
 	*/
 
-	fstream inFile; // input file object
-	string line; // temporary variable to store each line as a string of chars
-	string word; // temporary variable to store each word
-	stringstream lineStream; // temporary stream buffer for each line
-	int endPos = startPos + eachLines; // ending line position
-	int processedLineCount = 0;
-    regex wordRegex("((?!\\d)[^\\W_]+(?:['_-][^\\W_]+)*)");
+	int nthreads = pool.size();
+	vector<ByteRange> threadRanges = split_range(filename, range, nthreads);
+	unique_ptr<MappedRange> mapped;
+	{
+		PROFILE_SCOPE(PROF_READ);
+		if (options.input == INPUT_MMAP)
+			mapped.reset(new MappedRange(filename, range));
+#ifdef WC_PROFILE
+		// fault the pages in up front, so reading is not timed as tokenizing
+		if (mapped)
+			pool.run([&](int t) {
+				volatile char sink = 0;
+				const char* data = mapped->data() + (threadRanges[t].begin - range.begin);
+				for (long long i = 0; i < threadRanges[t].size(); i += 4096)
+					sink += data[i];
+			});
+#endif
+	}
+	PROFILE_ADD(PROF_BYTES_READ, range.size());
+
+	PROFILE_SCOPE(PROF_TOKENIZE);
+	pool.run([&](int t) {
+		Tokenizer tokenizer(minWordLen, maxWordLen); // word extractor of this thread
+		auto emit = [&countWord, t](string_view word) {
+			countWord(t, word);
+		};
+
+		ByteRange threadRange = threadRanges[t];
+		bool lineEnds = options.ngram > 0;
+		if (mapped && lineEnds)
+			tokenize_by_line(tokenizer, mapped->data() + (threadRange.begin - range.begin), threadRange.size(), emit);
+		else if (mapped) // tokenize directly over the mapped bytes, no per-line copies
+			tokenizer.tokenize(mapped->data() + (threadRange.begin - range.begin), threadRange.size(), emit);
+		else if (options.input == INPUT_STREAM)
+			tokenize_blocks(filename, threadRange, minWordLen, maxWordLen, options, emit);
+		else
+			tokenize_lines(filename, threadRange, tokenizer, lineEnds, emit);
+		if (lineEnds)
+			emit(string_view()); // the range ends a line, even without a newline
+	});
+}
 
-	inFile.open(filename);
-	if (!inFile.is_open()) {
-		cout << "Error: could not open file '" << filename << "'" << endl;
-		exit(1);
+template <typename CountWord>
+void tokenize_text(const char* text, size_t size, int minWordLen, int maxWordLen, ThreadPool& pool,
+	CountWord&& countWord) {
+	/* Pass the words of a text held in memory to `countWord(t, word)`, t being the thread of the
+	pool that found the word. The text is split into one part per thread, each part ending right
+	after a delimiter. */
+
+	int nthreads = pool.size();
+	vector<size_t> cuts(nthreads + 1, size);
+	cuts[0] = 0;
+	for (int t = 1; t < nthreads; t++) {
+		size_t cut = max(cuts[t - 1], size * t / nthreads);
+		while (cut < size && (cut == 0 || !tok_is_delimiter(text[cut - 1])))
+			cut++;
+		cuts[t] = cut;
 	}
 
-	// Loop over each line in the text file. Start to process the text lines from the given
-	// starting line position up to but not including the ending line position.
-	for (int pos = 0; pos < endPos; pos++) {
-		getline(inFile, line); // read the line at this position
-		if (pos < startPos)
-			continue; // advance to next iteration/line if starting line position is not yet reached
+	PROFILE_SCOPE(PROF_TOKENIZE);
+	pool.run([&](int t) {
+		Tokenizer tokenizer(minWordLen, maxWordLen);
+		tokenizer.tokenize(text + cuts[t], cuts[t + 1] - cuts[t], [&countWord, t](string_view word) {
+			countWord(t, word);
+		});
+	});
+}
 
-		if (line.back() == '\r')
-			line.erase(line.end() - 1); // remove last 'CR' or \r character if exists
+template <typename CountWord>
+long long tokenize_compressed_file(string filename, Compression compression, int owner, int minWordLen,
+	int maxWordLen, bool lineEnds, int rank, int nprocs, ThreadPool& pool, CountWord&& countWord) {
+	/* Pass the words of this process's share of a compressed file to `countWord(t, word)`, t being
+	the thread of the pool that found the word, and return the compressed bytes of the share. The
+	blocks of a file with an index of them are split between every thread of every process, counting
+	from process `owner` on; a file without one is decompressed by the first thread of `owner`. With
+	`lineEnds`, the shares are cut at newlines and the end of every line is passed as an empty word. */
+
+	int nthreads = pool.size();
+	vector<CompressedPart> parts = split_blocks(index_blocks(filename, compression), nprocs * nthreads);
+	int firstPart = (rank - owner + nprocs) % nprocs * nthreads;
+	long long bytes = 0;
+	for (int t = 0; t < nthreads; t++)
+		if (firstPart + t < (int) parts.size())
+			bytes += parts[firstPart + t].size;
+	PROFILE_ADD(PROF_BYTES_READ, bytes);
+
+	PROFILE_SCOPE(PROF_TOKENIZE);
+	pool.run([&](int t) {
+		if (firstPart + t >= (int) parts.size())
+			return;
+		const CompressedPart& part = parts[firstPart + t];
+		tokenize_compressed(filename, compression, part.offset, part.skipHead, part.rawSize, minWordLen, maxWordLen,
+			lineEnds, [&countWord, t](string_view word) {
+				countWord(t, word);
+			});
+	});
+	return bytes;
+}
 
-        // Extract words using regex
-        sregex_iterator it(line.begin(), line.end(), wordRegex);
-        sregex_iterator end;
+struct alignas(64) ThreadSketch {
+	/* Sketch owned by a single thread, padded to its own cache line(s). */
 
-        // Loop over each matching words
-        for (; it != end; ++it) {
-            smatch match = *it;
-            word = match.str();
+	WordSketch sketch;
+};
 
-            // Skip if word length is smaller than min or larger than max
-            if (word.length() < minWordLen || word.length() > maxWordLen)
-                continue;
+struct alignas(64) ThreadNgrams {
+	/* N-gram counter owned by a single thread, padded to its own cache line(s). */
 
-            // Transform to lowercase
-            transform(word.begin(), word.end(), word.begin(), ::tolower);
+	NgramCounter ngrams;
+};
 
-            update_counter(counter, word);
-        }
-		processedLineCount++;
+void merge_thread_ngrams(vector<ThreadNgrams>& threadNgrams, ThreadPool& pool) {
+	/* Merge the n-gram counters of every thread into the first one, as a parallel binary tree like
+	`merge_thread_counters()`. */
+
+	int nthreads = threadNgrams.size();
+	for (int stride = 1; stride < nthreads; stride *= 2) {
+		pool.run([&threadNgrams, stride, nthreads](int t) {
+			if (t % (2 * stride) == 0 && t + stride < nthreads) {
+				threadNgrams[t].ngrams.merge(threadNgrams[t + stride].ngrams);
+				threadNgrams[t + stride].ngrams = NgramCounter(threadNgrams[t].ngrams.n);
+			}
+		});
 	}
+}
 
-	inFile.close();
+void merge_into_counter(vector<ThreadCounter>& threadCounters, Counter& counter, ThreadPool& pool) {
+	/* Merge the counters of every thread and add them to `counter`. */
+
+#ifdef WC_PROFILE
+	for (ThreadCounter& threadCounter: threadCounters) {
+		PROFILE_ADD(PROF_TOKENS, get_counter_total(threadCounter.counter));
+		PROFILE_ADD(PROF_PROBES, threadCounter.counter.probes());
+	}
+#endif
+
+	PROFILE_SCOPE(PROF_MERGE);
+	merge_thread_counters(threadCounters, pool);
+	if (counter.empty())
+		counter = move(threadCounters[0].counter);
+	else
+		update_counter(counter, threadCounters[0].counter);
+}
+
+void process_lines(string filename, ByteRange range, Counter& counter, int minWordLen, int maxWordLen,
+	const Options& options, ThreadPool& pool, SpillRuns* spills = nullptr) {
+	/* Count the words in a specified section of a given text file, using the given line-aligned
+	byte range to determine which section of the text file to process. Store the results in the
+	provided Counter object. Each thread counts its part of the range into its own counter, and the
+	thread counters are merged at the end.
+	*/
+
+	vector<ThreadCounter> threadCounters(pool.size());
+	int nthreads = pool.size();
+	tokenize_range(filename, range, minWordLen, maxWordLen, options, pool, [&](int t, string_view word) {
+		count_word(threadCounters[t], word, spills, nthreads);
+	});
+	merge_into_counter(threadCounters, counter, pool);
+}
+
+void count_text(const char* text, size_t size, Counter& counter, int minWordLen, int maxWordLen,
+	ThreadPool& pool, SpillRuns* spills = nullptr) {
+	/* Count the words of a text held in memory into the provided Counter object. */
+
+	vector<ThreadCounter> threadCounters(pool.size());
+	int nthreads = pool.size();
+	tokenize_text(text, size, minWordLen, maxWordLen, pool, [&](int t, string_view word) {
+		count_word(threadCounters[t], word, spills, nthreads);
+	});
+	merge_into_counter(threadCounters, counter, pool);
+}
+
+void print_throughput(int rank, int nprocs, double inputBytes, double inputTime, InputMode input) {
+	/* Gather the number of bytes each process read and the time it spent reading and tokenizing
+	them, then print the throughput of each process on ROOT. */
+
+	double eachStats[2] = { inputBytes, inputTime };
+	vector<double> allStats(2 * nprocs);
+	MPI_Gather(eachStats, 2, MPI_DOUBLE, allStats.data(), 2, MPI_DOUBLE, ROOT, MPI_COMM_WORLD);
+
+	if (rank == ROOT) {
+		cout << "Input throughput (" << input_mode_name(input) << "):" << endl;
+		cout << "| " << setw(4) << "Rank" << " | " << setw(10) << "MB" << " | " << setw(9) << "Seconds"
+			<< " | " << setw(9) << "MB/s" << " |" << endl;
+		for (int r = 0; r < nprocs; r++) {
+			double megabytes = allStats[2 * r] / 1e6, seconds = allStats[2 * r + 1];
+			cout << "| " << setw(4) << r << " | " << setw(10) << fixed << setprecision(2) << megabytes
+				<< " | " << setw(9) << setprecision(4) << seconds << " | " << setw(9) << setprecision(1)
+				<< (seconds > 0 ? megabytes / seconds : 0) << " |" << endl;
+		}
+		cout.unsetf(ios::fixed);
+		cout << setprecision(6);
+	}
 }
 
 void prompt_user(int rank, vector<string>& allFilenames, int& minWordLen, int& maxWordLen) {
@@ -178,168 +457,500 @@ int main(int argc, char* argv[]) {
 	int nprocs, rank; // number of processes and rank/id of each process
 	double startTime, endTime; // for timing the program
 
-	// Initialize the MPI environment
-	MPI_Init(&argc, &argv);
+	// Initialize the MPI environment; only the main thread of each process makes MPI calls
+	int threadSupport;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
 
 	// Get the number of processes and rank of each process
 	MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+	// Parse command line options
+	Options options;
+	if (!parse_options(argc, argv, options)) {
+		if (rank == ROOT)
+			print_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+
+	// Worker threads need an MPI library that lets a process have threads besides the one calling MPI
+	if (threadSupport < MPI_THREAD_FUNNELED && (options.threads > 0 ? options.threads : get_default_thread_count()) > 1) {
+		if (rank == ROOT)
+			cout << "Warning: the MPI library does not support threads, counting with --threads 1" << endl;
+		options.threads = 1;
+	}
+
+	// A stream is counted over a sliding window until it ends, instead of the files
+	if (!options.streamPath.empty()) {
+		stream_count(options.streamPath, options.stream, options.minWordLen, options.maxWordLen, options.top,
+			rank, nprocs);
+		MPI_Finalize();
+		return 0;
+	}
+
+	// The shares of MPI-IO are cut at any delimiter, but n-grams need whole lines
+	if (options.ngram > 0 && options.input == INPUT_MPIIO)
+		options.input = INPUT_MMAP;
+
+	// Options of the POSIX input path, used for every file that is not read with MPI-IO (with the
+	// dynamic schedule, or when a file is too small to be split between the processes)
+	Options posixOptions = options;
+	if (posixOptions.input == INPUT_MPIIO)
+		posixOptions.input = INPUT_MMAP;
+
+	// Worker threads of this process
+	ThreadPool pool(options.threads > 0 ? options.threads : get_default_thread_count());
+
 	// User input variables, shared and constant across each proc
-    int minWordLen = 0; // minimum word length for inclusion
-    int maxWordLen = 0; // maximum word length for inclusion
-	vector<string> allFilenames; // list of all the text files
+    int minWordLen = options.minWordLen; // minimum word length for inclusion
+    int maxWordLen = options.maxWordLen; // maximum word length for inclusion
+	vector<string> allFilenames = options.files; // list of all the text files
 
 	// Define word counter to store the frequency of words of all the text files [ROOT use only]
 	Counter allWordCounter;
 
-	// Prompt user for input
-	prompt_user(rank, allFilenames, minWordLen, maxWordLen);
+	// Define word counter to store the frequency of the words owned by this process, over all the
+	// text files [--reduce shuffle only]
+	Counter ownedWordCounter;
+
+	// Define word counter to store the frequency of words of this process, over all the text files
+	// [--top with --reduce gather only]
+	Counter localWordCounter;
+
+	// Number of unique words and total number of words over all the text files [ROOT use only]
+	long long uniqueWords = 0, totalWords = 0;
+
+	// Most common n-grams, number of unique n-grams and total number of n-grams over all the text
+	// files [--ngram, ROOT use only]
+	vector<NgramRow> topNgrams;
+	long long uniqueNgrams = 0, totalNgrams = 0;
+
+	// Time spent by this process merging counters
+	double reduceTime = 0, maxReduceTime = 0;
+
+	// Time with counters in flight and the part of it hidden behind computation, summed over the
+	// processes [--reduce pipeline, ROOT use only]
+	double pipelineTimes[2] = { 0, 0 };
+
+	// Sorted runs and bytes spilled, summed over the processes [--memory-budget, ROOT use only], and
+	// the file holding the formatted words of the range of this process [without --top]
+	long long spilled[2] = { 0, 0 };
+	string slicePath;
+
+	// Input statistics of this process, accumulated over every file
+	double inputBytes = 0, inputTime = 0;
+
+	// Prompt user for input, unless the files were given as options
+	if (allFilenames.empty()) {
+		prompt_user(rank, allFilenames, minWordLen, maxWordLen);
+	} else {
+		for (const string& filename : allFilenames) {
+			if (!is_file_exists(filename)) {
+				if (rank == ROOT)
+					cout << "Error: " << filename << " does not exist." << endl;
+				MPI_Finalize();
+				return 1;
+			}
+		}
+	}
+
+	// With --approx every thread adds the words it finds to its own fixed-size sketch, over all the
+	// text files, instead of counting them exactly
+	vector<ThreadSketch> threadSketches;
+	if (options.approx) {
+		options.sketch.maxWordLen = maxWordLen;
+		threadSketches.assign(pool.size(), ThreadSketch{ WordSketch(options.sketch) });
+	}
+	auto sketch_word = [&threadSketches](int t, string_view word) {
+		threadSketches[t].sketch.add(word);
+	};
+
+	// With --ngram every thread counts the n-grams of the lines it tokenizes into its own n-gram
+	// counter, over all the text files; an empty word marks the end of a line
+	vector<ThreadNgrams> threadNgrams;
+	if (options.ngram > 0)
+		threadNgrams.assign(pool.size(), ThreadNgrams{ NgramCounter(options.ngram) });
+	auto ngram_word = [&threadNgrams](int t, string_view word) {
+		if (word.empty())
+			threadNgrams[t].ngrams.end_line();
+		else
+			threadNgrams[t].ngrams.add_word(word);
+	};
+
+	// With --memory-budget the counters that outgrow the budget are spilled to sorted runs on disk,
+	// which are merged across the processes at the end
+	unique_ptr<SpillRuns> spills;
+	if (options.memoryBudget > 0)
+		spills.reset(new SpillRuns(options.spillDir, options.memoryBudget, rank));
+
+	// Count the words of a line-aligned byte range of a file, or of text in memory, into a counter
+	// (or into the sketches of the threads with --approx, or their n-gram counters with --ngram)
+	auto count_range = [&](const string& filename, ByteRange range, Counter& counter) {
+		if (options.approx)
+			tokenize_range(filename, range, minWordLen, maxWordLen, posixOptions, pool, sketch_word);
+		else if (options.ngram > 0)
+			tokenize_range(filename, range, minWordLen, maxWordLen, posixOptions, pool, ngram_word);
+		else
+			process_lines(filename, range, counter, minWordLen, maxWordLen, posixOptions, pool, spills.get());
+	};
+	auto count_in_memory = [&](const char* text, size_t size, Counter& counter) {
+		if (options.approx)
+			tokenize_text(text, size, minWordLen, maxWordLen, pool, sketch_word);
+		else
+			count_text(text, size, counter, minWordLen, maxWordLen, pool, spills.get());
+	};
+
+	// Count the words of this process's share of a compressed file, return its compressed bytes
+	vector<Compression> compressions;
+	for (const string& filename : allFilenames)
+		compressions.push_back(detect_compression(filename));
+	auto count_compressed = [&](size_t fileIndex, Counter& counter) {
+		if (options.approx)
+			return tokenize_compressed_file(allFilenames[fileIndex], compressions[fileIndex], fileIndex % nprocs,
+				minWordLen, maxWordLen, false, rank, nprocs, pool, sketch_word);
+		if (options.ngram > 0)
+			return tokenize_compressed_file(allFilenames[fileIndex], compressions[fileIndex], fileIndex % nprocs,
+				minWordLen, maxWordLen, true, rank, nprocs, pool, ngram_word);
+		vector<ThreadCounter> threadCounters(pool.size());
+		long long bytes = tokenize_compressed_file(allFilenames[fileIndex], compressions[fileIndex], fileIndex % nprocs,
+			minWordLen, maxWordLen, false, rank, nprocs, pool, [&](int t, string_view word) {
+				count_word(threadCounters[t], word, spills.get(), pool.size());
+			});
+		merge_into_counter(threadCounters, counter, pool);
+		return bytes;
+	};
 
 	//Initialize start time
 	MPI_Barrier(MPI_COMM_WORLD);
 	startTime = MPI_Wtime();
+	PROFILE_START();
 
     if (rank == ROOT)
         cout << "Processing..." << endl;
 
-	// loop over each text file, parallely computing the frequency of words in each file one at a
-	// time, and updating the contents of the `allWordCounter` at the end of each iteration
-	for (string filename : allFilenames) {
-
-		int totalLines; // total number of lines in the file [ROOT use only]
-		int eachLines; // number of lines for each process to work on
-		int remLines; // number of remaining lines for root proccess to work on [ROOT use only]
-		Counter eachWordCounter; // word counter of this process
-
-		// ROOT proc determines the total number of lines and each process's line count
-		if (rank == ROOT) {
-			totalLines = get_line_count(filename);
-			eachLines = totalLines / nprocs; // divided equally between the processes
-			remLines = totalLines % nprocs;
-
-			// handle work for remaining lines
-			process_lines(filename, remLines, (eachLines*nprocs), eachWordCounter, minWordLen, maxWordLen);
+	// With --reduce pipeline the counter of every file is sent to ROOT without waiting for it to
+	// arrive, and ROOT merges the counters as they land
+	unique_ptr<PipelinedGather> pipeline;
+	if (options.reduce == REDUCE_PIPELINE)
+		pipeline.reset(new PipelinedGather(rank, nprocs, options.pipelineDepth, options.frontCoded));
+
+	// With --reduce hierarchical the processes are grouped by node, and the counters of a node are
+	// merged through shared memory before one counter per node goes to ROOT
+	NodeGroup nodeGroup;
+	if (options.reduce == REDUCE_HIERARCHICAL)
+		nodeGroup = make_node_group(rank, options.nodeSize);
+
+	// Merge the counter of a process into `allWordCounter` [ROOT], or with --reduce shuffle into the
+	// counters of the processes owning each word. With --top and --reduce gather, the counters stay
+	// on their process until the top words are selected at the end, and with --memory-budget until
+	// they outgrow the budget. With --approx or --ngram there is nothing to merge until the end.
+	auto reduce_counter = [&](Counter& eachWordCounter) {
+		if (options.approx || options.ngram > 0)
+			return;
+		double reduceStart = MPI_Wtime();
+		if (spills) {
+			if (localWordCounter.empty())
+				localWordCounter = move(eachWordCounter);
+			else
+				update_counter(localWordCounter, eachWordCounter);
+			if (spills->over_budget(localWordCounter, 2))
+				spills->spill(localWordCounter);
+		} else if (options.reduce == REDUCE_SHUFFLE)
+			shuffle_counter(eachWordCounter, ownedWordCounter, nprocs, options.frontCoded);
+		else if (options.top > 0 && localWordCounter.empty())
+			localWordCounter = move(eachWordCounter);
+		else if (options.top > 0)
+			update_counter(localWordCounter, eachWordCounter);
+		else if (pipeline)
+			pipeline->send(eachWordCounter, allWordCounter);
+		else if (options.reduce == REDUCE_HIERARCHICAL)
+			node_gather_counter(eachWordCounter, allWordCounter, nodeGroup, rank, options.frontCoded);
+		else
+			gather_counter(eachWordCounter, allWordCounter, rank, nprocs, options.frontCoded);
+		reduceTime += MPI_Wtime() - reduceStart;
+	};
+
+	if (options.schedule == SCHEDULE_DYNAMIC) {
+		// Cut every text file into fixed-size chunks and let each process pull the next chunk off a
+		// shared queue whenever it is done with the previous one. Every process counts all of its
+		// chunks into a single counter, which is merged only once at the end. Compressed files cannot
+		// be cut at arbitrary bytes, so they are split at their block boundaries beforehand instead.
+		Counter eachWordCounter; // word counter of this process, over all the text files
+		vector<Chunk> chunks = make_chunks(allFilenames, options.chunkSize);
+		chunks.erase(remove_if(chunks.begin(), chunks.end(), [&compressions](const Chunk& chunk) {
+			return compressions[chunk.file] != COMPRESSION_NONE;
+		}), chunks.end());
+		for (size_t fileIndex = 0; fileIndex < allFilenames.size(); fileIndex++) {
+			if (compressions[fileIndex] == COMPRESSION_NONE)
+				continue;
+			PROFILE_FILE(fileIndex);
+			double inputStart = MPI_Wtime();
+			inputBytes += count_compressed(fileIndex, eachWordCounter);
+			inputTime += MPI_Wtime() - inputStart;
 		}
-
-		// Broadcast each process's line count
-		MPI_Bcast(&eachLines, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-
-		// Each process works on their section of the text file
-		process_lines(filename, eachLines, (eachLines*rank), eachWordCounter, minWordLen, maxWordLen);
-
-		// Decomposing the counter of each proc into words and counts objects
-		string eachWords;
-		vector<int> eachCounts;
-		decompose_counter(eachWordCounter, eachWords, eachCounts);
-
-		// Variables/arguments for count data gathering
-		int sendIntAmount; 			// number of ints that each proc sends to ROOT proc
-		int *gatheredIntBuf = NULL; // large buffer array to store the gathered ints from each proc
-									// [ROOT use only]
-		int recvIntAmounts[nprocs]; // array of number of ints the ROOT proc receives from each proc
-									// [ROOT use only]
-		int intBufOffsets[nprocs]; 	// array of index offsets for `gatheredIntBuf` to correctly gather
-									// and load contiguous ints [ROOT use only]
-		int intBufSize; 			// total size of `gatheredIntBuf` to be computed [ROOT use only]
-
-		// Variables/arguments for word data gathering
-		int sendCharAmount;				// number of chars that each proc sends to ROOT proc
-		char *gatheredCharBuf = NULL; 	// large buffer array to store the gathered chars from each proc
-										// [ROOT use only]
-		int recvCharAmounts[nprocs]; 	// array of number of chars the ROOT proc receives from each
-										// proc [ROOT use only]
-		int charBufOffsets[nprocs]; 	// array of index offsets for `gatheredCharBuf` to correctly
-										// gather and load contiguous chars [ROOT use only]
-		int charBufSize;				// total size of `gatheredIntBuf` to be computed [ROOT use only]
-
-
-		// get the amount of ints for each proc to send, then gather the amounts in ROOT proc
-		sendIntAmount = eachCounts.size();
-		MPI_Gather(&sendIntAmount, 1, MPI_INT, recvIntAmounts, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-
-		// get the amount of chars for each proc to send, then gather the amounts in ROOT proc
-		sendCharAmount = eachWords.size();
-		MPI_Gather(&sendCharAmount, 1, MPI_INT, recvCharAmounts, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-
-		// ROOT proc computes and sets the index offsets and total sizes of the two large buffer arrays,
-		// also allocates memory for the two large buffer arrays.
-		if (rank == ROOT) {
-			intBufSize = charBufSize = 0; // count fromm 0 to help fill offset values
-			for (int r = 0; r < nprocs; r++) {
-				// index offsets are based on the rank values of each proc along with the total number
-				// of procs
-
-				// Compute index offsets and total size for large buffer array of ints (count data)
-				intBufOffsets[r] = intBufSize; // displacement relative to `gatheredIntBuf`
-				intBufSize += recvIntAmounts[r]; // accumulate the total size
-
-				// Compute index offsets and total size for large buffer array of chars (words data)
-				charBufOffsets[r] = charBufSize; // displacement relative to `gatheredCharBuf`
-				charBufSize += recvCharAmounts[r]; // accumulate the total of all counter sizes
+		ChunkQueue queue(chunks.size(), MPI_COMM_WORLD);
+		long long chunk;
+
+		while (true) {
+			{
+				PROFILE_SCOPE(PROF_SCHEDULE);
+				if (!queue.next(chunk))
+					break;
 			}
-
-			gatheredIntBuf = new int[intBufSize]; // allocate buffer memory based on total size
-			charBufSize += 1; // additional space for null terminating character
-			gatheredCharBuf = new char[charBufSize]; // allocate buffer memory based on total size
+			PROFILE_FILE(chunks[chunk].file);
+			const string& filename = allFilenames[chunks[chunk].file];
+			ByteRange chunkRange = align_range(filename, chunks[chunk].range);
+			double inputStart = MPI_Wtime();
+			count_range(filename, chunkRange, eachWordCounter);
+			inputTime += MPI_Wtime() - inputStart;
+			inputBytes += chunkRange.size();
 		}
 
-		// Gather counts (int data) into large contiguous buffer
-		MPI_Gatherv(&eachCounts[0], sendIntAmount, MPI_INT,
-			gatheredIntBuf, recvIntAmounts, intBufOffsets, MPI_INT,
-			ROOT, MPI_COMM_WORLD);
-
-		// Gather words (char data) into large contiguous buffer
-		MPI_Gatherv(eachWords.c_str(), sendCharAmount, MPI_CHAR,
-			gatheredCharBuf, recvCharAmounts, charBufOffsets, MPI_CHAR,
-			ROOT, MPI_COMM_WORLD);
-
-		/* Create a new word counter and merge all counter data from each proc */
-
-		if (rank == ROOT) {
-			gatheredCharBuf[charBufSize-1] = '\0'; // just in case
-
-			// checking the pairing of data points (word-count) between the int and char buffers
-			int newlineCount = 0;
-			for (int i = 0; i < charBufSize; i++) {
-				if (gatheredCharBuf[i] == '\n')
-					newlineCount++;
+		PROFILE_FILE(-1);
+		reduce_counter(eachWordCounter);
+	} else {
+		// With a cache, find out which files (or which of their first bytes) are already counted
+		bool useCache = !options.cacheDir.empty() && !options.approx && options.ngram == 0;
+		vector<CacheEntry> cacheEntries;
+		if (useCache)
+			cacheEntries = check_cache(allFilenames, options.cacheDir, minWordLen, maxWordLen,
+				options.cacheVerify, rank, nprocs);
+		int cacheLoads = 0; // unchanged files loaded from the cache so far, spread over the processes
+
+		// loop over each text file, parallely computing the frequency of words in each file one at
+		// a time, and updating the contents of the `allWordCounter` at the end of each iteration
+		for (size_t fileIndex = 0; fileIndex < allFilenames.size(); fileIndex++) {
+			const string& filename = allFilenames[fileIndex];
+			PROFILE_FILE(fileIndex);
+
+			Counter eachWordCounter; // word counter of this process
+
+			// An unchanged file is loaded from the cache by a single process, and merged as usual
+			if (useCache && cacheEntries[fileIndex].valid && cacheEntries[fileIndex].cachedSize == cacheEntries[fileIndex].fileSize) {
+				string cachePath = get_cache_path(options.cacheDir, filename, minWordLen, maxWordLen);
+				if (cacheLoads++ % nprocs == rank && !load_cache(cachePath, eachWordCounter)) {
+					cout << "Error! Cache file '" << cachePath << "' is corrupt. Aborting program." << endl;
+					exit(1);
+				}
+				reduce_counter(eachWordCounter);
+				continue;
 			}
-			if (newlineCount != intBufSize) {
-				cout << "Error! Data not aligned. Aborting program." << endl;
-				exit(1);
+			// A compressed file is split between the processes at the boundaries of its blocks, and
+			// counted whole even if its cache covers part of it
+			if (compressions[fileIndex] != COMPRESSION_NONE) {
+				if (useCache)
+					cacheEntries[fileIndex].valid = 0;
+				double inputStart = MPI_Wtime();
+				inputBytes += count_compressed(fileIndex, eachWordCounter);
+				inputTime += MPI_Wtime() - inputStart;
+				if (useCache)
+					update_cache(filename, options.cacheDir, minWordLen, maxWordLen, cacheEntries[fileIndex],
+						eachWordCounter, rank, nprocs);
+				reduce_counter(eachWordCounter);
+				continue;
+			}
+			long long countedSize = useCache ? cacheEntries[fileIndex].cachedSize : 0; // bytes already in the cache
+
+			// With MPI-IO the processes read equal shares of the file together, and swap the words
+			// cut at the edges of the shares
+			string text; 			// share of the file, plus the head of the next share
+			size_t textBegin = 0; 	// start of the first word that belongs to this process
+			long long textBytes = 0;
+			double inputStart = MPI_Wtime();
+			if (options.input == INPUT_MPIIO && countedSize == 0 && read_file_collective(filename, text, textBegin, textBytes, rank, nprocs)) {
+				count_in_memory(text.data() + textBegin, text.size() - textBegin, eachWordCounter);
+				inputTime += MPI_Wtime() - inputStart;
+				inputBytes += textBytes;
+			} else {
+				// Each process works out its own line-aligned byte range of the file (or of the bytes
+				// appended since it was cached) and works on it
+				ByteRange eachRange = !useCache ? get_split_range(filename, rank, nprocs)
+					: split_range(filename, { countedSize, cacheEntries[fileIndex].fileSize }, nprocs)[rank];
+				inputStart = MPI_Wtime();
+				count_range(filename, eachRange, eachWordCounter);
+				inputTime += MPI_Wtime() - inputStart;
+				inputBytes += eachRange.size();
 			}
-			// Create equivalent objects from respective buffers via copy constructors
-			vector<int> gatheredCounts(gatheredIntBuf, gatheredIntBuf + intBufSize);
-			string gatheredWords(gatheredCharBuf);
 
-			// Free memory of large buffers
-			delete[] gatheredIntBuf;
-			delete[] gatheredCharBuf;
+			// Write the counter of the whole file to the cache
+			if (useCache)
+				update_cache(filename, options.cacheDir, minWordLen, maxWordLen, cacheEntries[fileIndex],
+					eachWordCounter, rank, nprocs);
 
-			// Recompose a counter from gathered data
-			Counter mergedCounter;
-			compose_counter(mergedCounter, gatheredWords, gatheredCounts);
+			// Merge the counters of every process, either on ROOT or on the owner process of each word
+			reduce_counter(eachWordCounter);
+		} // end of for-loop
+		PROFILE_FILE(-1);
+	}
 
-			// Update the contents of `allWordCounter`
-			update_counter(allWordCounter, mergedCounter);
+	double reduceStart = MPI_Wtime();
+	if (options.approx) {
+		// Merge the sketches of the threads, then those of the processes on ROOT in one reduction
+		WordSketch& eachSketch = threadSketches[0].sketch;
+		{
+			PROFILE_SCOPE(PROF_MERGE);
+			for (size_t t = 1; t < threadSketches.size(); t++)
+				eachSketch.merge(threadSketches[t].sketch);
+		}
+		PROFILE_ADD(PROF_TOKENS, eachSketch.total);
+		reduce_sketch(eachSketch, rank);
+		totalWords = eachSketch.total;
+	} else if (options.ngram > 0) {
+		// Merge the n-gram counters of the threads, then merge the dictionaries of the processes and
+		// combine the remapped n-grams; only the top n-grams are decoded on ROOT
+		NgramCounter& eachNgrams = threadNgrams[0].ngrams;
+		{
+			PROFILE_SCOPE(PROF_MERGE);
+			merge_thread_ngrams(threadNgrams, pool);
+		}
+		PROFILE_ADD(PROF_TOKENS, eachNgrams.words);
+		long long eachTotal[2] = { eachNgrams.words, 0 }, total[2] = { 0, 0 };
+		eachNgrams.narrow.for_each([&eachTotal](uint64_t, long long count) { eachTotal[1] += count; });
+		eachNgrams.wide.for_each([&eachTotal](NgramKey128, long long count) { eachTotal[1] += count; });
+		MPI_Reduce(eachTotal, total, 2, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+		totalWords = total[0];
+		totalNgrams = total[1];
+		reduce_ngrams(eachNgrams, options.reduce == REDUCE_SHUFFLE, options.frontCoded,
+			options.top > 0 ? options.top : DEFAULT_NGRAM_TOP, topNgrams, uniqueNgrams, uniqueWords, rank, nprocs);
+	} else if (spills) {
+		// Spill what is left too, and merge the sorted runs of every process: each process ends up
+		// with a range of the words, of which it keeps the top words, or formats them all
+		spills->spill(localWordCounter);
+		OutputFormat format = options.outputPath.empty() ? OUTPUT_TABLE : options.outputFormat;
+		reduce_spilled_counts(*spills, options.top, format, allWordCounter, slicePath, uniqueWords, totalWords,
+			rank, nprocs);
+		long long eachSpilled[2] = { spills->spilledRuns, spills->spilledBytes };
+		MPI_Reduce(eachSpilled, spilled, 2, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+	} else if (options.top > 0) {
+		// Only the top words reach ROOT: the local top words of each owned counter if every word is
+		// owned by exactly one process, a threshold-pruned set of candidates (TPUT) otherwise
+		const Counter& eachWordCounter = options.reduce == REDUCE_SHUFFLE ? ownedWordCounter : localWordCounter;
+		long long eachTotal = get_counter_total(eachWordCounter);
+		if (options.reduce == REDUCE_SHUFFLE) {
+			long long eachUnique = get_counter_size(eachWordCounter);
+			MPI_Reduce(&eachUnique, &uniqueWords, 1, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+			top_k_disjoint(eachWordCounter, options.top, allWordCounter, rank, nprocs);
+		} else {
+			uniqueWords = count_unique_words(eachWordCounter, nprocs);
+			top_k_tput(eachWordCounter, options.top, allWordCounter, rank, nprocs);
+		}
+		MPI_Reduce(&eachTotal, &totalWords, 1, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+	} else if (options.reduce == REDUCE_SHUFFLE && !options.outputPath.empty()) {
+		// The owned counters are sorted and written out where they are
+		long long eachCounts[2] = { get_counter_size(ownedWordCounter), get_counter_total(ownedWordCounter) }, counts[2];
+		MPI_Reduce(eachCounts, counts, 2, MPI_LONG_LONG, MPI_SUM, ROOT, MPI_COMM_WORLD);
+		uniqueWords = counts[0];
+		totalWords = counts[1];
+	} else {
+		// Every word is owned by exactly one process, so ROOT only has to collect the owned counters
+		if (options.reduce == REDUCE_SHUFFLE)
+			gather_counter(ownedWordCounter, allWordCounter, rank, nprocs, options.frontCoded);
+		if (pipeline) {
+			pipeline->finish(allWordCounter);
+			double eachTimes[2] = { pipeline->inFlightTime, pipeline->inFlightTime - pipeline->blockedTime };
+			MPI_Reduce(eachTimes, pipelineTimes, 2, MPI_DOUBLE, MPI_SUM, ROOT, MPI_COMM_WORLD);
+			pipeline.reset();
 		}
-	} // end of for-loop
+		uniqueWords = get_counter_size(allWordCounter);
+		totalWords = get_counter_total(allWordCounter);
+	}
+	reduceTime += MPI_Wtime() - reduceStart;
 
 	//Initialize end time
 	MPI_Barrier(MPI_COMM_WORLD);
 	endTime = MPI_Wtime();
+	MPI_Reduce(&reduceTime, &maxReduceTime, 1, MPI_DOUBLE, MPI_MAX, ROOT, MPI_COMM_WORLD);
+
+	// Sort the words across the processes and write them to the output file in parallel, from the
+	// owned counters [--reduce shuffle] or from ROOT
+	double outputTime = 0;
+	EntryOrder order = options.alphabetical ? alphabetical : most_common;
+	if (!options.outputPath.empty()) {
+		double outputStart = MPI_Wtime();
+		bool owned = options.reduce == REDUCE_SHUFFLE && options.top == 0;
+		if (spills && options.top == 0)
+			write_spilled(slicePath, options.outputPath, options.outputFormat, rank, nprocs);
+		else
+			write_counter(owned ? ownedWordCounter : allWordCounter, options.outputPath, options.outputFormat, order,
+				rank, nprocs);
+		outputTime = MPI_Wtime() - outputStart;
+	}
+
+	// Write the index of every word on ROOT, collecting the owned counters first if they were written
+	// out where they are [--reduce shuffle]
+	double indexTime = 0;
+	if (!options.indexPath.empty()) {
+		double indexStart = MPI_Wtime();
+		if (options.reduce == REDUCE_SHUFFLE && !options.outputPath.empty())
+			gather_counter(ownedWordCounter, allWordCounter, rank, nprocs, options.frontCoded);
+		if (rank == ROOT && !write_index(allWordCounter, options.indexPath)) {
+			cout << "Error: could not write index '" << options.indexPath << "'" << endl;
+			exit(1);
+		}
+		indexTime = MPI_Wtime() - indexStart;
+	}
+
+	// The words of every range are printed by ROOT a block at a time, in alphabetical order
+	// [--memory-budget without --top]
+	bool printSpilled = spills && options.top == 0 && options.outputPath.empty();
+	if (printSpilled && rank != ROOT)
+		print_spilled(slicePath, rank, nprocs);
 
 	if (rank == ROOT) {
 		// Output the final report
         cout << "---------------------------------------------" << endl;
 		cout << "|             Word Count Report             |" << endl;
-        print_counter(allWordCounter, most_common);
-		cout << "Unique words: " << get_counter_size(allWordCounter) << endl;
-		cout << "Total words : "<< get_counter_total(allWordCounter) << endl;
+		if (options.ngram > 0)
+			cout << "Top " << (options.top > 0 ? options.top : DEFAULT_NGRAM_TOP) << " " << options.ngram << "-grams:" << endl;
+		else if (options.top > 0)
+			cout << "Top " << options.top << " words:" << endl;
+		if (options.approx) {
+			print_sketch_report(threadSketches[0].sketch, options.top);
+		} else if (options.ngram > 0) {
+			print_ngram_report(topNgrams, options.ngram);
+			cout << "Unique " << options.ngram << "-grams: " << uniqueNgrams << endl;
+			cout << "Total " << options.ngram << "-grams : " << totalNgrams << endl;
+			cout << "Unique words: " << uniqueWords << endl;
+		} else if (!options.outputPath.empty()) {
+			cout << "Words written to " << options.outputPath << " in " << outputTime
+				<< (spills ? " (merged from sorted runs over " : " (sample sort over ") << nprocs << " processes)" << endl;
+			cout << "Unique words: " << uniqueWords << endl;
+		} else if (printSpilled) {
+			print_spilled(slicePath, rank, nprocs);
+			cout << "Unique words: " << uniqueWords << endl;
+		} else {
+			print_counter(allWordCounter, order);
+			cout << "Unique words: " << uniqueWords << endl;
+		}
+		cout << "Total words : "<< totalWords << endl;
 		cout << "Total time : "<< (endTime - startTime) << endl;
+		cout << "Reduce time: " << maxReduceTime << " (" << (options.approx ? "sketch" : spills ? "spill merge" : reduce_mode_name(options.reduce));
+		if (nodeGroup.leaders != MPI_COMM_NULL) {
+			int nodes;
+			MPI_Comm_size(nodeGroup.leaders, &nodes);
+			cout << " over " << nodes << (nodes == 1 ? " node" : " nodes");
+		}
+		cout << ")" << endl;
+		if (spills)
+			cout << "Spilled: " << spilled[0] << " sorted runs, " << spilled[1] / 1e6 << " MB (memory budget "
+				<< options.memoryBudget / double(1 << 20) << " MB per process)" << endl;
+		if (!options.indexPath.empty())
+			cout << "Index written to " << options.indexPath << " in " << indexTime << " (query with IndexQuery)" << endl;
+		if (pipelineTimes[0] > 0)
+			cout << "Hidden communication: " << pipelineTimes[1] << " of " << pipelineTimes[0]
+				<< " with counters in flight (summed over the processes)" << endl;
 	}
 
+	if (options.reportThroughput)
+		print_throughput(rank, nprocs, inputBytes, inputTime, options.input);
+
+	if (options.profile)
+		report_profile(rank, nprocs, allFilenames, options.profileJson, options.profileTrace);
+
+	if (nodeGroup.node != MPI_COMM_NULL)
+		free_node_group(nodeGroup);
+
 	// Finalize the MPI environment.
     MPI_Finalize();
 
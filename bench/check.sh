@@ -0,0 +1,140 @@
+#!/bin/bash
+# Correctness check of the word counter against an independent reference count.
+#
+# The reference is computed by grep with the original word pattern, so every mode of the word
+# counter (process counts, threads, input, reduction and schedule options) is checked against the
+# same expected counts of the test-data/ and ascii-only/ files.
+#
+# Usage (from the repository root, after compiling ./ass):
+#	$ bench/check.sh [file ...]
+# Environment:
+#	RANKS="1 2 3 4"    process counts to try
+#	MIN=1 MAX=20       word length bounds
+#	MPIRUN="mpirun"    MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass          word counter executable
+#	QUERY=./IndexQuery index query tool, the --index checks are skipped without it
+
+RANKS=${RANKS:-"1 2 3 4"}
+MIN=${MIN:-1}
+MAX=${MAX:-20}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+QUERY=${QUERY:-./IndexQuery}
+FILES=("$@")
+[ ${#FILES[@]} -eq 0 ] && FILES=(test-data/*.txt ascii-only/*.txt)
+
+export LC_ALL=C
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# option sets to check, each with every process count (the cache is filled by the first run of
+# its config, and read by the others)
+CONFIGS=(
+	""
+	"--threads 3"
+	"--input fstream"
+	"--input stream --block-size 0.1 --threads 2"
+	"--input mpiio --threads 2"
+	"--reduce shuffle"
+	"--front-coding"
+	"--reduce shuffle --front-coding --threads 2"
+	"--reduce pipeline"
+	"--reduce pipeline --pipeline-depth 1 --front-coding --threads 2"
+	"--reduce hierarchical"
+	"--reduce hierarchical --node-size 2 --front-coding --threads 2"
+	"--schedule dynamic --chunk-size 0.05"
+	"--schedule dynamic --chunk-size 0.05 --reduce shuffle"
+	"--schedule dynamic --chunk-size 0.05 --reduce pipeline"
+	"--schedule dynamic --chunk-size 0.05 --reduce hierarchical --node-size 1"
+	"--cache $tmp/cache"
+	"--cache $tmp/cache --cache-verify --reduce shuffle"
+	"--cache $tmp/cache --reduce pipeline"
+	"--memory-budget 0.05 --threads 2"
+	"--memory-budget 0.2 --reduce shuffle --front-coding"
+)
+
+# "word count" lines, sorted by word
+LC_ALL=C grep -ohP "(?!\d)[^\W_]+(?:['_-][^\W_]+)*" "${FILES[@]}" \
+	| awk -v min="$MIN" -v max="$MAX" 'length($0) >= min && length($0) <= max { print tolower($0) }' \
+	| sort | uniq -c | awk '{ print $2, $1 }' > "$tmp/expected"
+
+report_counts() {
+	# Keep the "word count" lines of a word count report, sorted by word
+	awk -F'|' '/^Total time/ { exit } /^\| / && NF >= 5 && $2 !~ /^ Word / { w = $2; gsub(/ /, "", w); print w, $4 + 0 }' | sort
+}
+
+failures=0
+for config in "${CONFIGS[@]}"; do
+	for np in $RANKS; do
+		$MPIRUN -n "$np" "$EXE" $config --min-length "$MIN" --max-length "$MAX" "${FILES[@]}" \
+			| report_counts > "$tmp/actual"
+		if cmp -s "$tmp/expected" "$tmp/actual"; then
+			echo "PASS  -n $np $config"
+		else
+			echo "FAIL  -n $np $config"
+			diff "$tmp/expected" "$tmp/actual" | head -5
+			failures=$((failures + 1))
+		fi
+	done
+done
+
+# the words written to a file with --output, as CSV, sorted across the processes
+for config in "--reduce shuffle --sort alphabetical" "--sort frequency --threads 2" "--memory-budget 0.05"; do
+	for np in $RANKS; do
+		$MPIRUN -n "$np" "$EXE" $config --output "$tmp/words.csv" --format csv --min-length "$MIN" --max-length "$MAX" \
+			"${FILES[@]}" > /dev/null
+		tail -n +2 "$tmp/words.csv" | awk -F, '{ print $1, $3 }' | sort > "$tmp/actual"
+		if cmp -s "$tmp/expected" "$tmp/actual"; then
+			echo "PASS  -n $np $config --output (csv)"
+		else
+			echo "FAIL  -n $np $config --output (csv)"
+			diff "$tmp/expected" "$tmp/actual" | head -5
+			failures=$((failures + 1))
+		fi
+	done
+done
+
+# the files piped into --stream, in small batches, with a window longer than the run
+for config in "--dispatch load" "--dispatch round-robin --stream-queue 1"; do
+	for np in $RANKS; do
+		cat "${FILES[@]}" | $MPIRUN -n "$np" "$EXE" --stream - --window 3600 --top 100000000 --batch-size 16 $config \
+			--min-length "$MIN" --max-length "$MAX" | report_counts > "$tmp/actual"
+		if cmp -s "$tmp/expected" "$tmp/actual"; then
+			echo "PASS  -n $np --stream $config"
+		else
+			echo "FAIL  -n $np --stream $config"
+			diff "$tmp/expected" "$tmp/actual" | head -5
+			failures=$((failures + 1))
+		fi
+	done
+done
+
+# the words of an --index, looked up one by one, and listed in full after merging the indexes of
+# two halves of the files
+if [ -x "$QUERY" ]; then
+	half=$(((${#FILES[@]} + 1) / 2))
+	for config in "--reduce gather" "--reduce shuffle --output $tmp/words.csv --format csv"; do
+		for np in $RANKS; do
+			$MPIRUN -n "$np" "$EXE" $config --index "$tmp/all.idx" --min-length "$MIN" --max-length "$MAX" \
+				"${FILES[@]}" > /dev/null
+			cut -d' ' -f1 "$tmp/expected" | tr '\n' '\0' | xargs -0 "$QUERY" "$tmp/all.idx" count | sort > "$tmp/actual"
+			$MPIRUN -n "$np" "$EXE" $config --index "$tmp/first.idx" --min-length "$MIN" --max-length "$MAX" \
+				"${FILES[@]:0:$half}" > /dev/null
+			$MPIRUN -n "$np" "$EXE" $config --index "$tmp/second.idx" --min-length "$MIN" --max-length "$MAX" \
+				"${FILES[@]:$half}" > /dev/null
+			"$QUERY" --merge "$tmp/merged.idx" "$tmp/first.idx" "$tmp/second.idx" > /dev/null
+			"$QUERY" "$tmp/merged.idx" prefix "" | report_counts > "$tmp/merged"
+			if cmp -s "$tmp/expected" "$tmp/actual" && cmp -s "$tmp/expected" "$tmp/merged"; then
+				echo "PASS  -n $np $config --index"
+			else
+				echo "FAIL  -n $np $config --index"
+				diff "$tmp/expected" "$tmp/actual" | head -5
+				diff "$tmp/expected" "$tmp/merged" | head -5
+				failures=$((failures + 1))
+			fi
+		done
+	done
+fi
+
+echo "$(wc -l < "$tmp/expected") unique words, $failures failure(s)"
+[ $failures -eq 0 ]
@@ -0,0 +1,86 @@
+#!/bin/bash
+# Benchmark of compressed input: end-to-end time of counting a compressed corpus directly, against
+# decompressing it to disk first and counting the decompressed file. Writes one CSV row per run with
+# the best wall-clock time (launch included) of REPEAT runs.
+#
+# The corpus is compressed with every tool found: gzip, bgzip (BGZF, split between processes),
+# zstd, and t2sz (seekable zstd, split between processes). Formats whose tool is missing are skipped.
+#
+# Usage (from the repository root, after compiling ./ass with -DWC_GZIP -lz -DWC_ZSTD -lzstd, and
+# ./CorpusGen):
+#	$ bench/compressed.sh > compressed.csv
+# Environment:
+#	RANKS="1 2 4"          process counts to try
+#	SIZE=64                corpus size (MB)
+#	VOCAB=100000           vocabulary size
+#	REPEAT=3               runs of each configuration, the fastest one is kept
+#	ARGS=""                extra options of the word counter (e.g. "--threads 4")
+#	MPIRUN="mpirun"        MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass              word counter executable
+#	GEN=./CorpusGen        corpus generator executable
+#	CORPUS_DIR=/tmp/wc-corpus  where the generated corpora are kept between runs
+
+RANKS=${RANKS:-"1 2 4"}
+SIZE=${SIZE:-64}
+VOCAB=${VOCAB:-100000}
+REPEAT=${REPEAT:-3}
+ARGS=${ARGS:-}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+GEN=${GEN:-./CorpusGen}
+CORPUS_DIR=${CORPUS_DIR:-${TMPDIR:-/tmp}/wc-corpus}
+
+mkdir -p "$CORPUS_DIR"
+file="$CORPUS_DIR/zipf-${SIZE}mb-${VOCAB}.txt"
+[ -f "$file" ] || "$GEN" --size "$SIZE" --vocab "$VOCAB" --output "$file" 2> /dev/null
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# format name, compressed file, compress command, decompress command
+FORMATS=()
+compress() {
+	local name=$1 ext=$2 tool=$3 compressCmd=$4 decompressCmd=$5
+	command -v "$tool" > /dev/null || return
+	[ -f "$file.$ext" ] || $compressCmd < "$file" > "$file.$ext"
+	FORMATS+=("$name|$file.$ext|$decompressCmd")
+}
+compress gzip gz gzip "gzip -c" "gzip -dc"
+compress bgzf bgz bgzip "bgzip -c" "bgzip -dc"
+compress zstd zst zstd "zstd -q -c" "zstd -q -dc"
+compress zstd-seekable szst t2sz "t2sz -s 1M -o /dev/stdout /dev/stdin" "zstd -q -dc"
+
+seconds() {
+	# Print the wall-clock seconds of a command
+	local start=$(date +%s.%N)
+	"$@" > /dev/null
+	awk -v start="$start" -v end="$(date +%s.%N)" 'BEGIN { printf "%.6f\n", end - start }'
+}
+
+best() {
+	# Print the fastest of REPEAT runs of a command
+	for ((i = 0; i < REPEAT; i++)); do
+		seconds "$@"
+	done | sort -g | head -1
+}
+
+decompress_then_count() {
+	local np=$1 compressed=$2 decompressCmd=$3
+	$decompressCmd < "$compressed" > "$tmp/corpus.txt"
+	$MPIRUN -n "$np" "$EXE" $ARGS --top 10 "$tmp/corpus.txt"
+}
+
+echo "format,ranks,mode,compressed_mb,seconds,mb_per_s"
+for format in "${FORMATS[@]}"; do
+	IFS='|' read name compressed decompressCmd <<< "$format"
+	bytes=$(stat -c %s "$file")
+	compressedMb=$(awk -v b="$(stat -c %s "$compressed")" 'BEGIN { printf "%.1f", b / 1e6 }')
+	for np in $RANKS; do
+		direct=$(best $MPIRUN -n "$np" "$EXE" $ARGS --top 10 "$compressed")
+		staged=$(best decompress_then_count "$np" "$compressed" "$decompressCmd")
+		for run in "direct $direct" "decompress-then-count $staged"; do
+			set -- $run
+			awk -v name="$name" -v np="$np" -v mode="$1" -v mb="$compressedMb" -v t="$2" -v bytes="$bytes" \
+				'BEGIN { printf "%s,%d,%s,%s,%.6f,%.1f\n", name, np, mode, mb, t, bytes / 1e6 / t }'
+		done
+	done
+done
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Benchmark of the input modes of the word counter: memory mapping, fstream, the streaming block
+# reader and collective MPI-IO, on the same synthetic Zipf corpus for every process count. Writes
+# one CSV row per run with the best total time of REPEAT runs.
+#
+# The first run of each configuration warms the page cache, so with REPEAT > 1 the results measure
+# reads from memory; drop the caches between runs (or use a file larger than memory, or a parallel
+# file system for MPI-IO) to measure the storage itself.
+#
+# Usage (from the repository root, after compiling ./ass and ./CorpusGen):
+#	$ bench/input.sh > input.csv
+# Environment:
+#	MODES="mmap fstream stream mpiio"  input modes to compare
+#	RANKS="1 2 4"          process counts to try
+#	SIZE=64                corpus size (MB)
+#	VOCAB=100000           vocabulary size
+#	REPEAT=3               runs of each configuration, the fastest one is kept
+#	ARGS=""                extra options of the word counter (e.g. "--threads 4")
+#	MPIRUN="mpirun"        MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass              word counter executable
+#	GEN=./CorpusGen        corpus generator executable
+#	CORPUS_DIR=/tmp/wc-corpus  where the generated corpora are kept between runs
+
+MODES=${MODES:-"mmap fstream stream mpiio"}
+RANKS=${RANKS:-"1 2 4"}
+SIZE=${SIZE:-64}
+VOCAB=${VOCAB:-100000}
+REPEAT=${REPEAT:-3}
+ARGS=${ARGS:-}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+GEN=${GEN:-./CorpusGen}
+CORPUS_DIR=${CORPUS_DIR:-${TMPDIR:-/tmp}/wc-corpus}
+
+mkdir -p "$CORPUS_DIR"
+file="$CORPUS_DIR/zipf-${SIZE}mb-${VOCAB}.txt"
+[ -f "$file" ] || "$GEN" --size "$SIZE" --vocab "$VOCAB" --output "$file" 2> /dev/null
+bytes=$(stat -c %s "$file")
+
+echo "mode,ranks,size_mb,seconds,mb_per_s"
+for mode in $MODES; do
+	for np in $RANKS; do
+		for ((i = 0; i < REPEAT; i++)); do
+			$MPIRUN -n "$np" "$EXE" $ARGS --input "$mode" --top 10 "$file" | awk '/^Total time/ { print $4 }'
+		done | sort -g | head -1 | awk -v mode="$mode" -v np="$np" -v bytes="$bytes" '{
+			printf "%s,%d,%.1f,%.6f,%.1f\n", mode, np, bytes / 1e6, $1, bytes / 1e6 / $1
+		}'
+	done
+done
@@ -0,0 +1,75 @@
+#!/bin/bash
+# Benchmark of the node-aware (hierarchical) reduction against the flat gather, over process counts
+# and node layouts, on synthetic Zipf-distributed corpora made by CorpusGen. Writes one CSV row per
+# run, with the reduce time of the slowest process; speedup = gather time / hierarchical time of the
+# same process count and corpus.
+#
+# On one machine the layouts are simulated with --node-size, which cuts the processes of the machine
+# into groups of at most N processes, each reduced as a node (0 keeps the whole machine one node).
+# On a cluster, give the launcher a layout instead, e.g. MPIRUN="mpirun --map-by ppr:4:node" and
+# NODE_SIZES=0, and the nodes are the real ones.
+#
+# Usage (from the repository root, after compiling ./ass and ./CorpusGen):
+#	$ bench/reduce.sh > reduce.csv
+# Environment:
+#	RANKS="2 4 8"          process counts to try
+#	NODE_SIZES="1 2 4 0"   processes per node group of --reduce hierarchical, 0 for whole nodes
+#	SIZE=64                corpus size (MB)
+#	VOCABS="100000 1000000" vocabulary sizes, large ones make the reduction dominate
+#	REPEAT=3               runs of each configuration, the fastest one is kept
+#	ARGS=""                extra options of the word counter (e.g. "--front-coding")
+#	MPIRUN="mpirun"        MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass              word counter executable
+#	GEN=./CorpusGen        corpus generator executable
+#	CORPUS_DIR=/tmp/wc-corpus  where the generated corpora are kept between runs
+
+RANKS=${RANKS:-"2 4 8"}
+NODE_SIZES=${NODE_SIZES:-"1 2 4 0"}
+SIZE=${SIZE:-64}
+VOCABS=${VOCABS:-"100000 1000000"}
+REPEAT=${REPEAT:-3}
+ARGS=${ARGS:-}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+GEN=${GEN:-./CorpusGen}
+CORPUS_DIR=${CORPUS_DIR:-${TMPDIR:-/tmp}/wc-corpus}
+
+mkdir -p "$CORPUS_DIR"
+
+corpus() {
+	# Print the path of the corpus of the given size and vocabulary, generating it if needed
+	local size=$1 vocab=$2
+	local file="$CORPUS_DIR/zipf-${size}mb-${vocab}.txt"
+	[ -f "$file" ] || "$GEN" --size "$size" --vocab "$vocab" --output "$file" 2> /dev/null
+	echo "$file"
+}
+
+run_best() {
+	# Print "reduce_seconds total_seconds nodes" of the run with the fastest reduction of REPEAT runs
+	local np=$1 file=$2
+	shift 2
+	for ((i = 0; i < REPEAT; i++)); do
+		$MPIRUN -n "$np" "$EXE" $ARGS "$@" "$file" | awk '
+			/^Total time/ { total = $4 }
+			/^Reduce time/ { reduce = $3; nodes = /over [0-9]+ node/ ? $(NF - 1) : 1 }
+			END { print reduce, total, nodes }'
+	done | sort -g | head -1
+}
+
+echo "ranks,vocab,reduce,node_size,nodes,reduce_seconds,total_seconds,speedup"
+for vocab in $VOCABS; do
+	file=$(corpus "$SIZE" "$vocab")
+	for np in $RANKS; do
+		read base total nodes <<< "$(run_best "$np" "$file" --reduce gather)"
+		echo "$np,$vocab,gather,,,$base,$total,1.000"
+		for size in $NODE_SIZES; do
+			[ "$size" -gt "$np" ] && continue
+			[ "$size" -eq 0 ] && option=() || option=(--node-size "$size")
+			read t total nodes <<< "$(run_best "$np" "$file" --reduce hierarchical "${option[@]}")"
+			awk -v np="$np" -v vocab="$vocab" -v size="$size" -v nodes="$nodes" -v t="$t" -v total="$total" \
+				-v base="$base" 'BEGIN {
+				printf "%d,%d,hierarchical,%d,%d,%.6f,%.6f,%.3f\n", np, vocab, size, nodes, t, total, base / t
+			}'
+		done
+	done
+done
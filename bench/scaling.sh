@@ -0,0 +1,35 @@
+#!/bin/bash
+# Scaling report of the word counter across MPI ranks x threads per rank.
+#
+# Usage (from the repository root, after compiling ./ass):
+#	$ bench/scaling.sh [file ...]
+# Environment:
+#	RANKS="1 2 4"      process counts to try
+#	THREADS="1 2 4"    threads per process to try
+#	MPIRUN="mpirun"    MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass          word counter executable
+
+RANKS=${RANKS:-"1 2 4"}
+THREADS=${THREADS:-"1 2 4"}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+FILES=("$@")
+[ ${#FILES[@]} -eq 0 ] && FILES=(ascii-only/shelly.txt test-data/fruits-all.txt)
+
+run_once() {
+	# Print the "Total time" of the word counter
+	local np=$1 nt=$2
+	$MPIRUN -n "$np" "$EXE" --threads "$nt" --top 10 "${FILES[@]}" | awk '/^Total time/ { print $4 }'
+}
+
+base=$(run_once 1 1)
+printf "| %5s | %7s | %5s | %10s | %7s | %10s |\n" Ranks Threads Cores Time Speedup Efficiency
+for np in $RANKS; do
+	for nt in $THREADS; do
+		t=$(run_once "$np" "$nt")
+		awk -v np="$np" -v nt="$nt" -v t="$t" -v base="$base" 'BEGIN {
+			cores = np * nt; speedup = base / t
+			printf "| %5d | %7d | %5d | %10.4f | %7.2f | %9.1f%% |\n", np, nt, cores, t, speedup, 100 * speedup / cores
+		}'
+	done
+done
@@ -0,0 +1,81 @@
+#!/bin/bash
+# Benchmark sweep of the word counter over process counts, corpus sizes and vocabulary sizes, on
+# synthetic Zipf-distributed corpora made by CorpusGen. Writes one CSV row per run:
+#	strong scaling: the same corpus for every process count,
+#	                efficiency = time(1 process) / (processes * time)
+#	weak scaling:   WEAK_SIZE MB per process, efficiency = time(1 process) / time
+#
+# Usage (from the repository root, after compiling ./ass and ./CorpusGen):
+#	$ bench/sweep.sh > results.csv
+# Environment:
+#	RANKS="1 2 4"          process counts to try
+#	SIZES="16 64"          corpus sizes (MB) of the strong scaling runs
+#	VOCABS="10000 1000000" vocabulary sizes
+#	WEAK_SIZE=16           corpus size (MB) per process of the weak scaling runs
+#	REPEAT=3               runs of each configuration, the fastest one is kept
+#	ARGS=""                extra options of the word counter (e.g. "--threads 4 --reduce shuffle")
+#	MPIRUN="mpirun"        MPI launcher (e.g. "mpirun --oversubscribe")
+#	EXE=./ass              word counter executable
+#	GEN=./CorpusGen        corpus generator executable
+#	CORPUS_DIR=/tmp/wc-corpus  where the generated corpora are kept between sweeps
+
+RANKS=${RANKS:-"1 2 4"}
+SIZES=${SIZES:-"16 64"}
+VOCABS=${VOCABS:-"10000 1000000"}
+WEAK_SIZE=${WEAK_SIZE:-16}
+REPEAT=${REPEAT:-3}
+ARGS=${ARGS:-}
+MPIRUN=${MPIRUN:-mpirun}
+EXE=${EXE:-./ass}
+GEN=${GEN:-./CorpusGen}
+CORPUS_DIR=${CORPUS_DIR:-${TMPDIR:-/tmp}/wc-corpus}
+
+mkdir -p "$CORPUS_DIR"
+
+corpus() {
+	# Print the path of the corpus of the given size and vocabulary, generating it if needed
+	local size=$1 vocab=$2
+	local file="$CORPUS_DIR/zipf-${size}mb-${vocab}.txt"
+	[ -f "$file" ] || "$GEN" --size "$size" --vocab "$vocab" --output "$file" 2> /dev/null
+	echo "$file"
+}
+
+run_best() {
+	# Print "seconds words" of the fastest of REPEAT runs on a file
+	local np=$1 file=$2
+	for ((i = 0; i < REPEAT; i++)); do
+		$MPIRUN -n "$np" "$EXE" $ARGS --top 10 "$file" \
+			| awk '/^Total words/ { words = $4 } /^Total time/ { time = $4 } END { print time, words }'
+	done | sort -g | head -1
+}
+
+row() {
+	# Print a CSV row, given the scaling mode, ranks, file, vocabulary, run result and baseline time
+	local scaling=$1 np=$2 file=$3 vocab=$4 seconds=$5 words=$6 base=$7
+	awk -v scaling="$scaling" -v np="$np" -v bytes="$(stat -c %s "$file")" -v vocab="$vocab" \
+		-v t="$seconds" -v words="$words" -v base="$base" 'BEGIN {
+		speedup = scaling == "strong" ? base / t : np * base / t
+		efficiency = scaling == "strong" ? base / (np * t) : base / t
+		printf "%s,%d,%.1f,%d,%.6f,%.1f,%.0f,%.3f,%.3f\n", scaling, np, bytes / 1e6, vocab, t,
+			bytes / 1e6 / t, words / t, speedup, efficiency
+	}'
+}
+
+echo "scaling,ranks,size_mb,vocab,seconds,mb_per_s,words_per_s,speedup,efficiency"
+for vocab in $VOCABS; do
+	for size in $SIZES; do
+		file=$(corpus "$size" "$vocab")
+		read base words <<< "$(run_best 1 "$file")"
+		for np in $RANKS; do
+			read t words <<< "$(run_best "$np" "$file")"
+			row strong "$np" "$file" "$vocab" "$t" "$words" "$base"
+		done
+	done
+
+	read base words <<< "$(run_best 1 "$(corpus "$WEAK_SIZE" "$vocab")")"
+	for np in $RANKS; do
+		file=$(corpus $((WEAK_SIZE * np)) "$vocab")
+		read t words <<< "$(run_best "$np" "$file")"
+		row weak "$np" "$file" "$vocab" "$t" "$words" "$base"
+	done
+done